@@ -0,0 +1,130 @@
+# hornetseye-alsa - Play audio data using libalsa
+# Copyright (C) 2012 Jan Wedekind
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Benchmark of the read and write paths using the ALSA null and file plugins.
+# No sound hardware is required. Every configuration of the matrix is reported as
+# a table row on standard output and as a JSON object per line in the file given
+# by BENCH_OUTPUT (default: bench/results.json).
+#
+# Environment variables:
+#   BENCH_CALLS     Number of timed calls per configuration (default: 200)
+#   BENCH_BLOCKS    Comma-separated block sizes in frames (default: 64,256,1024,4096)
+#   BENCH_CHANNELS  Comma-separated channel counts (default: 1,2,8)
+#   BENCH_RATES     Comma-separated sampling rates (default: 44100,48000,96000)
+#   BENCH_OUTPUT    File for machine-readable results
+require 'json'
+require 'fileutils'
+require 'tmpdir'
+require 'hornetseye_alsa'
+include Hornetseye
+
+def env_list(name, default)
+  (ENV[name] || default).split(',').collect { |x| x.to_i }
+end
+
+CALLS = (ENV['BENCH_CALLS'] || 200).to_i
+BLOCKS = env_list 'BENCH_BLOCKS', '64,256,1024,4096'
+CHANNELS = env_list 'BENCH_CHANNELS', '1,2,8'
+RATES = env_list 'BENCH_RATES', '44100,48000,96000'
+OUTPUT = ENV['BENCH_OUTPUT'] || File.join(File.dirname(__FILE__), 'results.json')
+RAW_FILE = File.join Dir.tmpdir, "hornetseye-alsa-bench-#{Process.pid}.raw"
+
+def percentile(sorted, p)
+  sorted[[(sorted.size * p).ceil - 1, 0].max]
+end
+
+def now
+  Process.clock_gettime Process::CLOCK_MONOTONIC
+end
+
+# Time the specified block once per call after a warm-up call
+def measure(frames_per_call)
+  yield
+  times = []
+  allocated = GC.stat :total_allocated_objects
+  gc_count = GC.count
+  start = now
+  CALLS.times do
+    t = now
+    yield
+    times << now - t
+  end
+  elapsed = now - start
+  allocated = GC.stat(:total_allocated_objects) - allocated
+  gc_count = GC.count - gc_count
+  times.sort!
+  { :frames_per_second => frames_per_call * CALLS / elapsed,
+    :p50 => percentile(times, 0.5) * 1e6, :p90 => percentile(times, 0.9) * 1e6,
+    :p99 => percentile(times, 0.99) * 1e6, :max => times.last * 1e6,
+    :allocations_per_call => allocated.to_f / CALLS, :gc_count => gc_count }
+end
+
+def bench_output(pcm_name, rate, channels, block)
+  speaker = AlsaOutput.new pcm_name, rate, channels
+  frame = MultiArray(SINT, 2).new(channels, block).fill! 0
+  result = measure(block) { speaker.write frame }
+  speaker.drop
+  speaker.close
+  result
+end
+
+def bench_input(pcm_name, rate, channels, block, into)
+  microphone = AlsaInput.new pcm_name, rate, channels
+  frame = MultiArray(SINT, 2).new(channels, block)
+  result = if into
+    measure(block) { microphone.read_into frame }
+  else
+    measure(block) { microphone.read block }
+  end
+  microphone.close
+  result
+end
+
+CASES = [
+  [ 'write', 'null', lambda { |r, c, b| bench_output 'null', r, c, b } ],
+  [ 'write', 'file', lambda { |r, c, b| bench_output "file:FILE=#{RAW_FILE},FORMAT=raw", r, c, b } ],
+  [ 'read', 'null', lambda { |r, c, b| bench_input 'null', r, c, b, false } ],
+  [ 'read_into', 'null', lambda { |r, c, b| bench_input 'null', r, c, b, true } ]
+]
+
+FileUtils.mkdir_p File.dirname(OUTPUT)
+File.open OUTPUT, 'w' do |json|
+  printf "%-9s %-4s %6s %2s %5s %12s %9s %9s %9s %9s %7s %3s\n", 'method', 'pcm', 'rate',
+         'ch', 'block', 'frames/s', 'p50[us]', 'p90[us]', 'p99[us]', 'max[us]', 'alloc',
+         'gc'
+  CASES.each do |method, pcm, bench|
+    RATES.each do |rate|
+      CHANNELS.each do |channels|
+        BLOCKS.each do |block|
+          begin
+            result = bench.call rate, channels, block
+          rescue RuntimeError => e
+            STDERR.puts "#{method} #{pcm} #{rate} #{channels} #{block}: #{e.message}"
+            next
+          end
+          printf "%-9s %-4s %6d %2d %5d %12.0f %9.1f %9.1f %9.1f %9.1f %7.1f %3d\n",
+                 method, pcm, rate, channels, block, result[:frames_per_second],
+                 result[:p50], result[:p90], result[:p99], result[:max],
+                 result[:allocations_per_call], result[:gc_count]
+          json.puts({ :method => method, :pcm => pcm, :rate => rate,
+                      :channels => channels, :block => block,
+                      :calls => CALLS }.merge(result).to_json)
+        end
+      end
+    end
+  end
+end
+FileUtils.rm_f RAW_FILE
@@ -9,9 +9,10 @@ CC_FILES = FileList[ 'ext/*.cc' ]
 HH_FILES = FileList[ 'ext/*.hh' ] + FileList[ 'ext/*.tcc' ]
 TC_FILES = FileList[ 'test/tc_*.rb' ]
 TS_FILES = FileList[ 'test/ts_*.rb' ]
+BENCH_FILES = FileList[ 'bench/bench_*.rb' ]
 SO_FILE = "ext/#{PKG_NAME.tr '\-', '_'}.#{CFG[ 'DLEXT' ]}"
 PKG_FILES = [ 'Rakefile', 'README.md', 'COPYING', '.document' ] +
-            RB_FILES + CC_FILES + HH_FILES + TS_FILES + TC_FILES
+            RB_FILES + CC_FILES + HH_FILES + TS_FILES + TC_FILES + BENCH_FILES
 BIN_FILES = [ 'README.md', 'COPYING', '.document', SO_FILE ] +
             RB_FILES + TS_FILES + TC_FILES
 SUMMARY = %q{Play audio data using libalsa}
@@ -0,0 +1,731 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "alsaduplex.hh"
+
+using namespace std;
+
+VALUE AlsaDuplex::cRubyClass = Qnil;
+
+static unsigned int duplexBufferTime(unsigned int rate, snd_pcm_uframes_t periodSize,
+                                     unsigned int periods)
+{
+  return rate > 0 ? (unsigned int)(periodSize * periods * 1000000LL / rate) : 0;
+}
+
+AlsaDuplex::AlsaDuplex(const string &captureName, const string &playbackName,
+                       unsigned int rate, unsigned int captureChannels,
+                       unsigned int playbackChannels, SampleFormat format,
+                       snd_pcm_uframes_t periodSize, unsigned int periods,
+                       int prefill, int tapSize) throw (Error):
+  m_captureName(captureName), m_playbackName(playbackName),
+  m_captureConfig(captureName, SND_PCM_STREAM_CAPTURE, rate, captureChannels, format,
+                  false, duplexBufferTime(rate, periodSize, periods), periods,
+                  periodSize),
+  m_playbackConfig(playbackName, SND_PCM_STREAM_PLAYBACK, rate, playbackChannels,
+                   format, false, duplexBufferTime(rate, periodSize, periods),
+                   periods, periodSize),
+  m_rate(rate), m_captureChannels(captureChannels),
+  m_playbackChannels(playbackChannels), m_format(format), m_periodSize(periodSize),
+  m_periods(periods), m_prefill(prefill), m_linked(false), m_kernel(NULL),
+  m_inUse(NULL), m_threadInitialised(false), m_running(false), m_quit(false)
+{
+  m_capture.pcm = NULL;
+  m_playback.pcm = NULL;
+  ERRORMACRO(rate > 0 && periodSize > 0, Error, , "Sampling rate and period size of "
+             "duplex devices \"" << m_captureName << "\" and \"" << m_playbackName
+             << "\" must be positive");
+  ERRORMACRO(captureChannels > 0 && playbackChannels > 0, Error, , "Duplex devices \""
+             << m_captureName << "\" and \"" << m_playbackName << "\" need at least "
+             "one channel");
+  try {
+    m_capture = PCMPool::acquire(m_captureConfig);
+    m_playback = PCMPool::acquire(m_playbackConfig);
+    ERRORMACRO(m_capture.rate == m_playback.rate, Error, , "PCM device \""
+               << m_captureName << "\" captures at " << m_capture.rate << " Hz but \""
+               << m_playbackName << "\" plays at " << m_playback.rate << " Hz");
+    ERRORMACRO(m_capture.periodSize == m_playback.periodSize, Error, , "PCM device \""
+               << m_captureName << "\" has a period size of " << m_capture.periodSize
+               << " frames but \"" << m_playbackName << "\" has one of "
+               << m_playback.periodSize << " frames");
+    m_rate = m_capture.rate;
+    m_periodSize = m_capture.periodSize;
+    m_periods = m_playback.periods;
+    ERRORMACRO(m_prefill >= 1 && m_prefill < (int)m_periods, Error, , "Prefill of "
+               "PCM device \"" << m_playbackName << "\" must be between 1 and "
+               << m_periods - 1 << " periods (but was " << m_prefill << ")");
+    m_linked = snd_pcm_link(m_capture.pcm, m_playback.pcm) == 0;
+    m_input = boost::shared_array<char>
+      (new char[m_periodSize * sampleSize(m_format) * m_captureChannels]);
+    m_output = boost::shared_array<char>
+      (new char[m_periodSize * sampleSize(m_format) * m_playbackChannels]);
+    m_inputFloat = boost::shared_array<float>(new float[m_periodSize * m_captureChannels]);
+    m_outputFloat = boost::shared_array<float>
+      (new float[m_periodSize * m_playbackChannels]);
+    m_passthrough = PassthroughKernelPtr(new PassthroughKernel(m_captureChannels,
+                                                               m_playbackChannels));
+    m_kernelPtr = m_passthrough;
+    m_kernel = m_passthrough.get();
+    if (tapSize > 0)
+      m_tap = RingBufferPtr(new RingBuffer(tapSize, sampleSize(m_format) *
+                                                    m_playbackChannels));
+    m_poll = DevicePollPtr(new DevicePoll(m_capture.pcm, m_captureName));
+  } catch (Error &e) {
+    close();
+    throw e;
+  };
+}
+
+AlsaDuplex::~AlsaDuplex(void)
+{
+  close();
+}
+
+void AlsaDuplex::close(void)
+{
+  if (m_capture.pcm != NULL || m_playback.pcm != NULL) {
+    stopThread();
+    m_poll.reset();
+    releaseDevices();
+    if (m_chain.get()) {
+      m_chain->release();
+      m_chain.reset();
+    };
+  };
+}
+
+void AlsaDuplex::start(void) throw (Error)
+{
+  checkOpen();
+  if (!m_running.exchange(true)) {
+    if (m_threadInitialised) {
+      pthread_join(m_thread, NULL);
+      m_threadInitialised = false;
+    };
+    m_error.clear();
+    int err = m_scheduling.createThread(&m_thread, staticThreadFunc, this);
+    if (err != 0) {
+      m_running = false;
+      ERRORMACRO(false, Error, , "Error creating audio thread for duplex devices \""
+                 << m_captureName << "\" and \"" << m_playbackName << "\": "
+                 << strerror(err));
+    };
+    m_threadInitialised = true;
+  };
+}
+
+void AlsaDuplex::stop(void) throw (Error)
+{
+  checkOpen();
+  stopThread();
+  snd_pcm_drop(m_capture.pcm);
+  snd_pcm_drop(m_playback.pcm);
+}
+
+bool AlsaDuplex::running(void)
+{
+  return m_running;
+}
+
+SequencePtr AlsaDuplex::read(int samples, SampleFormat format) throw (Error)
+{
+  checkOpen();
+  SequencePtr frame(new Sequence((int)(samples * sampleSize(format) *
+                                       m_playbackChannels)));
+  // Root the sequence while the GVL is released (see AlsaInput::read).
+  VALUE rbFrame = frame->rubyObject();
+  read(frame->data(), samples, format);
+  RB_GC_GUARD(rbFrame);
+  return frame;
+}
+
+// Read processed samples from the tap ring buffer.
+int AlsaDuplex::read(char *data, int samples, SampleFormat format) throw (Error)
+{
+  checkOpen();
+  ERRORMACRO(m_tap.get() != NULL, Error, , "Duplex devices \"" << m_captureName
+             << "\" and \"" << m_playbackName << "\" were opened without a tap");
+  int frameSize = sampleSize(format) * m_playbackChannels;
+  int n = 0;
+  while (n < samples) {
+    int m = samples - n;
+    char *region = m_tap->readRegion(m);
+    if (m > 0) {
+      convertSamples(region, m_format, data + n * frameSize, format,
+                     m * m_playbackChannels);
+      m_tap->commitRead(m);
+      n += m;
+    } else {
+      if (!m_running) {
+        ERRORMACRO(!m_error.empty(), Error, , "Duplex devices \"" << m_captureName
+                   << "\" and \"" << m_playbackName << "\" are not running. Did you "
+                   "call \"start\"?");
+        ERRORMACRO(false, Error, , m_error);
+      };
+      long long start = StreamStats::now();
+      waitReadWithoutGVL(m_tap, samples - n);
+      m_stats.blocked(StreamStats::now() - start);
+    };
+  };
+  return n;
+}
+
+// Replace the processing kernel without waiting for the audio thread. The previous
+// kernel is retired and released by a later call once the audio thread does not
+// use it any more.
+void AlsaDuplex::setKernel(DuplexKernelPtr kernel) throw (Error)
+{
+  ERRORMACRO(kernel.get() != NULL, Error, , "Kernel of duplex devices \""
+             << m_captureName << "\" and \"" << m_playbackName << "\" must not be "
+             "NULL");
+  if (kernel == m_kernelPtr) return;
+  m_kernel.store(kernel.get());
+  m_retired.push_back(m_kernelPtr);
+  m_kernelPtr = kernel;
+  reclaimKernels();
+}
+
+// Release the retired kernels except for the one the audio thread announced in
+// m_inUse. Retired processing chains can be attached to other devices afterwards.
+void AlsaDuplex::reclaimKernels(void)
+{
+  DuplexKernel *inUse = m_inUse.load();
+  vector<DuplexKernelPtr> retained;
+  for (unsigned int i=0; i<m_retired.size(); i++) {
+    DuplexKernelPtr kernel = m_retired[i];
+    if (kernel == m_kernelPtr) continue;
+    if (kernel.get() == inUse)
+      retained.push_back(kernel);
+    else {
+      DSPChain *chain = dynamic_cast<DSPChain *>(kernel.get());
+      if (chain != NULL) chain->release();
+    };
+  };
+  m_retired = retained;
+}
+
+float AlsaDuplex::gain(void)
+{
+  return m_passthrough->gain();
+}
+
+// Use a processing chain as kernel. An empty pointer restores the passthrough
+// kernel.
+void AlsaDuplex::setChain(DSPChainPtr chain) throw (Error)
+{
+  checkOpen();
+  if (chain == m_chain) return;
+  if (chain.get()) {
+    ERRORMACRO(chain->inputChannels() == (int)m_captureChannels &&
+               chain->outputChannels() == (int)m_playbackChannels, Error, ,
+               "Processing chain converts " << chain->inputChannels() << " to "
+               << chain->outputChannels() << " channel(s) but duplex devices \""
+               << m_captureName << "\" and \"" << m_playbackName << "\" have "
+               << m_captureChannels << " and " << m_playbackChannels);
+    chain->prepare(m_periodSize, m_captureName);
+  };
+  // The previous chain is released with the retired kernels.
+  if (chain.get())
+    setKernel(chain);
+  else
+    setKernel(m_passthrough);
+  m_chain = chain;
+}
+
+void AlsaDuplex::setGain(float gain)
+{
+  m_passthrough->setGain(gain);
+}
+
+unsigned int AlsaDuplex::rate(void)
+{
+  return m_rate;
+}
+
+unsigned int AlsaDuplex::captureChannels(void)
+{
+  return m_captureChannels;
+}
+
+unsigned int AlsaDuplex::playbackChannels(void)
+{
+  return m_playbackChannels;
+}
+
+SampleFormat AlsaDuplex::format(void)
+{
+  return m_format;
+}
+
+snd_pcm_uframes_t AlsaDuplex::periodSize(void)
+{
+  return m_periodSize;
+}
+
+unsigned int AlsaDuplex::periods(void)
+{
+  return m_periods;
+}
+
+int AlsaDuplex::prefill(void)
+{
+  return m_prefill;
+}
+
+// Nominal round-trip latency in frames (the captured period plus the prefill).
+int AlsaDuplex::latency(void)
+{
+  return (m_prefill + 1) * m_periodSize;
+}
+
+bool AlsaDuplex::linked(void)
+{
+  return m_linked;
+}
+
+int AlsaDuplex::tapSize(void)
+{
+  return m_tap.get() ? m_tap->size() : 0;
+}
+
+void AlsaDuplex::schedule(int priority, const vector<int> &cpus, bool lockMemory,
+                          bool fallback) throw (Error)
+{
+  checkOpen();
+  ERRORMACRO(!m_threadInitialised, Error, , "Scheduling of the audio thread for "
+             "duplex devices \"" << m_captureName << "\" and \"" << m_playbackName
+             << "\" must be configured before calling \"start\"");
+  m_scheduling.configure(priority, cpus, lockMemory, fallback);
+  if (lockMemory && m_tap.get()) m_tap->prefault();
+}
+
+bool AlsaDuplex::realtime(void)
+{
+  return m_scheduling.realtime();
+}
+
+VALUE AlsaDuplex::stats(void)
+{
+  return m_stats.toHash();
+}
+
+void AlsaDuplex::checkOpen(void) throw (Error)
+{
+  ERRORMACRO(m_capture.pcm != NULL, Error, , "Duplex devices \"" << m_captureName
+             << "\" and \"" << m_playbackName << "\" are not open. Did you call "
+             "\"close\" before?");
+}
+
+void AlsaDuplex::releaseDevices(void)
+{
+  if (m_linked) {
+    snd_pcm_unlink(m_capture.pcm);
+    m_linked = false;
+  };
+  if (m_capture.pcm != NULL) {
+    PCMPool::release(m_captureConfig, m_capture);
+    m_capture.pcm = NULL;
+  };
+  if (m_playback.pcm != NULL) {
+    PCMPool::release(m_playbackConfig, m_playback);
+    m_playback.pcm = NULL;
+  };
+}
+
+// Prepare both devices, prefill the playback device with silence, and start them.
+// Linked devices start at the same time.
+void AlsaDuplex::startStreams(void) throw (Error)
+{
+  snd_pcm_drop(m_capture.pcm);
+  snd_pcm_drop(m_playback.pcm);
+  int err = snd_pcm_prepare(m_capture.pcm);
+  ERRORMACRO(err >= 0, Error, , "Error preparing PCM device \"" << m_captureName
+             << "\": " << snd_strerror(err));
+  err = snd_pcm_prepare(m_playback.pcm);
+  ERRORMACRO(err >= 0, Error, , "Error preparing PCM device \"" << m_playbackName
+             << "\": " << snd_strerror(err));
+  memset(m_output.get(), 0, m_periodSize * sampleSize(m_format) * m_playbackChannels);
+  for (int i=0; i<m_prefill; i++)
+    ERRORMACRO(writePeriod(), Error, , "Error prefilling PCM device \""
+               << m_playbackName << "\"");
+  if (snd_pcm_state(m_capture.pcm) == SND_PCM_STATE_PREPARED) {
+    err = snd_pcm_start(m_capture.pcm);
+    ERRORMACRO(err >= 0, Error, , "Error starting PCM device \"" << m_captureName
+               << "\": " << snd_strerror(err));
+  };
+  if (snd_pcm_state(m_playback.pcm) == SND_PCM_STATE_PREPARED) {
+    err = snd_pcm_start(m_playback.pcm);
+    ERRORMACRO(err >= 0, Error, , "Error starting PCM device \"" << m_playbackName
+               << "\": " << snd_strerror(err));
+  };
+}
+
+// Read one period from the capture device. Returns false after an overrun.
+bool AlsaDuplex::readPeriod(void) throw (Error)
+{
+  int frameSize = sampleSize(m_format) * m_captureChannels;
+  snd_pcm_uframes_t n = 0;
+  while (n < m_periodSize && !m_quit) {
+    snd_pcm_sframes_t err = snd_pcm_readi(m_capture.pcm, m_input.get() + n * frameSize,
+                                          m_periodSize - n);
+    if (err == -EAGAIN) continue;
+    if (err == -EPIPE || err == -ESTRPIPE) {
+      m_stats.xrun();
+      return false;
+    };
+    ERRORMACRO(err >= 0, Error, , "Error reading audio frames from PCM device \""
+               << m_captureName << "\": " << snd_strerror(err));
+    n += err;
+  };
+  return true;
+}
+
+// Write one period to the playback device. Returns false after an underrun.
+bool AlsaDuplex::writePeriod(void) throw (Error)
+{
+  int frameSize = sampleSize(m_format) * m_playbackChannels;
+  snd_pcm_uframes_t n = 0;
+  while (n < m_periodSize && !m_quit) {
+    snd_pcm_sframes_t err = snd_pcm_writei(m_playback.pcm,
+                                           m_output.get() + n * frameSize,
+                                           m_periodSize - n);
+    if (err == -EAGAIN) {
+      snd_pcm_wait(m_playback.pcm, 1000);
+      continue;
+    };
+    if (err == -EPIPE || err == -ESTRPIPE) {
+      m_stats.xrun();
+      return false;
+    };
+    ERRORMACRO(err >= 0, Error, , "Error writing audio frames to PCM device \""
+               << m_playbackName << "\": " << snd_strerror(err));
+    n += err;
+  };
+  return true;
+}
+
+// Run the kernel on the captured period and copy the result to the tap.
+void AlsaDuplex::process(void)
+{
+  convertSamples(m_input.get(), m_format, (char *)m_inputFloat.get(), SAMPLE_FLOAT,
+                 m_periodSize * m_captureChannels);
+  // Announce the kernel before using it. If setKernel replaced it in the meantime,
+  // it may already have been released and the new one is announced instead.
+  DuplexKernel *kernel = m_kernel.load();
+  m_inUse.store(kernel);
+  while (m_kernel.load() != kernel) {
+    kernel = m_kernel.load();
+    m_inUse.store(kernel);
+  };
+  kernel->process(m_inputFloat.get(), m_outputFloat.get(), m_periodSize);
+  m_inUse.store(NULL, boost::memory_order_release);
+  convertSamples((const char *)m_outputFloat.get(), SAMPLE_FLOAT, m_output.get(),
+                 m_format, m_periodSize * m_playbackChannels);
+  if (m_tap.get()) {
+    int tapped = m_tap->write(m_output.get(), m_periodSize);
+    if (tapped < (int)m_periodSize) m_stats.dropped(m_periodSize - tapped);
+    m_stats.fill(m_tap->count());
+  };
+}
+
+void AlsaDuplex::stopThread(void)
+{
+  m_quit = true;
+  if (m_poll.get()) m_poll->wake();
+  if (m_threadInitialised) {
+    pthread_join(m_thread, NULL);
+    m_threadInitialised = false;
+  };
+  m_quit = false;
+  m_running = false;
+  m_inUse = NULL;
+  reclaimKernels();
+}
+
+void AlsaDuplex::fail(const string &message)
+{
+  m_stats.error();
+  m_error = message;
+  m_running = false;
+  if (m_tap.get()) m_tap->interrupt();
+}
+
+void AlsaDuplex::threadFunc(void)
+{
+  try {
+    startStreams();
+    while (!m_quit) {
+      if (!m_poll->wait(1000)) continue;
+      long long start = StreamStats::now();
+      if (readPeriod()) {
+        process();
+        if (writePeriod()) {
+          m_stats.transferred(m_periodSize);
+          m_stats.period(StreamStats::now() - start);
+          continue;
+        };
+      };
+      if (m_quit) break;
+      // Restart both devices with the original latency after an overrun or
+      // underrun.
+      startStreams();
+      m_stats.recovered();
+    };
+  } catch (Error &e) {
+    fail(e.what());
+  };
+}
+
+void *AlsaDuplex::staticThreadFunc( void *self )
+{
+  ((AlsaDuplex *)self)->threadFunc();
+  return self;
+}
+
+VALUE AlsaDuplex::registerRubyClass( VALUE rbModule )
+{
+  cRubyClass = rb_define_class_under( rbModule, "AlsaDuplex", rb_cObject );
+  rb_define_singleton_method( cRubyClass, "new", RUBY_METHOD_FUNC( wrapNew ), 10 );
+  rb_define_method( cRubyClass, "close", RUBY_METHOD_FUNC( wrapClose ), 0 );
+  rb_define_method( cRubyClass, "start", RUBY_METHOD_FUNC( wrapStart ), 0 );
+  rb_define_method( cRubyClass, "stop", RUBY_METHOD_FUNC( wrapStop ), 0 );
+  rb_define_method( cRubyClass, "running?", RUBY_METHOD_FUNC( wrapRunning ), 0 );
+  rb_define_method( cRubyClass, "read", RUBY_METHOD_FUNC( wrapRead ), 2 );
+  rb_define_method( cRubyClass, "gain", RUBY_METHOD_FUNC( wrapGain ), 0 );
+  rb_define_method( cRubyClass, "gain=", RUBY_METHOD_FUNC( wrapSetGain ), 1 );
+  rb_define_method( cRubyClass, "chain=", RUBY_METHOD_FUNC( wrapSetChain ), 1 );
+  rb_define_method( cRubyClass, "rate", RUBY_METHOD_FUNC( wrapRate ), 0 );
+  rb_define_method( cRubyClass, "capture_channels",
+                    RUBY_METHOD_FUNC( wrapCaptureChannels ), 0 );
+  rb_define_method( cRubyClass, "playback_channels",
+                    RUBY_METHOD_FUNC( wrapPlaybackChannels ), 0 );
+  rb_define_method( cRubyClass, "format", RUBY_METHOD_FUNC( wrapFormat ), 0 );
+  rb_define_method( cRubyClass, "period_size", RUBY_METHOD_FUNC( wrapPeriodSize ), 0 );
+  rb_define_method( cRubyClass, "periods", RUBY_METHOD_FUNC( wrapPeriods ), 0 );
+  rb_define_method( cRubyClass, "prefill", RUBY_METHOD_FUNC( wrapPrefill ), 0 );
+  rb_define_method( cRubyClass, "latency", RUBY_METHOD_FUNC( wrapLatency ), 0 );
+  rb_define_method( cRubyClass, "linked?", RUBY_METHOD_FUNC( wrapLinked ), 0 );
+  rb_define_method( cRubyClass, "tap_size", RUBY_METHOD_FUNC( wrapTapSize ), 0 );
+  rb_define_method( cRubyClass, "schedule", RUBY_METHOD_FUNC( wrapSchedule ), 4 );
+  rb_define_method( cRubyClass, "realtime?", RUBY_METHOD_FUNC( wrapRealtime ), 0 );
+  rb_define_method( cRubyClass, "stats", RUBY_METHOD_FUNC( wrapStats ), 0 );
+  return cRubyClass;
+}
+
+void AlsaDuplex::deleteRubyObject( void *ptr )
+{
+  delete (AlsaDuplexPtr *)ptr;
+}
+
+VALUE AlsaDuplex::wrapNew(VALUE rbClass, VALUE rbCaptureName, VALUE rbPlaybackName,
+                          VALUE rbRate, VALUE rbCaptureChannels,
+                          VALUE rbPlaybackChannels, VALUE rbFormat,
+                          VALUE rbPeriodSize, VALUE rbPeriods, VALUE rbPrefill,
+                          VALUE rbTapSize)
+{
+  VALUE retVal = Qnil;
+  try {
+    rb_check_type( rbCaptureName, T_STRING );
+    rb_check_type( rbPlaybackName, T_STRING );
+    rb_check_type( rbFormat, T_STRING );
+    AlsaDuplexPtr ptr(new AlsaDuplex(StringValuePtr(rbCaptureName),
+                                     StringValuePtr(rbPlaybackName),
+                                     NUM2UINT(rbRate), NUM2UINT(rbCaptureChannels),
+                                     NUM2UINT(rbPlaybackChannels),
+                                     parseSampleFormat(StringValuePtr(rbFormat)),
+                                     NUM2ULONG(rbPeriodSize), NUM2UINT(rbPeriods),
+                                     NUM2INT(rbPrefill), NUM2INT(rbTapSize)));
+    retVal = Data_Wrap_Struct( rbClass, 0, deleteRubyObject,
+                               new AlsaDuplexPtr( ptr ) );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE AlsaDuplex::wrapClose( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  (*self)->close();
+  return rbSelf;
+}
+
+VALUE AlsaDuplex::wrapStart( VALUE rbSelf )
+{
+  try {
+    AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+    (*self)->start();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaDuplex::wrapStop( VALUE rbSelf )
+{
+  try {
+    AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+    (*self)->stop();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaDuplex::wrapRunning( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return (*self)->running() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaDuplex::wrapRead( VALUE rbSelf, VALUE rbSamples, VALUE rbFormat )
+{
+  VALUE rbRetVal = Qnil;
+  int state = 0;
+  try {
+    AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+    SequencePtr sequence( (*self)->read( NUM2INT( rbSamples ),
+                                         parseSampleFormat( StringValuePtr( rbFormat ) ) ) );
+    rbRetVal = sequence->rubyObject();
+  } catch ( Interrupt &e ) {
+    state = e.state();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  if ( state != 0 ) rb_jump_tag( state );
+  return rbRetVal;
+}
+
+VALUE AlsaDuplex::wrapGain( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return rb_float_new( (*self)->gain() );
+}
+
+VALUE AlsaDuplex::wrapSetGain( VALUE rbSelf, VALUE rbGain )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  (*self)->setGain( NUM2DBL( rbGain ) );
+  return rbGain;
+}
+
+VALUE AlsaDuplex::wrapSetChain( VALUE rbSelf, VALUE rbChain )
+{
+  try {
+    AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+    DSPChainPtr chain;
+    if (rbChain != Qnil) {
+      if (!rb_obj_is_kind_of(rbChain, DSPChain::cRubyClass))
+        rb_raise(rb_eTypeError, "Expected DSPChain or nil");
+      DSPChainPtr *ptr; Data_Get_Struct( rbChain, DSPChainPtr, ptr );
+      chain = *ptr;
+    };
+    (*self)->setChain(chain);
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbChain;
+}
+
+VALUE AlsaDuplex::wrapRate( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return UINT2NUM( (*self)->rate() );
+}
+
+VALUE AlsaDuplex::wrapCaptureChannels( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return UINT2NUM( (*self)->captureChannels() );
+}
+
+VALUE AlsaDuplex::wrapPlaybackChannels( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return UINT2NUM( (*self)->playbackChannels() );
+}
+
+VALUE AlsaDuplex::wrapFormat( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return ID2SYM( rb_intern( sampleFormatName( (*self)->format() ) ) );
+}
+
+VALUE AlsaDuplex::wrapPeriodSize( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return ULONG2NUM( (*self)->periodSize() );
+}
+
+VALUE AlsaDuplex::wrapPeriods( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return UINT2NUM( (*self)->periods() );
+}
+
+VALUE AlsaDuplex::wrapPrefill( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return INT2NUM( (*self)->prefill() );
+}
+
+VALUE AlsaDuplex::wrapLatency( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return INT2NUM( (*self)->latency() );
+}
+
+VALUE AlsaDuplex::wrapLinked( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return (*self)->linked() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaDuplex::wrapTapSize( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return INT2NUM( (*self)->tapSize() );
+}
+
+VALUE AlsaDuplex::wrapSchedule(VALUE rbSelf, VALUE rbPriority, VALUE rbCPUs,
+                               VALUE rbLockMemory, VALUE rbFallback)
+{
+  try {
+    AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+    rb_check_type( rbCPUs, T_ARRAY );
+    vector<int> cpus;
+    for (long i=0; i<RARRAY_LEN(rbCPUs); i++)
+      cpus.push_back(NUM2INT(rb_ary_entry(rbCPUs, i)));
+    (*self)->schedule(NUM2INT(rbPriority), cpus, RTEST(rbLockMemory), RTEST(rbFallback));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaDuplex::wrapRealtime( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return (*self)->realtime() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaDuplex::wrapStats( VALUE rbSelf )
+{
+  AlsaDuplexPtr *self; Data_Get_Struct( rbSelf, AlsaDuplexPtr, self );
+  return (*self)->stats();
+}
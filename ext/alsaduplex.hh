@@ -0,0 +1,152 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef ALSADUPLEX_HH
+#define ALSADUPLEX_HH
+
+#include <alsa/asoundlib.h>
+#include <string>
+#include <vector>
+#include "rubyinc.hh"
+#include "error.hh"
+#include "sequence.hh"
+#include "ringbuffer.hh"
+#include "gvl.hh"
+#include "convert.hh"
+#include "devicepoll.hh"
+#include "threadscheduling.hh"
+#include "streamstats.hh"
+#include "pcmpool.hh"
+#include "duplexkernel.hh"
+#include "dspchain.hh"
+
+// Capture and playback device serviced by one audio thread. Each captured period
+// is passed through a native kernel and written to the playback device straight
+// away. The devices are linked with snd_pcm_link where the driver allows it so
+// that they start at the same time. The playback device is prefilled with silence
+// so that the round-trip latency is the prefill plus one period. A copy of the
+// processed audio goes to a tap ring buffer which can be read from Ruby.
+class AlsaDuplex
+{
+public:
+  AlsaDuplex(const std::string &captureName, const std::string &playbackName,
+             unsigned int rate = 48000, unsigned int captureChannels = 2,
+             unsigned int playbackChannels = 2, SampleFormat format = SAMPLE_S16,
+             snd_pcm_uframes_t periodSize = 256, unsigned int periods = 3,
+             int prefill = 1, int tapSize = 0) throw (Error);
+  virtual ~AlsaDuplex(void);
+  void close(void);
+  void start(void) throw (Error);
+  void stop(void) throw (Error);
+  bool running(void);
+  SequencePtr read(int samples, SampleFormat format = SAMPLE_S16) throw (Error);
+  int read(char *data, int samples, SampleFormat format = SAMPLE_S16) throw (Error);
+  void setKernel(DuplexKernelPtr kernel) throw (Error);
+  void setChain(DSPChainPtr chain) throw (Error);
+  float gain(void);
+  void setGain(float gain);
+  unsigned int rate(void);
+  unsigned int captureChannels(void);
+  unsigned int playbackChannels(void);
+  SampleFormat format(void);
+  snd_pcm_uframes_t periodSize(void);
+  unsigned int periods(void);
+  int prefill(void);
+  int latency(void);
+  bool linked(void);
+  int tapSize(void);
+  void schedule(int priority, const std::vector<int> &cpus, bool lockMemory,
+                bool fallback) throw (Error);
+  bool realtime(void);
+  VALUE stats(void);
+  static VALUE cRubyClass;
+  static VALUE registerRubyClass( VALUE rbModule );
+  static void deleteRubyObject( void *ptr );
+  static VALUE wrapNew(VALUE rbClass, VALUE rbCaptureName, VALUE rbPlaybackName,
+                       VALUE rbRate, VALUE rbCaptureChannels,
+                       VALUE rbPlaybackChannels, VALUE rbFormat, VALUE rbPeriodSize,
+                       VALUE rbPeriods, VALUE rbPrefill, VALUE rbTapSize);
+  static VALUE wrapClose( VALUE rbSelf );
+  static VALUE wrapStart( VALUE rbSelf );
+  static VALUE wrapStop( VALUE rbSelf );
+  static VALUE wrapRunning( VALUE rbSelf );
+  static VALUE wrapRead( VALUE rbSelf, VALUE rbSamples, VALUE rbFormat );
+  static VALUE wrapGain( VALUE rbSelf );
+  static VALUE wrapSetGain( VALUE rbSelf, VALUE rbGain );
+  static VALUE wrapSetChain( VALUE rbSelf, VALUE rbChain );
+  static VALUE wrapRate( VALUE rbSelf );
+  static VALUE wrapCaptureChannels( VALUE rbSelf );
+  static VALUE wrapPlaybackChannels( VALUE rbSelf );
+  static VALUE wrapFormat( VALUE rbSelf );
+  static VALUE wrapPeriodSize( VALUE rbSelf );
+  static VALUE wrapPeriods( VALUE rbSelf );
+  static VALUE wrapPrefill( VALUE rbSelf );
+  static VALUE wrapLatency( VALUE rbSelf );
+  static VALUE wrapLinked( VALUE rbSelf );
+  static VALUE wrapTapSize( VALUE rbSelf );
+  static VALUE wrapSchedule(VALUE rbSelf, VALUE rbPriority, VALUE rbCPUs,
+                            VALUE rbLockMemory, VALUE rbFallback);
+  static VALUE wrapRealtime( VALUE rbSelf );
+  static VALUE wrapStats( VALUE rbSelf );
+protected:
+  void checkOpen(void) throw (Error);
+  void releaseDevices(void);
+  void startStreams(void) throw (Error);
+  bool readPeriod(void) throw (Error);
+  bool writePeriod(void) throw (Error);
+  void process(void);
+  void reclaimKernels(void);
+  void stopThread(void);
+  void fail(const std::string &message);
+  void threadFunc(void);
+  static void *staticThreadFunc( void *self );
+  PCMHandle m_capture;
+  PCMHandle m_playback;
+  std::string m_captureName;
+  std::string m_playbackName;
+  PCMConfig m_captureConfig;
+  PCMConfig m_playbackConfig;
+  unsigned int m_rate;
+  unsigned int m_captureChannels;
+  unsigned int m_playbackChannels;
+  SampleFormat m_format;
+  snd_pcm_uframes_t m_periodSize;
+  unsigned int m_periods;
+  int m_prefill;
+  bool m_linked;
+  boost::shared_array<char> m_input;
+  boost::shared_array<char> m_output;
+  boost::shared_array<float> m_inputFloat;
+  boost::shared_array<float> m_outputFloat;
+  PassthroughKernelPtr m_passthrough;
+  DuplexKernelPtr m_kernelPtr;
+  std::vector<DuplexKernelPtr> m_retired;
+  DSPChainPtr m_chain;
+  boost::atomic<DuplexKernel *> m_kernel;
+  boost::atomic<DuplexKernel *> m_inUse;
+  RingBufferPtr m_tap;
+  DevicePollPtr m_poll;
+  ThreadScheduling m_scheduling;
+  StreamStats m_stats;
+  bool m_threadInitialised;
+  boost::atomic<bool> m_running;
+  boost::atomic<bool> m_quit;
+  std::string m_error;
+  pthread_t m_thread;
+};
+
+typedef boost::shared_ptr< AlsaDuplex > AlsaDuplexPtr;
+
+#endif
@@ -20,51 +20,43 @@ using namespace std;
 VALUE AlsaInput::cRubyClass = Qnil;
 
 AlsaInput::AlsaInput(const string &pcmName, unsigned int rate,
-                     unsigned int channels) throw (Error):
-  m_pcmHandle(NULL), m_pcmName( pcmName ), m_rate( rate ), m_channels( channels ),
-  m_periodSize(1024), m_threadInitialised(false), m_start(0), m_count(0),
-  m_size(rate)
+                     unsigned int channels, SampleFormat format, bool mmap,
+                     unsigned int bufferTime, unsigned int periods,
+                     snd_pcm_uframes_t periodSize, int ringSize,
+                     OverflowPolicy policy) throw (Error):
+  m_pcmHandle(NULL), m_pcmName( pcmName ),
+  m_config(pcmName, SND_PCM_STREAM_CAPTURE, rate, channels, format, mmap, bufferTime,
+           periods, periodSize),
+  m_rate( rate ), m_requestedRate( rate ),
+  m_channels( channels ),
+  m_format(format), m_frameSize(sampleSize(format) * channels), m_mmap(mmap),
+  m_periodSize(1024), m_bufferSize(0), m_periods(0), m_policy(policy),
+  m_threadInitialised(false), m_running(false), m_quit(false), m_overflow(false),
+  m_captured(0), m_grouped(false), m_stamped(false), m_frameIndex(0), m_timestamp(0)
 {
   try {
-    snd_pcm_hw_params_t *hwParams;
-    snd_pcm_hw_params_alloca(&hwParams);
-    int err = snd_pcm_open(&m_pcmHandle, m_pcmName.c_str(), SND_PCM_STREAM_CAPTURE,
-                           0);
-    ERRORMACRO( err >= 0, Error, , "Error opening PCM device \"" << m_pcmName
-                << "\": " << snd_strerror( err ) );
-    err = snd_pcm_hw_params_any( m_pcmHandle, hwParams );
-    ERRORMACRO( err >= 0, Error, , "Unable to configure the PCM device \""
-                << m_pcmName << "\": " << snd_strerror( err ) );
-    err = snd_pcm_hw_params_set_access( m_pcmHandle, hwParams,
-                                        SND_PCM_ACCESS_RW_INTERLEAVED );
-    ERRORMACRO( err >= 0, Error, , "Error setting PCM device \""
-                << m_pcmName << "\" to interlaced access: " << snd_strerror( err ) );
-    err = snd_pcm_hw_params_set_format( m_pcmHandle, hwParams,
-                                        SND_PCM_FORMAT_S16_LE );
-    ERRORMACRO( err >= 0, Error, , "Error setting PCM device \"" << m_pcmName
-                << "\" to 16-bit signed integer format: " << snd_strerror( err ) );
-    err = snd_pcm_hw_params_set_rate_near( m_pcmHandle, hwParams, &m_rate, 0 );
-    ERRORMACRO( err >= 0, Error, , "Error setting sampling rate of PCM device \""
-                << m_pcmName << "\" to " << rate << " Hz: " << snd_strerror( err ) );
-    err = snd_pcm_hw_params_set_channels( m_pcmHandle, hwParams, channels );
-    ERRORMACRO( err >= 0, Error, , "Error setting number of channels of PCM device \""
-                << m_pcmName << "\" to " << channels << ": " << snd_strerror( err ) );
-    unsigned int bufferTime = 500000;
-    err = snd_pcm_hw_params_set_buffer_time_near(m_pcmHandle, hwParams, &bufferTime, NULL);
-    ERRORMACRO(err >= 0, Error, , "Error setting buffer time of PCM device \""
-               << m_pcmName << "\" to " << bufferTime << " us: " << snd_strerror(err));
-    unsigned int periods = 16;
-    err = snd_pcm_hw_params_set_periods_near(m_pcmHandle, hwParams, &periods, NULL);
-    ERRORMACRO(err >= 0, Error, , "Error setting periods of PCM device \""
-               << m_pcmName << "\" to " << periods << ": " << snd_strerror(err));
-    err = snd_pcm_hw_params( m_pcmHandle, hwParams );
-    ERRORMACRO( err >= 0, Error, , "Error setting parameters of PCM device \""
-                << m_pcmName << "\": " << snd_strerror( err ) );
-    err = snd_pcm_hw_params_get_period_size(hwParams, &m_periodSize, NULL);
-    ERRORMACRO( err >= 0, Error, , "Error getting period size of PCM device \""
-                << m_pcmName << "\": " << snd_strerror( err ) );
-    err = pthread_mutex_init(&m_mutex, NULL);
-    ERRORMACRO(err == 0, Error, , "Error initialising mutex: " << strerror(err));
+    ERRORMACRO(policy == OVERFLOW_DROP_NEWEST || policy == OVERFLOW_DROP_OLDEST ||
+               policy == OVERFLOW_ERROR, Error, , "Overflow policy \""
+               << overflowPolicyName(policy) << "\" is not supported for capture "
+               "(must be one of drop_newest, drop_oldest, or error)");
+    PCMHandle handle = PCMPool::acquire(m_config);
+    m_pcmHandle = handle.pcm;
+    m_rate = handle.rate;
+    m_periodSize = handle.periodSize;
+    m_bufferSize = handle.bufferSize;
+    m_periods = handle.periods;
+    if (ringSize <= 0) {
+      ringSize = m_rate;
+      if (ringSize < (int)(2 * m_bufferSize)) ringSize = 2 * m_bufferSize;
+    };
+    ERRORMACRO(ringSize >= (int)m_periodSize, Error, , "Ring buffer of " << ringSize
+               << " frames is smaller than a period of PCM device \"" << m_pcmName
+               << "\" (" << m_periodSize << " frames)");
+    m_ring = RingBufferPtr(new RingBuffer(ringSize, m_frameSize));
+    m_stamps = BlockStampsPtr(new BlockStamps(2 * (ringSize / m_periodSize + 2)));
+    m_poll = DevicePollPtr(new DevicePoll(m_pcmHandle, m_pcmName));
+    m_watermark = WatermarkPtr(new Watermark(m_ring, false, m_periodSize));
+    m_wait = WatermarkPtr(new Watermark(m_ring, false, m_ring->size()));
   } catch ( Error &e ) {
     close();
     throw e;
@@ -78,65 +70,101 @@ AlsaInput::~AlsaInput(void)
 
 void AlsaInput::close(void)
 {
-  if ( m_pcmHandle != NULL ) {
+  // Devices of a capture group are closed by the group.
+  if ( m_pcmHandle != NULL && !m_grouped ) {
+    if (m_recorder.get()) {
+      m_recorder->stop();
+      m_recorder.reset();
+    };
     drop();
-    pthread_mutex_destroy(&m_mutex);
-    snd_pcm_close( m_pcmHandle );
-    m_pcmHandle = NULL;
+    m_poll.reset();
+    releaseDevice();
   };
 }
 
-SequencePtr AlsaInput::read(int samples) throw (Error)
+SequencePtr AlsaInput::read(int samples, SampleFormat format) throw (Error)
 {
   ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
              << "\" is not open. Did you call \"close\" before?");
-  SequencePtr frame(new Sequence((int)(samples * 2 * m_channels)));
-  lock();
-  if (!m_data.get()) {
-    if (m_threadInitialised) pthread_join(m_thread, NULL);
-    m_data = boost::shared_array<short int>(new short int[m_size * m_channels]);
-    m_start = 0;
-    m_count = 0;
-    pthread_create(&m_thread, NULL, staticThreadFunc, this);
-  };
-  int n = samples;
-  if (n > m_count) n = m_count;
-  if (m_start + n > m_size) {
-    memcpy(frame->data(), m_data.get() + m_start * m_channels, (m_size - m_start) * 2 * m_channels);
-    memcpy(frame->data() + (m_size - m_start) * 2 * m_channels, m_data.get(), (n + m_start - m_size) * 2 * m_channels);
-  } else
-    memcpy(frame->data(), m_data.get() + m_start * m_channels, n * 2 * m_channels);
-  m_start += n;
-  if (m_start >= m_size) m_start -= m_size;
-  m_count -= n;
-  if (n < samples) {
-    try {
-      readi((short int *)frame->data() + n * m_channels * 2, samples - n);
-    } catch (Error &e) {
-      unlock();
-      throw e;
-    }
-  }
-  unlock();
+  SequencePtr frame(new Sequence((int)(samples * sampleSize(format) * m_channels)));
+  // The sequence is only referenced from the heap. Keep it on the stack so that the
+  // garbage collector does not free it while the GVL is released.
+  VALUE rbFrame = frame->rubyObject();
+  read(frame->data(), samples, format);
+  RB_GC_GUARD(rbFrame);
   return frame;
 }
 
+int AlsaInput::read(char *data, int samples, SampleFormat format, bool block)
+  throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(m_recorder.get() == NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is recording to \"" << m_recorder->path() << "\"");
+  checkThread();
+  startThread();
+  if (m_overflow.load(boost::memory_order_relaxed) && m_overflow.exchange(false))
+    ERRORMACRO(false, Error, , "Capture buffer of PCM device \"" << m_pcmName
+               << "\" overflowed (" << m_stats.droppedFrames() << " frames lost "
+               "so far)");
+  int frameSize = sampleSize(format) * m_channels;
+  int n = 0;
+  while (n < samples) {
+    int m = samples - n;
+    char *region = m_ring->readRegion(m);
+    if (m > 0) {
+      long long frame = 0, time = 0;
+      bool stamped = n == 0 &&
+        m_stamps->lookup(m_ring->readPosition(), rate(), frame, time);
+      convertSamples(region, m_format, data + n * frameSize, format, m * m_channels);
+      // The audio thread may have dropped the region while it was being copied.
+      if (m_ring->tryCommitRead(m)) {
+        if (n == 0) {
+          m_stamped = stamped;
+          m_frameIndex = frame;
+          m_timestamp = time;
+        };
+        n += m;
+      };
+    } else {
+      ERRORMACRO(m_running, Error, , m_error);
+      if (!block) break;
+      long long start = StreamStats::now();
+      waitReadWithoutGVL(m_ring, samples - n, m_wait);
+      m_stats.blocked(StreamStats::now() - start);
+    };
+  };
+  m_watermark->update();
+  return n;
+}
+
 void AlsaInput::drop(void) throw (Error)
 {
   ERRORMACRO( m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
               << "\" is not open. Did you call \"close\" before?" );
-  lock();
-  m_data.reset();
-  m_count = 0;
+  ERRORMACRO(!m_grouped, Error, , "PCM device \"" << m_pcmName << "\" is part of "
+             "a capture group");
+  ERRORMACRO(m_recorder.get() == NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is recording to \"" << m_recorder->path() << "\"");
+  stopThread();
+  m_error.clear();
   snd_pcm_drop(m_pcmHandle);
-  unlock();
-  if (m_threadInitialised) {
-    pthread_join(m_thread, NULL);
-    m_threadInitialised = false;
-  }
+  m_ring->flush();
+  if (m_resampler.get()) m_resampler->reset();
+  m_overflow = false;
+  m_stamps->reset();
+  m_captured = 0;
+  m_stamped = false;
+  m_watermark->update();
 }
 
 unsigned int AlsaInput::rate(void)
+{
+  return m_resampler.get() ? m_requestedRate : m_rate;
+}
+
+unsigned int AlsaInput::deviceRate(void)
 {
   return m_rate;
 }
@@ -146,11 +174,111 @@ unsigned int AlsaInput::channels(void)
   return m_channels;
 }
 
+snd_pcm_uframes_t AlsaInput::periodSize(void)
+{
+  return m_periodSize;
+}
+
+snd_pcm_uframes_t AlsaInput::bufferSize(void)
+{
+  return m_bufferSize;
+}
+
+unsigned int AlsaInput::periods(void)
+{
+  return m_periods;
+}
+
+SampleFormat AlsaInput::format(void)
+{
+  return m_format;
+}
+
+bool AlsaInput::mmap(void)
+{
+  return m_mmap;
+}
+
+int AlsaInput::ringSize(void)
+{
+  return m_ring->size();
+}
+
+OverflowPolicy AlsaInput::policy(void)
+{
+  return m_policy;
+}
+
+long AlsaInput::lostFrames(void)
+{
+  return m_stats.droppedFrames();
+}
+
+bool AlsaInput::timestamp(long long &frame, long long &time)
+{
+  frame = m_frameIndex;
+  time = m_timestamp;
+  return m_stamped;
+}
+
+void AlsaInput::schedule(int priority, const vector<int> &cpus, bool lockMemory,
+                         bool fallback) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(!m_threadInitialised, Error, , "Scheduling of the audio thread for PCM "
+             "device \"" << m_pcmName << "\" must be configured before any audio "
+             "is transferred");
+  m_scheduling.configure(priority, cpus, lockMemory, fallback);
+  if (lockMemory) m_ring->prefault();
+}
+
+bool AlsaInput::realtime(void)
+{
+  return m_scheduling.realtime();
+}
+
+bool AlsaInput::memoryLocked(void)
+{
+  return m_scheduling.memoryLocked();
+}
+
+// Convert from the sampling rate of the device to the requested one if they
+// differ. The ring buffer then holds frames at the requested rate.
+bool AlsaInput::resample(int taps) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(!m_threadInitialised, Error, , "Resampling for PCM device \""
+             << m_pcmName << "\" must be configured before any audio is transferred");
+  if (m_rate != m_requestedRate) {
+    m_resampler = ResamplerPtr(new Resampler(m_rate, m_requestedRate, m_channels, taps,
+                                             m_periodSize));
+    // Resampled blocks are shorter than a period when decimating.
+    int block = (int)(m_periodSize * m_requestedRate / m_rate);
+    if (block < 1) block = 1;
+    m_stamps = BlockStampsPtr(new BlockStamps(2 * (m_ring->size() / block + 2)));
+    int frames = (int)(m_periodSize * m_requestedRate / m_rate) + 2;
+    if (frames < (int)m_periodSize) frames = m_periodSize;
+    m_resampleBuffer = boost::shared_array<float>(new float[frames * m_channels]);
+  };
+  return m_resampler.get() != NULL;
+}
+
+bool AlsaInput::resampling(void)
+{
+  return m_resampler.get() != NULL;
+}
+
+VALUE AlsaInput::stats(void)
+{
+  return m_stats.toHash();
+}
+
 int AlsaInput::avail(void) throw (Error)
 {
   ERRORMACRO( m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
               << "\" is not open. Did you call \"close\" before?" );
-  lock();
   snd_pcm_sframes_t frames;
   int err = 0;
   while ( ( frames = snd_pcm_avail( m_pcmHandle ) ) < 0 ) {
@@ -159,74 +287,390 @@ int AlsaInput::avail(void) throw (Error)
               "retrieval from PCM device \"" << m_pcmName << "\": "
               << snd_strerror( err ) );
   };
-  frames += m_count;
-  unlock();
+  if (m_resampler.get()) frames = frames * m_requestedRate / m_rate;
+  frames += m_ring->count();
   return frames;
 }
 
-void AlsaInput::readi(short int *data, int count)
+int AlsaInput::watermark(void)
 {
-  int err;
-  while ((err = snd_pcm_readi(m_pcmHandle, data, count)) < 0) {
-    if (err == -EBADFD)
-      err = snd_pcm_prepare(m_pcmHandle);
-    else
-      err = snd_pcm_recover(m_pcmHandle, err, 1);
-    ERRORMACRO(err >= 0, Error, , "Error reading audio frames from PCM device \""
-               << m_pcmName << "\": " << snd_strerror(err));
+  return m_watermark->level();
+}
+
+void AlsaInput::setWatermark(int frames) throw (Error)
+{
+  ERRORMACRO(frames > 0 && frames <= m_ring->size(), Error, , "Watermark of " << frames
+             << " frames is out of range (must be between 1 and " << m_ring->size()
+             << ")");
+  m_watermark->setLevel(frames);
+}
+
+// The audio thread is started so that the descriptor becomes readable without a
+// prior call to read.
+int AlsaInput::watermarkFd(void) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  checkThread();
+  startThread();
+  return m_watermark->fd();
+}
+
+// Let a writer thread take over the ring buffer and append the captured frames to
+// a file. Frames captured before are discarded.
+void AlsaInput::recordTo(const string &path, RecordContainer container,
+                         SampleFormat format) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(!m_grouped, Error, , "PCM device \"" << m_pcmName << "\" is part of "
+             "a capture group");
+  ERRORMACRO(m_recorder.get() == NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is already recording to \"" << m_recorder->path() << "\"");
+  checkThread();
+  m_ring->flush();
+  m_overflow = false;
+  m_recorder = RecorderPtr(new Recorder(m_ring, path, container, rate(), m_channels,
+                                        m_format, format));
+  startThread();
+}
+
+// Stop recording and return the number of frames written to the file.
+long long AlsaInput::stopRecording(void) throw (Error)
+{
+  ERRORMACRO(m_recorder.get() != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not recording");
+  RecorderPtr recorder = m_recorder;
+  m_recorder.reset();
+  recorder->stop();
+  m_watermark->update();
+  recorder->check();
+  ERRORMACRO(m_running, Error, , m_error);
+  if (m_overflow.exchange(false))
+    ERRORMACRO(false, Error, , "Capture buffer of PCM device \"" << m_pcmName
+               << "\" overflowed while recording to \"" << recorder->path() << "\" ("
+               << m_stats.droppedFrames() << " frames lost so far)");
+  return recorder->frames();
+}
+
+bool AlsaInput::recording(void)
+{
+  return m_recorder.get() != NULL;
+}
+
+long long AlsaInput::recordedFrames(void)
+{
+  return m_recorder.get() ? m_recorder->frames() : 0;
+}
+
+// Let the audio thread process each captured period with the specified chain
+// before it goes to the ring buffer. An empty pointer detaches the chain. The
+// audio thread is restarted if it was running.
+void AlsaInput::setChain(DSPChainPtr chain) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(!m_grouped, Error, , "PCM device \"" << m_pcmName << "\" is part of "
+             "a capture group");
+  if (chain == m_chain) return;
+  if (chain.get()) {
+    ERRORMACRO(chain->inputChannels() == (int)m_channels &&
+               chain->outputChannels() == (int)m_channels, Error, , "Processing "
+               "chain converts " << chain->inputChannels() << " to "
+               << chain->outputChannels() << " channel(s) but PCM device \""
+               << m_pcmName << "\" has " << m_channels);
+    chain->prepare(m_periodSize, m_pcmName);
   };
+  bool running = m_running;
+  stopThread();
+  if (m_chain.get()) m_chain->release();
+  m_chain = chain;
+  if (running) startThread();
+}
+
+// Let the audio thread compute levels and the spectrum of the captured frames.
+// The audio thread is started so that results are available without calling read.
+// An FFT size of zero stops the analysis.
+void AlsaInput::analyse(int fftSize, int hop) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(!m_grouped, Error, , "PCM device \"" << m_pcmName << "\" is part of "
+             "a capture group");
+  AnalyserPtr analyser;
+  if (fftSize > 0) analyser = AnalyserPtr(new Analyser(m_channels, fftSize, hop,
+                                                       m_periodSize));
+  checkThread();
+  bool running = m_running;
+  stopThread();
+  m_analyser = analyser;
+  if (running || analyser.get()) startThread();
+}
+
+AnalyserPtr AlsaInput::analyser(void)
+{
+  return m_analyser;
+}
+
+void AlsaInput::readi(char *data, int count) throw (Error)
+{
+  int err;
+  while ((err = snd_pcm_readi(m_pcmHandle, data, count)) < 0)
+    recover(err);
   ERRORMACRO(count == err, Error, , "Only managed to read " << err << " of "
              << count << " frames from PCM device \"" << m_pcmName << "\"" );
 }
 
-void AlsaInput::lock(void)
+void AlsaInput::mmapRead(char *data, int count) throw (Error)
 {
-  pthread_mutex_lock( &m_mutex );
+  while (count > 0) {
+    if (snd_pcm_state(m_pcmHandle) == SND_PCM_STATE_PREPARED) {
+      int err = snd_pcm_start(m_pcmHandle);
+      ERRORMACRO(err >= 0, Error, , "Error starting PCM device \"" << m_pcmName
+                 << "\": " << snd_strerror(err));
+    };
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcmHandle);
+    if (avail < 0) {
+      recover(avail);
+      continue;
+    };
+    if (avail == 0) {
+      m_poll->wait(1000);
+      if (m_quit) break;
+      continue;
+    };
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames = count;
+    int err = snd_pcm_mmap_begin(m_pcmHandle, &areas, &offset, &frames);
+    if (err < 0) {
+      recover(err);
+      continue;
+    };
+    char *area = (char *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+    memcpy(data, area, frames * m_frameSize);
+    snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_pcmHandle, offset, frames);
+    if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+      recover(committed >= 0 ? -EPIPE : committed);
+      continue;
+    };
+    data += frames * m_frameSize;
+    count -= frames;
+  };
 }
 
-void AlsaInput::unlock(void)
+// Hand the device back to the pool which either keeps it or closes it.
+void AlsaInput::releaseDevice(void)
 {
-  pthread_mutex_unlock( &m_mutex );
+  PCMHandle handle;
+  handle.pcm = m_pcmHandle;
+  handle.rate = m_rate;
+  handle.periodSize = m_periodSize;
+  handle.bufferSize = m_bufferSize;
+  handle.periods = m_periods;
+  PCMPool::release(m_config, handle);
+  m_pcmHandle = NULL;
+  if (m_chain.get()) {
+    m_chain->release();
+    m_chain.reset();
+  };
+  m_analyser.reset();
+}
+
+void AlsaInput::recover(int err) throw (Error)
+{
+  if (err == -EPIPE) m_stats.xrun();
+  if (err == -EBADFD)
+    err = snd_pcm_prepare(m_pcmHandle);
+  else
+    err = snd_pcm_recover(m_pcmHandle, err, 1);
+  ERRORMACRO(err >= 0, Error, , "Error reading audio frames from PCM device \""
+             << m_pcmName << "\": " << snd_strerror(err));
+  m_stats.recovered();
+}
+
+// A capture thread which stopped because of an error is not restarted until drop
+// is called. Until then its error is raised again.
+void AlsaInput::checkThread(void) throw (Error)
+{
+  ERRORMACRO(!m_threadInitialised || m_running, Error, , m_error);
+}
+
+void AlsaInput::startThread(void) throw (Error)
+{
+  if (m_grouped) return;
+  if (!m_running.exchange(true)) {
+    if (m_threadInitialised) {
+      pthread_join(m_thread, NULL);
+      m_threadInitialised = false;
+    };
+    int err = m_scheduling.createThread(&m_thread, staticThreadFunc, this);
+    if (err != 0) {
+      m_running = false;
+      ERRORMACRO(false, Error, , "Error creating audio thread for PCM device \""
+                 << m_pcmName << "\": " << strerror(err));
+    };
+    m_threadInitialised = true;
+  };
+}
+
+void AlsaInput::stopThread(void)
+{
+  m_quit = true;
+  if (m_poll.get()) m_poll->wake();
+  if (m_threadInitialised) {
+    pthread_join(m_thread, NULL);
+    m_threadInitialised = false;
+  };
+  m_quit = false;
+  m_running = false;
+}
+
+// Estimate the capture time of the first frame of a block which has just been
+// read. The timestamp refers to the latest frame captured by the hardware and
+// there are "avail" frames behind the block which have not been read yet.
+long long AlsaInput::blockTime(snd_pcm_status_t *status, int frames)
+{
+  long long time = 0;
+  snd_pcm_uframes_t pending = 0;
+  if (snd_pcm_status(m_pcmHandle, status) >= 0) {
+    snd_htimestamp_t stamp;
+    snd_pcm_status_get_htstamp(status, &stamp);
+    time = stamp.tv_sec * 1000000000LL + stamp.tv_nsec;
+    pending = snd_pcm_status_get_avail(status);
+  };
+  if (time == 0) {
+    time = StreamStats::now();
+    pending = 0;
+  };
+  return time - (long long)(frames + pending) * 1000000000LL / m_rate;
 }
 
 void AlsaInput::threadFunc(void)
 {
-  bool quit = false;
-  while (!quit) {
-    snd_pcm_wait(m_pcmHandle, 1000);
+  snd_pcm_status_t *status;
+  snd_pcm_status_alloca(&status);
+  boost::shared_array<char> discard(new char[m_periodSize * m_frameSize]);
+  while (!m_quit) {
     try {
-      lock();
-      if (m_data.get()) {
-        int n = m_periodSize;
-        if (m_count + n > m_size) {
-          int m_size_new = m_size;
-          while(m_size_new < m_count + n) m_size_new = 2 * m_size_new;
-          boost::shared_array<short int> data(new short int[m_size_new * m_channels]);
-          if (m_start + m_count > m_size) {
-            memcpy(data.get(), m_data.get() + m_start * m_channels, (m_size - m_start) * 2 * m_channels);
-            memcpy(data.get() + (m_size - m_start) * m_channels, m_data.get(), (m_start + m_count - m_size) * 2 * m_channels);
-          } else
-            memcpy(data.get(), m_data.get() + m_start * m_channels, m_count * 2 * m_channels);
-          m_data = data;
-          m_start = 0;
-          m_size = m_size_new;
-        };
-        int offset = m_start + m_count;
-        if (offset > m_size) offset -= m_size;
-        if (offset + n > m_size) n = m_size - offset;
-        readi(m_data.get() + offset * m_channels, n);
-        m_count += n;
-      } else
-        quit = true;
-      unlock();
+      startDevice();
+      if (!m_poll->wait(1000)) continue;
+      capturePeriod(status, discard.get());
     } catch (Error &e) {
-      quit = true;
-      m_data.reset();
-      unlock();
+      fail(e.what());
+      break;
     }
   };
 }
 
+void AlsaInput::startDevice(void) throw (Error)
+{
+  if (snd_pcm_state(m_pcmHandle) == SND_PCM_STATE_PREPARED) {
+    int err = snd_pcm_start(m_pcmHandle);
+    ERRORMACRO(err >= 0, Error, , "Error starting PCM device \"" << m_pcmName
+               << "\": " << snd_strerror(err));
+  };
+}
+
+// Transfer one period from the device to the ring buffer. The discard buffer must
+// be able to hold one period and is used when the ring buffer is full.
+void AlsaInput::capturePeriod(snd_pcm_status_t *status, char *discard) throw (Error)
+{
+  if (m_resampler.get()) {
+    resamplePeriod(status, discard);
+    return;
+  };
+  long long start = StreamStats::now();
+  int n = m_periodSize;
+  char *data = m_ring->writeRegion(n);
+  if (n == 0 && m_policy == OVERFLOW_DROP_OLDEST) {
+    m_stats.dropped(m_ring->dropOldest(m_periodSize));
+    n = m_periodSize;
+    data = m_ring->writeRegion(n);
+  };
+  bool overflow = n == 0;
+  if (overflow) {
+    if (m_policy == OVERFLOW_ERROR) m_overflow = true;
+    data = discard;
+    n = m_periodSize;
+  };
+  if (m_mmap)
+    mmapRead(data, n);
+  else
+    readi(data, n);
+  if (m_chain.get()) m_chain->apply(data, m_format, n);
+  if (m_analyser.get()) m_analyser->analyse(data, m_format, n);
+  if (overflow)
+    m_stats.dropped(n);
+  else {
+    m_stamps->record(m_ring->writePosition(), n, m_captured, blockTime(status, n));
+    m_ring->commitWrite(n);
+    m_stats.transferred(n);
+    m_stats.fill(m_ring->count());
+    m_watermark->signal();
+    m_wait->signal();
+  };
+  m_captured += n;
+  m_stats.period(StreamStats::now() - start);
+}
+
+// Read one period from the device into the specified buffer and transfer it to the
+// ring buffer after converting it to the requested sampling rate.
+void AlsaInput::resamplePeriod(snd_pcm_status_t *status, char *data) throw (Error)
+{
+  long long start = StreamStats::now();
+  int n = m_periodSize;
+  if (m_mmap)
+    mmapRead(data, n);
+  else
+    readi(data, n);
+  // The first resampled frame lags behind the first frame read because of the
+  // filter delay.
+  long long time = blockTime(status, n) +
+    (long long)(m_resampler->position() * 1000000000.0 / m_rate);
+  float *buffer = m_resampleBuffer.get();
+  convertSamples(data, m_format, (char *)buffer, SAMPLE_FLOAT, n * m_channels);
+  if (m_chain.get()) m_chain->run(buffer, n);
+  if (m_analyser.get()) m_analyser->analyse(buffer, n);
+  m_resampler->push(buffer, n);
+  int m = m_resampler->available();
+  m_resampler->pull(buffer, m);
+  if (m_ring->space() < m && m_policy == OVERFLOW_DROP_OLDEST)
+    m_stats.dropped(m_ring->dropOldest(m - m_ring->space()));
+  int fit = min(m, m_ring->space());
+  if (fit < m) {
+    if (m_policy == OVERFLOW_ERROR) m_overflow = true;
+    m_stats.dropped(m - fit);
+  };
+  if (fit > 0) {
+    m_stamps->record(m_ring->writePosition(), fit, m_captured, time);
+    int written = 0;
+    while (written < fit) {
+      int k = fit - written;
+      char *region = m_ring->writeRegion(k);
+      convertSamples((const char *)(buffer + written * m_channels), SAMPLE_FLOAT,
+                     region, m_format, k * m_channels);
+      m_ring->commitWrite(k);
+      written += k;
+    };
+    m_stats.fill(m_ring->count());
+    m_watermark->signal();
+    m_wait->signal();
+  };
+  m_stats.transferred(n);
+  m_captured += m;
+  m_stats.period(StreamStats::now() - start);
+}
+
+void AlsaInput::fail(const string &message)
+{
+  m_stats.error();
+  m_error = message;
+  m_running = false;
+  m_ring->interrupt();
+  m_wait->interrupt();
+}
+
 void *AlsaInput::staticThreadFunc( void *self )
 {
   ((AlsaInput *)self)->threadFunc();
@@ -236,13 +680,45 @@ VALUE AlsaInput::registerRubyClass( VALUE rbModule )
 {
   cRubyClass = rb_define_class_under( rbModule, "AlsaInput", rb_cObject );
   rb_define_singleton_method(cRubyClass, "new",
-                             RUBY_METHOD_FUNC(wrapNew), 3);
+                             RUBY_METHOD_FUNC(wrapNew), 10);
   rb_define_method( cRubyClass, "close", RUBY_METHOD_FUNC( wrapClose ), 0 );
-  rb_define_method( cRubyClass, "read", RUBY_METHOD_FUNC( wrapRead ), 1 );
+  rb_define_method( cRubyClass, "read", RUBY_METHOD_FUNC( wrapRead ), 2 );
+  rb_define_method( cRubyClass, "read_into", RUBY_METHOD_FUNC( wrapReadInto ), 3 );
+  rb_define_method( cRubyClass, "read_nonblock", RUBY_METHOD_FUNC( wrapReadNonblock ), 3 );
   rb_define_method( cRubyClass, "rate", RUBY_METHOD_FUNC( wrapRate ), 0 );
+  rb_define_method( cRubyClass, "device_rate", RUBY_METHOD_FUNC( wrapDeviceRate ), 0 );
   rb_define_method( cRubyClass, "channels", RUBY_METHOD_FUNC( wrapChannels ), 0 );
+  rb_define_method( cRubyClass, "format", RUBY_METHOD_FUNC( wrapFormat ), 0 );
+  rb_define_method( cRubyClass, "period_size", RUBY_METHOD_FUNC( wrapPeriodSize ), 0 );
+  rb_define_method( cRubyClass, "buffer_size", RUBY_METHOD_FUNC( wrapBufferSize ), 0 );
+  rb_define_method( cRubyClass, "periods", RUBY_METHOD_FUNC( wrapPeriods ), 0 );
+  rb_define_method( cRubyClass, "mmap?", RUBY_METHOD_FUNC( wrapMMap ), 0 );
+  rb_define_method( cRubyClass, "ring_size", RUBY_METHOD_FUNC( wrapRingSize ), 0 );
+  rb_define_method( cRubyClass, "overflow", RUBY_METHOD_FUNC( wrapPolicy ), 0 );
+  rb_define_method( cRubyClass, "lost_frames", RUBY_METHOD_FUNC( wrapLostFrames ), 0 );
+  rb_define_method( cRubyClass, "timestamp", RUBY_METHOD_FUNC( wrapTimestamp ), 0 );
+  rb_define_method( cRubyClass, "frame_index", RUBY_METHOD_FUNC( wrapFrameIndex ), 0 );
+  rb_define_method( cRubyClass, "schedule", RUBY_METHOD_FUNC( wrapSchedule ), 4 );
+  rb_define_method( cRubyClass, "realtime?", RUBY_METHOD_FUNC( wrapRealtime ), 0 );
+  rb_define_method( cRubyClass, "memory_locked?", RUBY_METHOD_FUNC( wrapMemoryLocked ), 0 );
+  rb_define_method( cRubyClass, "resample", RUBY_METHOD_FUNC( wrapResample ), 1 );
+  rb_define_method( cRubyClass, "resampling?", RUBY_METHOD_FUNC( wrapResampling ), 0 );
+  rb_define_method( cRubyClass, "stats", RUBY_METHOD_FUNC( wrapStats ), 0 );
   rb_define_method( cRubyClass, "avail", RUBY_METHOD_FUNC( wrapAvail ), 0 );
   rb_define_method( cRubyClass, "drop", RUBY_METHOD_FUNC( wrapDrop ), 0 );
+  rb_define_method( cRubyClass, "watermark", RUBY_METHOD_FUNC( wrapWatermark ), 0 );
+  rb_define_method( cRubyClass, "watermark=", RUBY_METHOD_FUNC( wrapSetWatermark ), 1 );
+  rb_define_method( cRubyClass, "watermark_fd", RUBY_METHOD_FUNC( wrapWatermarkFd ), 0 );
+  rb_define_method( cRubyClass, "record_to", RUBY_METHOD_FUNC( wrapRecordTo ), 3 );
+  rb_define_method( cRubyClass, "stop_recording", RUBY_METHOD_FUNC( wrapStopRecording ), 0 );
+  rb_define_method( cRubyClass, "recording?", RUBY_METHOD_FUNC( wrapRecording ), 0 );
+  rb_define_method( cRubyClass, "recorded", RUBY_METHOD_FUNC( wrapRecorded ), 0 );
+  rb_define_method( cRubyClass, "chain=", RUBY_METHOD_FUNC( wrapSetChain ), 1 );
+  rb_define_method( cRubyClass, "analyse", RUBY_METHOD_FUNC( wrapAnalyse ), 2 );
+  rb_define_method( cRubyClass, "analysis_size", RUBY_METHOD_FUNC( wrapAnalysisSize ), 0 );
+  rb_define_method( cRubyClass, "analysis_hop", RUBY_METHOD_FUNC( wrapAnalysisHop ), 0 );
+  rb_define_method( cRubyClass, "analysis", RUBY_METHOD_FUNC( wrapAnalysis ), 0 );
+  rb_define_method( cRubyClass, "reset_analysis", RUBY_METHOD_FUNC( wrapResetAnalysis ), 0 );
 }
 
 void AlsaInput::deleteRubyObject( void *ptr )
@@ -251,13 +727,22 @@ void AlsaInput::deleteRubyObject( void *ptr )
 }
 
 VALUE AlsaInput::wrapNew( VALUE rbClass, VALUE rbPCMName, VALUE rbRate,
-                          VALUE rbChannels)
+                          VALUE rbChannels, VALUE rbFormat, VALUE rbMMap,
+                          VALUE rbBufferTime, VALUE rbPeriods, VALUE rbPeriodSize,
+                          VALUE rbRingSize, VALUE rbPolicy)
 {
   VALUE retVal = Qnil;
   try {
     rb_check_type( rbPCMName, T_STRING );
+    rb_check_type( rbFormat, T_STRING );
+    rb_check_type( rbPolicy, T_STRING );
     AlsaInputPtr ptr(new AlsaInput(StringValuePtr(rbPCMName),
-                                   NUM2UINT(rbRate), NUM2UINT(rbChannels)));
+                                   NUM2UINT(rbRate), NUM2UINT(rbChannels),
+                                   parseSampleFormat(StringValuePtr(rbFormat)),
+                                   RTEST(rbMMap), NUM2UINT(rbBufferTime),
+                                   NUM2UINT(rbPeriods), NUM2ULONG(rbPeriodSize),
+                                   NUM2INT(rbRingSize),
+                                   parseOverflowPolicy(StringValuePtr(rbPolicy))));
     retVal = Data_Wrap_Struct( rbClass, 0, deleteRubyObject,
                                new AlsaInputPtr( ptr ) );
   } catch ( exception &e ) {
@@ -273,13 +758,52 @@ VALUE AlsaInput::wrapClose( VALUE rbSelf )
   return rbSelf;
 }
 
-VALUE AlsaInput::wrapRead( VALUE rbSelf, VALUE rbSamples )
+VALUE AlsaInput::wrapRead( VALUE rbSelf, VALUE rbSamples, VALUE rbFormat )
 {
   VALUE rbRetVal = Qnil;
+  int state = 0;
   try {
     AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
-    SequencePtr sequence( (*self)->read( NUM2INT( rbSamples ) ) );
+    SequencePtr sequence( (*self)->read( NUM2INT( rbSamples ),
+                                         parseSampleFormat( StringValuePtr( rbFormat ) ) ) );
     rbRetVal = sequence->rubyObject();
+  } catch ( Interrupt &e ) {
+    state = e.state();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  if ( state != 0 ) rb_jump_tag( state );
+  return rbRetVal;
+}
+
+VALUE AlsaInput::wrapReadInto( VALUE rbSelf, VALUE rbMemory, VALUE rbSamples,
+                               VALUE rbFormat )
+{
+  int state = 0;
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    char *data; Data_Get_Struct( rbMemory, char, data );
+    (*self)->read( data, NUM2INT( rbSamples ),
+                   parseSampleFormat( StringValuePtr( rbFormat ) ) );
+  } catch ( Interrupt &e ) {
+    state = e.state();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  if ( state != 0 ) rb_jump_tag( state );
+  return rbMemory;
+}
+
+VALUE AlsaInput::wrapReadNonblock( VALUE rbSelf, VALUE rbMemory, VALUE rbSamples,
+                                   VALUE rbFormat )
+{
+  VALUE rbRetVal = Qnil;
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    char *data; Data_Get_Struct( rbMemory, char, data );
+    rbRetVal = INT2NUM( (*self)->read( data, NUM2INT( rbSamples ),
+                                       parseSampleFormat( StringValuePtr( rbFormat ) ),
+                                       false ) );
   } catch ( exception &e ) {
     rb_raise( rb_eRuntimeError, "%s", e.what() );
   };
@@ -292,12 +816,134 @@ VALUE AlsaInput::wrapRate( VALUE rbSelf )
   return UINT2NUM( (*self)->rate() );
 }
 
+VALUE AlsaInput::wrapDeviceRate( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return UINT2NUM( (*self)->deviceRate() );
+}
+
 VALUE AlsaInput::wrapChannels( VALUE rbSelf )
 {
   AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
   return UINT2NUM( (*self)->channels() );
 }
 
+VALUE AlsaInput::wrapPeriodSize( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return ULONG2NUM( (*self)->periodSize() );
+}
+
+VALUE AlsaInput::wrapBufferSize( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return ULONG2NUM( (*self)->bufferSize() );
+}
+
+VALUE AlsaInput::wrapPeriods( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return UINT2NUM( (*self)->periods() );
+}
+
+VALUE AlsaInput::wrapFormat( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return ID2SYM( rb_intern( sampleFormatName( (*self)->format() ) ) );
+}
+
+VALUE AlsaInput::wrapMMap( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return (*self)->mmap() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaInput::wrapRingSize( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return INT2NUM( (*self)->ringSize() );
+}
+
+VALUE AlsaInput::wrapPolicy( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return ID2SYM( rb_intern( overflowPolicyName( (*self)->policy() ) ) );
+}
+
+VALUE AlsaInput::wrapLostFrames( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return LONG2NUM( (*self)->lostFrames() );
+}
+
+VALUE AlsaInput::wrapTimestamp( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  long long frame, time;
+  if (!(*self)->timestamp(frame, time)) return Qnil;
+  return rb_float_new(time * 1e-9);
+}
+
+VALUE AlsaInput::wrapFrameIndex( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  long long frame, time;
+  if (!(*self)->timestamp(frame, time)) return Qnil;
+  return LL2NUM(frame);
+}
+
+VALUE AlsaInput::wrapSchedule(VALUE rbSelf, VALUE rbPriority, VALUE rbCPUs,
+                              VALUE rbLockMemory, VALUE rbFallback)
+{
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    rb_check_type( rbCPUs, T_ARRAY );
+    vector<int> cpus;
+    for (long i=0; i<RARRAY_LEN(rbCPUs); i++)
+      cpus.push_back(NUM2INT(rb_ary_entry(rbCPUs, i)));
+    (*self)->schedule(NUM2INT(rbPriority), cpus, RTEST(rbLockMemory), RTEST(rbFallback));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaInput::wrapRealtime( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return (*self)->realtime() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaInput::wrapMemoryLocked( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return (*self)->memoryLocked() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaInput::wrapResample( VALUE rbSelf, VALUE rbTaps )
+{
+  VALUE rbRetVal = Qnil;
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    rbRetVal = (*self)->resample(NUM2INT(rbTaps)) ? Qtrue : Qfalse;
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbRetVal;
+}
+
+VALUE AlsaInput::wrapResampling( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return (*self)->resampling() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaInput::wrapStats( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return (*self)->stats();
+}
+
 VALUE AlsaInput::wrapAvail( VALUE rbSelf )
 {
   VALUE rbRetVal = Qnil;
@@ -321,3 +967,148 @@ VALUE AlsaInput::wrapDrop( VALUE rbSelf )
   return rbSelf;
 }
 
+VALUE AlsaInput::wrapWatermark( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return INT2NUM( (*self)->watermark() );
+}
+
+VALUE AlsaInput::wrapSetWatermark( VALUE rbSelf, VALUE rbFrames )
+{
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    (*self)->setWatermark( NUM2INT( rbFrames ) );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbFrames;
+}
+
+VALUE AlsaInput::wrapWatermarkFd( VALUE rbSelf )
+{
+  VALUE rbRetVal = Qnil;
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    rbRetVal = INT2NUM( (*self)->watermarkFd() );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbRetVal;
+}
+
+VALUE AlsaInput::wrapRecordTo( VALUE rbSelf, VALUE rbPath, VALUE rbContainer,
+                               VALUE rbFormat )
+{
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    rb_check_type( rbPath, T_STRING );
+    rb_check_type( rbContainer, T_STRING );
+    rb_check_type( rbFormat, T_STRING );
+    (*self)->recordTo(StringValuePtr(rbPath),
+                      parseRecordContainer(StringValuePtr(rbContainer)),
+                      parseSampleFormat(StringValuePtr(rbFormat)));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaInput::wrapStopRecording( VALUE rbSelf )
+{
+  VALUE rbRetVal = Qnil;
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    rbRetVal = LL2NUM((*self)->stopRecording());
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbRetVal;
+}
+
+VALUE AlsaInput::wrapRecording( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return (*self)->recording() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaInput::wrapRecorded( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  return LL2NUM((*self)->recordedFrames());
+}
+
+VALUE AlsaInput::wrapSetChain( VALUE rbSelf, VALUE rbChain )
+{
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    DSPChainPtr chain;
+    if (rbChain != Qnil) {
+      if (!rb_obj_is_kind_of(rbChain, DSPChain::cRubyClass))
+        rb_raise(rb_eTypeError, "Expected DSPChain or nil");
+      DSPChainPtr *ptr; Data_Get_Struct( rbChain, DSPChainPtr, ptr );
+      chain = *ptr;
+    };
+    (*self)->setChain(chain);
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbChain;
+}
+
+VALUE AlsaInput::wrapAnalyse( VALUE rbSelf, VALUE rbFFTSize, VALUE rbHop )
+{
+  try {
+    AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+    (*self)->analyse(NUM2INT(rbFFTSize), NUM2INT(rbHop));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaInput::wrapAnalysisSize( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  AnalyserPtr analyser = (*self)->analyser();
+  return INT2NUM(analyser.get() ? analyser->fftSize() : 0);
+}
+
+VALUE AlsaInput::wrapAnalysisHop( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  AnalyserPtr analyser = (*self)->analyser();
+  return INT2NUM(analyser.get() ? analyser->hop() : 0);
+}
+
+// Returns the number of hops analysed, the peak and RMS levels, and the spectrum as
+// a sequence of single precision floating point numbers.
+VALUE AlsaInput::wrapAnalysis( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  AnalyserPtr analyser = (*self)->analyser();
+  if (analyser.get() == NULL) return Qnil;
+  int channels = analyser->channels();
+  vector<float> peak(channels), rms(channels);
+  int size = analyser->bins() * channels * sizeof(float);
+  SequencePtr spectrum(new Sequence(size));
+  // Root the sequence while the arrays below are allocated.
+  VALUE rbSpectrum = spectrum->rubyObject();
+  long long blocks = analyser->latest(&peak[0], &rms[0], (float *)spectrum->data());
+  VALUE rbPeak = rb_ary_new2(channels);
+  VALUE rbRMS = rb_ary_new2(channels);
+  for (int c=0; c<channels; c++) {
+    rb_ary_push(rbPeak, rb_float_new(peak[c]));
+    rb_ary_push(rbRMS, rb_float_new(rms[c]));
+  };
+  VALUE rbRetVal = rb_ary_new3(4, LL2NUM(blocks), rbPeak, rbRMS, rbSpectrum);
+  RB_GC_GUARD(rbSpectrum);
+  return rbRetVal;
+}
+
+VALUE AlsaInput::wrapResetAnalysis( VALUE rbSelf )
+{
+  AlsaInputPtr *self; Data_Get_Struct( rbSelf, AlsaInputPtr, self );
+  AnalyserPtr analyser = (*self)->analyser();
+  if (analyser.get()) analyser->reset();
+  return rbSelf;
+}
@@ -21,49 +21,168 @@
 #include "rubyinc.hh"
 #include "error.hh"
 #include "sequence.hh"
+#include "ringbuffer.hh"
+#include "gvl.hh"
+#include "convert.hh"
+#include "devicepoll.hh"
+#include "threadscheduling.hh"
+#include "streamstats.hh"
+#include "blockstamps.hh"
+#include "resampler.hh"
+#include "pcmpool.hh"
+#include "watermark.hh"
+#include "recorder.hh"
+#include "dspchain.hh"
+#include "analyser.hh"
 
 class AlsaInput
 {
+  friend class AlsaInputGroup;
 public:
   AlsaInput( const std::string &pcmName = "default:0",
-             unsigned int rate = 48000, unsigned int channels = 2) throw (Error);
+             unsigned int rate = 48000, unsigned int channels = 2,
+             SampleFormat format = SAMPLE_S16, bool mmap = false,
+             unsigned int bufferTime = 500000, unsigned int periods = 16,
+             snd_pcm_uframes_t periodSize = 0, int ringSize = 0,
+             OverflowPolicy policy = OVERFLOW_DROP_NEWEST) throw (Error);
   virtual ~AlsaInput(void);
   void close(void);
-  SequencePtr read( int samples ) throw (Error);
+  SequencePtr read( int samples, SampleFormat format = SAMPLE_S16 ) throw (Error);
+  int read(char *data, int samples, SampleFormat format = SAMPLE_S16,
+           bool block = true) throw (Error);
   void drop(void) throw (Error);
   unsigned int rate(void);
+  unsigned int deviceRate(void);
   unsigned int channels(void);
+  snd_pcm_uframes_t periodSize(void);
+  snd_pcm_uframes_t bufferSize(void);
+  unsigned int periods(void);
+  SampleFormat format(void);
+  bool mmap(void);
+  int ringSize(void);
+  OverflowPolicy policy(void);
+  long lostFrames(void);
+  bool timestamp(long long &frame, long long &time);
+  void schedule(int priority, const std::vector<int> &cpus, bool lockMemory,
+                bool fallback) throw (Error);
+  bool realtime(void);
+  bool memoryLocked(void);
+  bool resample(int taps) throw (Error);
+  bool resampling(void);
+  VALUE stats(void);
   int avail(void) throw (Error);
-  void lock(void);
-  void unlock(void);
   void prepare(void) throw (Error);
+  int watermark(void);
+  void setWatermark(int frames) throw (Error);
+  int watermarkFd(void) throw (Error);
+  void recordTo(const std::string &path, RecordContainer container,
+                SampleFormat format) throw (Error);
+  long long stopRecording(void) throw (Error);
+  bool recording(void);
+  long long recordedFrames(void);
+  void setChain(DSPChainPtr chain) throw (Error);
+  void analyse(int fftSize, int hop) throw (Error);
+  AnalyserPtr analyser(void);
   static VALUE cRubyClass;
   static VALUE registerRubyClass( VALUE rbModule );
   static void deleteRubyObject( void *ptr );
   static VALUE wrapNew(VALUE rbClass, VALUE rbPCMName, VALUE rbRate,
-                       VALUE rbChannels);
+                       VALUE rbChannels, VALUE rbFormat, VALUE rbMMap,
+                       VALUE rbBufferTime, VALUE rbPeriods, VALUE rbPeriodSize,
+                       VALUE rbRingSize, VALUE rbPolicy);
   static VALUE wrapClose( VALUE rbSelf );
-  static VALUE wrapRead( VALUE rbSelf, VALUE rbSamples );
+  static VALUE wrapRead( VALUE rbSelf, VALUE rbSamples, VALUE rbFormat );
+  static VALUE wrapReadInto( VALUE rbSelf, VALUE rbMemory, VALUE rbSamples,
+                             VALUE rbFormat );
+  static VALUE wrapReadNonblock( VALUE rbSelf, VALUE rbMemory, VALUE rbSamples,
+                                 VALUE rbFormat );
   static VALUE wrapRate( VALUE rbSelf );
+  static VALUE wrapDeviceRate( VALUE rbSelf );
   static VALUE wrapChannels( VALUE rbSelf );
+  static VALUE wrapPeriodSize( VALUE rbSelf );
+  static VALUE wrapBufferSize( VALUE rbSelf );
+  static VALUE wrapPeriods( VALUE rbSelf );
+  static VALUE wrapFormat( VALUE rbSelf );
+  static VALUE wrapMMap( VALUE rbSelf );
+  static VALUE wrapRingSize( VALUE rbSelf );
+  static VALUE wrapPolicy( VALUE rbSelf );
+  static VALUE wrapLostFrames( VALUE rbSelf );
+  static VALUE wrapTimestamp( VALUE rbSelf );
+  static VALUE wrapFrameIndex( VALUE rbSelf );
+  static VALUE wrapSchedule(VALUE rbSelf, VALUE rbPriority, VALUE rbCPUs,
+                            VALUE rbLockMemory, VALUE rbFallback);
+  static VALUE wrapRealtime( VALUE rbSelf );
+  static VALUE wrapMemoryLocked( VALUE rbSelf );
+  static VALUE wrapResample( VALUE rbSelf, VALUE rbTaps );
+  static VALUE wrapResampling( VALUE rbSelf );
+  static VALUE wrapStats( VALUE rbSelf );
   static VALUE wrapAvail( VALUE rbSelf );
   static VALUE wrapDrop( VALUE rbSelf );
+  static VALUE wrapWatermark( VALUE rbSelf );
+  static VALUE wrapSetWatermark( VALUE rbSelf, VALUE rbFrames );
+  static VALUE wrapWatermarkFd( VALUE rbSelf );
+  static VALUE wrapRecordTo( VALUE rbSelf, VALUE rbPath, VALUE rbContainer,
+                             VALUE rbFormat );
+  static VALUE wrapStopRecording( VALUE rbSelf );
+  static VALUE wrapRecording( VALUE rbSelf );
+  static VALUE wrapRecorded( VALUE rbSelf );
+  static VALUE wrapSetChain( VALUE rbSelf, VALUE rbChain );
+  static VALUE wrapAnalyse( VALUE rbSelf, VALUE rbFFTSize, VALUE rbHop );
+  static VALUE wrapAnalysisSize( VALUE rbSelf );
+  static VALUE wrapAnalysisHop( VALUE rbSelf );
+  static VALUE wrapAnalysis( VALUE rbSelf );
+  static VALUE wrapResetAnalysis( VALUE rbSelf );
 protected:
-  void readi(short int *data, int count);
+  void readi(char *data, int count) throw (Error);
+  void mmapRead(char *data, int count) throw (Error);
+  void recover(int err) throw (Error);
+  void releaseDevice(void);
+  void checkThread(void) throw (Error);
+  void startThread(void) throw (Error);
+  void stopThread(void);
+  long long blockTime(snd_pcm_status_t *status, int frames);
+  void startDevice(void) throw (Error);
+  void capturePeriod(snd_pcm_status_t *status, char *discard) throw (Error);
+  void resamplePeriod(snd_pcm_status_t *status, char *data) throw (Error);
+  void fail(const std::string &message);
   void threadFunc(void);
   static void *staticThreadFunc( void *self );
   snd_pcm_t *m_pcmHandle;
   std::string m_pcmName;
+  PCMConfig m_config;
   unsigned int m_rate;
+  unsigned int m_requestedRate;
   unsigned int m_channels;
+  SampleFormat m_format;
+  int m_frameSize;
+  bool m_mmap;
   snd_pcm_uframes_t m_periodSize;
+  snd_pcm_uframes_t m_bufferSize;
+  unsigned int m_periods;
+  OverflowPolicy m_policy;
   bool m_threadInitialised;
-  boost::shared_array<short int> m_data;
-  int m_start;
-  int m_count;
-  int m_size;
+  boost::atomic<bool> m_running;
+  boost::atomic<bool> m_quit;
+  boost::atomic<bool> m_overflow;
+  RingBufferPtr m_ring;
+  DevicePollPtr m_poll;
+  WatermarkPtr m_watermark;
+  WatermarkPtr m_wait;
+  RecorderPtr m_recorder;
+  DSPChainPtr m_chain;
+  AnalyserPtr m_analyser;
+  ThreadScheduling m_scheduling;
+  StreamStats m_stats;
+  BlockStampsPtr m_stamps;
+  ResamplerPtr m_resampler;
+  boost::shared_array<float> m_resampleBuffer;
+  long long m_captured;
+  bool m_grouped;
+  bool m_stamped;
+  long long m_frameIndex;
+  long long m_timestamp;
+  std::string m_error;
   pthread_t m_thread;
-  pthread_mutex_t m_mutex;
 };
 
 typedef boost::shared_ptr< AlsaInput > AlsaInputPtr;
@@ -0,0 +1,355 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstring>
+#include "alsainputgroup.hh"
+
+using namespace std;
+
+VALUE AlsaInputGroup::cRubyClass = Qnil;
+
+AlsaInputGroup::AlsaInputGroup(const vector<AlsaInputPtr> &devices) throw (Error):
+  m_devices(devices), m_linked(devices.size(), false), m_threadInitialised(false),
+  m_quit(false), m_aligned(false)
+{
+  ERRORMACRO(!m_devices.empty(), Error, , "A capture group requires at least one "
+             "device");
+  vector<snd_pcm_t *> handles;
+  for (unsigned int i=0; i<m_devices.size(); i++) {
+    AlsaInputPtr device = m_devices[i];
+    ERRORMACRO(device->m_pcmHandle != NULL, Error, , "PCM device \"" << device->m_pcmName
+               << "\" is not open. Did you call \"close\" before?");
+    ERRORMACRO(!device->m_grouped && !device->m_running, Error, , "PCM device \""
+               << device->m_pcmName << "\" is already in use");
+    ERRORMACRO(device->rate() == m_devices[0]->rate(), Error, , "Sampling rate of PCM "
+               "device \"" << device->m_pcmName << "\" (" << device->rate() << " Hz) "
+               "differs from the one of PCM device \"" << m_devices[0]->m_pcmName
+               << "\" (" << m_devices[0]->rate() << " Hz)");
+    if (i > 0) m_pcmNames += ", ";
+    m_pcmNames += device->m_pcmName;
+    handles.push_back(device->m_pcmHandle);
+  };
+  m_poll = DevicePollPtr(new DevicePoll(handles, m_pcmNames));
+  m_linked[0] = true;
+  for (unsigned int i=1; i<m_devices.size(); i++)
+    m_linked[i] = snd_pcm_link(handles[0], handles[i]) >= 0;
+  for (unsigned int i=0; i<m_devices.size(); i++)
+    m_devices[i]->m_grouped = true;
+}
+
+AlsaInputGroup::~AlsaInputGroup(void)
+{
+  close();
+}
+
+void AlsaInputGroup::close(void)
+{
+  if (!m_devices.empty()) {
+    stopThread();
+    for (unsigned int i=0; i<m_devices.size(); i++) {
+      AlsaInputPtr device = m_devices[i];
+      if (i > 0 && m_linked[i]) snd_pcm_unlink(device->m_pcmHandle);
+      device->m_grouped = false;
+      device->close();
+    };
+    m_devices.clear();
+    m_poll.reset();
+  };
+}
+
+SequencePtr AlsaInputGroup::read(int samples, SampleFormat format) throw (Error)
+{
+  SequencePtr frame(new Sequence((int)(samples * sampleSize(format) * channels())));
+  // Root the sequence while the GVL is released (see AlsaInput::read).
+  VALUE rbFrame = frame->rubyObject();
+  read(frame->data(), samples, format);
+  RB_GC_GUARD(rbFrame);
+  return frame;
+}
+
+void AlsaInputGroup::read(char *data, int samples, SampleFormat format) throw (Error)
+{
+  ERRORMACRO(!m_devices.empty(), Error, , "Capture group is not open. Did you call "
+             "\"close\" before?");
+  startThread();
+  if (!m_aligned) align(format);
+  int frameSize = sampleSize(format) * channels();
+  int offset = 0;
+  for (unsigned int i=0; i<m_devices.size(); i++) {
+    int deviceFrameSize = sampleSize(format) * m_devices[i]->channels();
+    m_scratch.resize(samples * deviceFrameSize);
+    m_devices[i]->read(&m_scratch[0], samples, format);
+    for (int j=0; j<samples; j++)
+      memcpy(data + j * frameSize + offset, &m_scratch[j * deviceFrameSize],
+             deviceFrameSize);
+    offset += deviceFrameSize;
+  };
+}
+
+int AlsaInputGroup::size(void)
+{
+  return m_devices.size();
+}
+
+unsigned int AlsaInputGroup::rate(void)
+{
+  return m_devices.empty() ? 0 : m_devices[0]->rate();
+}
+
+unsigned int AlsaInputGroup::channels(void)
+{
+  unsigned int retVal = 0;
+  for (unsigned int i=0; i<m_devices.size(); i++)
+    retVal += m_devices[i]->channels();
+  return retVal;
+}
+
+bool AlsaInputGroup::linked(void)
+{
+  for (unsigned int i=0; i<m_linked.size(); i++)
+    if (!m_linked[i]) return false;
+  return true;
+}
+
+// Time offset of the last block read from each device relative to the first
+// device. The streams are aligned when reading starts, so the offsets show how
+// far the clocks of the devices have drifted apart since.
+vector<double> AlsaInputGroup::drift(void)
+{
+  vector<double> retVal(m_devices.size(), 0.0);
+  long long frame, reference;
+  if (!m_aligned || !m_devices[0]->timestamp(frame, reference)) return retVal;
+  for (unsigned int i=1; i<m_devices.size(); i++) {
+    long long time;
+    if (m_devices[i]->timestamp(frame, time))
+      retVal[i] = (time - reference) * 1e-9;
+  };
+  return retVal;
+}
+
+// Discard leading frames of the devices which started earlier so that the first
+// frames returned by all devices were captured at the same time.
+void AlsaInputGroup::align(SampleFormat format) throw (Error)
+{
+  vector<long long> times(m_devices.size(), 0);
+  long long latest = 0;
+  bool stamped = true;
+  for (unsigned int i=0; i<m_devices.size(); i++) {
+    m_scratch.resize(sampleSize(format) * m_devices[i]->channels());
+    m_devices[i]->read(&m_scratch[0], 1, format);
+    long long frame;
+    stamped = stamped && m_devices[i]->timestamp(frame, times[i]);
+    if (times[i] > latest) latest = times[i];
+  };
+  if (stamped) {
+    for (unsigned int i=0; i<m_devices.size(); i++) {
+      long long skip = ((latest - times[i]) * rate() + 500000000LL) / 1000000000LL;
+      int frameSize = sampleSize(format) * m_devices[i]->channels();
+      while (skip > 0) {
+        int m = skip < (long long)m_devices[i]->periodSize() ?
+                (int)skip : (int)m_devices[i]->periodSize();
+        m_scratch.resize(m * frameSize);
+        m_devices[i]->read(&m_scratch[0], m, format);
+        skip -= m;
+      };
+    };
+  };
+  m_aligned = true;
+}
+
+void AlsaInputGroup::startThread(void) throw (Error)
+{
+  if (!m_threadInitialised) {
+    for (unsigned int i=0; i<m_devices.size(); i++) {
+      m_devices[i]->m_running = true;
+      m_poll->enable(i);
+    };
+    // The devices were opened with the same options so the scheduling requested
+    // for the first one applies to the thread servicing all of them.
+    int err = m_devices[0]->m_scheduling.createThread(&m_thread, staticThreadFunc,
+                                                      this);
+    if (err != 0) {
+      for (unsigned int i=0; i<m_devices.size(); i++)
+        m_devices[i]->m_running = false;
+      ERRORMACRO(false, Error, , "Error creating audio thread for PCM devices "
+                 << m_pcmNames << ": " << strerror(err));
+    };
+    m_threadInitialised = true;
+  };
+}
+
+void AlsaInputGroup::stopThread(void)
+{
+  m_quit = true;
+  if (m_poll.get()) m_poll->wake();
+  if (m_threadInitialised) {
+    pthread_join(m_thread, NULL);
+    m_threadInitialised = false;
+  };
+  m_quit = false;
+  for (unsigned int i=0; i<m_devices.size(); i++)
+    m_devices[i]->m_running = false;
+}
+
+void AlsaInputGroup::threadFunc(void)
+{
+  snd_pcm_status_t *status;
+  snd_pcm_status_alloca(&status);
+  vector< boost::shared_array<char> > discard;
+  for (unsigned int i=0; i<m_devices.size(); i++)
+    discard.push_back(boost::shared_array<char>
+      (new char[m_devices[i]->m_periodSize * m_devices[i]->m_frameSize]));
+  while (!m_quit) {
+    bool running = false;
+    for (unsigned int i=0; i<m_devices.size(); i++) {
+      AlsaInputPtr device = m_devices[i];
+      if (device->m_running) {
+        try {
+          device->startDevice();
+          running = true;
+        } catch (Error &e) {
+          device->fail(e.what());
+          m_poll->disable(i);
+        }
+      };
+    };
+    if (!running) break;
+    try {
+      if (!m_poll->wait(1000)) continue;
+    } catch (Error &e) {
+      for (unsigned int i=0; i<m_devices.size(); i++)
+        if (m_devices[i]->m_running) m_devices[i]->fail(e.what());
+      break;
+    };
+    for (unsigned int i=0; i<m_devices.size(); i++) {
+      AlsaInputPtr device = m_devices[i];
+      if (device->m_running && m_poll->ready(i)) {
+        try {
+          device->capturePeriod(status, discard[i].get());
+        } catch (Error &e) {
+          // Keep the descriptors of the failed device from waking the other ones.
+          device->fail(e.what());
+          m_poll->disable(i);
+        }
+      };
+    };
+  };
+}
+
+void *AlsaInputGroup::staticThreadFunc( void *self )
+{
+  ((AlsaInputGroup *)self)->threadFunc();
+  return self;
+}
+
+VALUE AlsaInputGroup::registerRubyClass( VALUE rbModule )
+{
+  cRubyClass = rb_define_class_under( rbModule, "AlsaInputGroup", rb_cObject );
+  rb_define_singleton_method( cRubyClass, "new", RUBY_METHOD_FUNC( wrapNew ), 1 );
+  rb_define_method( cRubyClass, "close", RUBY_METHOD_FUNC( wrapClose ), 0 );
+  rb_define_method( cRubyClass, "read", RUBY_METHOD_FUNC( wrapRead ), 2 );
+  rb_define_method( cRubyClass, "size", RUBY_METHOD_FUNC( wrapSize ), 0 );
+  rb_define_method( cRubyClass, "rate", RUBY_METHOD_FUNC( wrapRate ), 0 );
+  rb_define_method( cRubyClass, "channels", RUBY_METHOD_FUNC( wrapChannels ), 0 );
+  rb_define_method( cRubyClass, "linked?", RUBY_METHOD_FUNC( wrapLinked ), 0 );
+  rb_define_method( cRubyClass, "drift", RUBY_METHOD_FUNC( wrapDrift ), 0 );
+  return cRubyClass;
+}
+
+void AlsaInputGroup::deleteRubyObject( void *ptr )
+{
+  delete (AlsaInputGroupPtr *)ptr;
+}
+
+VALUE AlsaInputGroup::wrapNew( VALUE rbClass, VALUE rbDevices )
+{
+  VALUE retVal = Qnil;
+  try {
+    rb_check_type( rbDevices, T_ARRAY );
+    vector<AlsaInputPtr> devices;
+    for (long i=0; i<RARRAY_LEN(rbDevices); i++) {
+      VALUE rbDevice = rb_ary_entry(rbDevices, i);
+      ERRORMACRO(RTEST(rb_obj_is_kind_of(rbDevice, AlsaInput::cRubyClass)), Error, ,
+                 "Capture group can only contain AlsaInput objects");
+      AlsaInputPtr *device; Data_Get_Struct( rbDevice, AlsaInputPtr, device );
+      devices.push_back(*device);
+    };
+    AlsaInputGroupPtr ptr(new AlsaInputGroup(devices));
+    retVal = Data_Wrap_Struct( rbClass, 0, deleteRubyObject,
+                               new AlsaInputGroupPtr( ptr ) );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE AlsaInputGroup::wrapClose( VALUE rbSelf )
+{
+  AlsaInputGroupPtr *self; Data_Get_Struct( rbSelf, AlsaInputGroupPtr, self );
+  (*self)->close();
+  return rbSelf;
+}
+
+VALUE AlsaInputGroup::wrapRead( VALUE rbSelf, VALUE rbSamples, VALUE rbFormat )
+{
+  VALUE rbRetVal = Qnil;
+  int state = 0;
+  try {
+    AlsaInputGroupPtr *self; Data_Get_Struct( rbSelf, AlsaInputGroupPtr, self );
+    SequencePtr sequence( (*self)->read( NUM2INT( rbSamples ),
+                                         parseSampleFormat( StringValuePtr( rbFormat ) ) ) );
+    rbRetVal = sequence->rubyObject();
+  } catch ( Interrupt &e ) {
+    state = e.state();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  if ( state != 0 ) rb_jump_tag( state );
+  return rbRetVal;
+}
+
+VALUE AlsaInputGroup::wrapSize( VALUE rbSelf )
+{
+  AlsaInputGroupPtr *self; Data_Get_Struct( rbSelf, AlsaInputGroupPtr, self );
+  return INT2NUM( (*self)->size() );
+}
+
+VALUE AlsaInputGroup::wrapRate( VALUE rbSelf )
+{
+  AlsaInputGroupPtr *self; Data_Get_Struct( rbSelf, AlsaInputGroupPtr, self );
+  return UINT2NUM( (*self)->rate() );
+}
+
+VALUE AlsaInputGroup::wrapChannels( VALUE rbSelf )
+{
+  AlsaInputGroupPtr *self; Data_Get_Struct( rbSelf, AlsaInputGroupPtr, self );
+  return UINT2NUM( (*self)->channels() );
+}
+
+VALUE AlsaInputGroup::wrapLinked( VALUE rbSelf )
+{
+  AlsaInputGroupPtr *self; Data_Get_Struct( rbSelf, AlsaInputGroupPtr, self );
+  return (*self)->linked() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaInputGroup::wrapDrift( VALUE rbSelf )
+{
+  AlsaInputGroupPtr *self; Data_Get_Struct( rbSelf, AlsaInputGroupPtr, self );
+  vector<double> drift((*self)->drift());
+  VALUE rbRetVal = rb_ary_new2(drift.size());
+  for (unsigned int i=0; i<drift.size(); i++)
+    rb_ary_push(rbRetVal, rb_float_new(drift[i]));
+  return rbRetVal;
+}
@@ -0,0 +1,69 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef ALSAINPUTGROUP_HH
+#define ALSAINPUTGROUP_HH
+
+#include <string>
+#include <vector>
+#include "alsainput.hh"
+
+// Several capture devices serviced by a single audio thread. The devices are
+// linked with snd_pcm_link where the driver allows it so that they start at the
+// same time. Otherwise the streams are aligned using the capture timestamps.
+class AlsaInputGroup
+{
+public:
+  AlsaInputGroup(const std::vector<AlsaInputPtr> &devices) throw (Error);
+  virtual ~AlsaInputGroup(void);
+  void close(void);
+  SequencePtr read(int samples, SampleFormat format = SAMPLE_S16) throw (Error);
+  void read(char *data, int samples, SampleFormat format = SAMPLE_S16) throw (Error);
+  int size(void);
+  unsigned int rate(void);
+  unsigned int channels(void);
+  bool linked(void);
+  std::vector<double> drift(void);
+  static VALUE cRubyClass;
+  static VALUE registerRubyClass( VALUE rbModule );
+  static void deleteRubyObject( void *ptr );
+  static VALUE wrapNew( VALUE rbClass, VALUE rbDevices );
+  static VALUE wrapClose( VALUE rbSelf );
+  static VALUE wrapRead( VALUE rbSelf, VALUE rbSamples, VALUE rbFormat );
+  static VALUE wrapSize( VALUE rbSelf );
+  static VALUE wrapRate( VALUE rbSelf );
+  static VALUE wrapChannels( VALUE rbSelf );
+  static VALUE wrapLinked( VALUE rbSelf );
+  static VALUE wrapDrift( VALUE rbSelf );
+protected:
+  void align(SampleFormat format) throw (Error);
+  void startThread(void) throw (Error);
+  void stopThread(void);
+  void threadFunc(void);
+  static void *staticThreadFunc( void *self );
+  std::vector<AlsaInputPtr> m_devices;
+  std::vector<bool> m_linked;
+  std::string m_pcmNames;
+  DevicePollPtr m_poll;
+  bool m_threadInitialised;
+  boost::atomic<bool> m_quit;
+  bool m_aligned;
+  std::vector<char> m_scratch;
+  pthread_t m_thread;
+};
+
+typedef boost::shared_ptr< AlsaInputGroup > AlsaInputGroupPtr;
+
+#endif
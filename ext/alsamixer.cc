@@ -0,0 +1,189 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstring>
+#include "alsamixer.hh"
+
+using namespace std;
+
+VALUE AlsaMixer::cRubyClass = Qnil;
+
+AlsaMixer::AlsaMixer(AlsaOutputPtr output, int maxVoices) throw (Error):
+  m_output(output), m_maxVoices(maxVoices)
+{
+  ERRORMACRO(maxVoices > 0, Error, , "Maximum number of voices must be positive (but "
+             "was " << maxVoices << ")");
+  m_slots = boost::shared_array< boost::atomic<AlsaVoicePtr *> >
+    (new boost::atomic<AlsaVoicePtr *>[maxVoices]);
+  m_retired = boost::shared_array< boost::atomic<AlsaVoicePtr *> >
+    (new boost::atomic<AlsaVoicePtr *>[maxVoices]);
+  for (int i=0; i<maxVoices; i++) {
+    m_slots[i] = NULL;
+    m_retired[i] = NULL;
+  };
+  m_mix = boost::shared_array<float>
+    (new float[m_output->periodSize() * m_output->channels()]);
+  m_output->attach(this);
+}
+
+AlsaMixer::~AlsaMixer(void)
+{
+  close();
+}
+
+void AlsaMixer::close(void)
+{
+  if (m_output.get()) {
+    m_output->detach();
+    for (int i=0; i<m_maxVoices; i++) {
+      AlsaVoicePtr *voice = m_slots[i].exchange(NULL);
+      if (voice != NULL) {
+        (*voice)->detach();
+        delete voice;
+      };
+    };
+    reclaim();
+    m_output->close();
+    m_output.reset();
+  };
+}
+
+AlsaVoicePtr AlsaMixer::addVoice(int ringSize, float gain) throw (Error)
+{
+  ERRORMACRO(m_output.get() != NULL, Error, , "Mixer is closed. Did you call "
+             "\"close\" before?");
+  reclaim();
+  AlsaVoicePtr voice(new AlsaVoice(m_output->channels(), ringSize, gain));
+  AlsaVoicePtr *entry = new AlsaVoicePtr(voice);
+  for (int i=0; i<m_maxVoices; i++) {
+    AlsaVoicePtr *expected = NULL;
+    if (m_retired[i].load() == NULL && m_slots[i].compare_exchange_strong(expected, entry))
+      return voice;
+  };
+  delete entry;
+  ERRORMACRO(false, Error, , "Mixer is already playing the maximum number of "
+             << m_maxVoices << " voices");
+  return voice;
+}
+
+int AlsaMixer::voices(void)
+{
+  int retVal = 0;
+  for (int i=0; i<m_maxVoices; i++)
+    if (m_slots[i].load() != NULL) retVal++;
+  return retVal;
+}
+
+int AlsaMixer::maxVoices(void)
+{
+  return m_maxVoices;
+}
+
+// Called by the audio thread of the output for every period.
+void AlsaMixer::render(char *data, int frames)
+{
+  float *mix = m_mix.get();
+  int samples = frames * m_output->channels();
+  memset(mix, 0, samples * sizeof(float));
+  for (int i=0; i<m_maxVoices; i++) {
+    AlsaVoicePtr *voice = m_slots[i].load(boost::memory_order_acquire);
+    if (voice != NULL) {
+      (*voice)->mix(mix, frames);
+      // The voice is published for reclaim before the slot is freed so that
+      // addVoice cannot reuse the slot while the previous voice is unclaimed. A
+      // finished voice stays in its slot until Ruby has reclaimed the previous one.
+      if ((*voice)->finished() && m_retired[i].load() == NULL) {
+        (*voice)->detach();
+        m_retired[i].store(voice);
+        m_slots[i].store(NULL);
+      };
+    };
+  };
+  convertSamples((const char *)mix, SAMPLE_FLOAT, data, m_output->format(), samples);
+}
+
+// Release voices removed by the audio thread. This has to be done by Ruby because
+// the audio thread must not free memory.
+void AlsaMixer::reclaim(void)
+{
+  for (int i=0; i<m_maxVoices; i++) {
+    AlsaVoicePtr *voice = m_retired[i].exchange(NULL);
+    if (voice != NULL) delete voice;
+  };
+}
+
+VALUE AlsaMixer::registerRubyClass( VALUE rbModule )
+{
+  cRubyClass = rb_define_class_under( rbModule, "AlsaMixer", rb_cObject );
+  rb_define_singleton_method( cRubyClass, "new", RUBY_METHOD_FUNC( wrapNew ), 2 );
+  rb_define_method( cRubyClass, "close", RUBY_METHOD_FUNC( wrapClose ), 0 );
+  rb_define_method( cRubyClass, "voice", RUBY_METHOD_FUNC( wrapVoice ), 2 );
+  rb_define_method( cRubyClass, "voices", RUBY_METHOD_FUNC( wrapVoices ), 0 );
+  rb_define_method( cRubyClass, "max_voices", RUBY_METHOD_FUNC( wrapMaxVoices ), 0 );
+  return cRubyClass;
+}
+
+void AlsaMixer::deleteRubyObject( void *ptr )
+{
+  delete (AlsaMixerPtr *)ptr;
+}
+
+VALUE AlsaMixer::wrapNew( VALUE rbClass, VALUE rbOutput, VALUE rbMaxVoices )
+{
+  VALUE retVal = Qnil;
+  try {
+    ERRORMACRO(RTEST(rb_obj_is_kind_of(rbOutput, AlsaOutput::cRubyClass)), Error, ,
+               "Mixer requires an AlsaOutput object");
+    AlsaOutputPtr *output; Data_Get_Struct( rbOutput, AlsaOutputPtr, output );
+    AlsaMixerPtr ptr(new AlsaMixer(*output, NUM2INT(rbMaxVoices)));
+    retVal = Data_Wrap_Struct( rbClass, 0, deleteRubyObject, new AlsaMixerPtr( ptr ) );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE AlsaMixer::wrapClose( VALUE rbSelf )
+{
+  AlsaMixerPtr *self; Data_Get_Struct( rbSelf, AlsaMixerPtr, self );
+  (*self)->close();
+  return rbSelf;
+}
+
+VALUE AlsaMixer::wrapVoice( VALUE rbSelf, VALUE rbRingSize, VALUE rbGain )
+{
+  VALUE retVal = Qnil;
+  try {
+    AlsaMixerPtr *self; Data_Get_Struct( rbSelf, AlsaMixerPtr, self );
+    AlsaVoicePtr voice((*self)->addVoice(NUM2INT(rbRingSize), NUM2DBL(rbGain)));
+    retVal = Data_Wrap_Struct( AlsaVoice::cRubyClass, 0, AlsaVoice::deleteRubyObject,
+                               new AlsaVoicePtr( voice ) );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE AlsaMixer::wrapVoices( VALUE rbSelf )
+{
+  AlsaMixerPtr *self; Data_Get_Struct( rbSelf, AlsaMixerPtr, self );
+  return INT2NUM( (*self)->voices() );
+}
+
+VALUE AlsaMixer::wrapMaxVoices( VALUE rbSelf )
+{
+  AlsaMixerPtr *self; Data_Get_Struct( rbSelf, AlsaMixerPtr, self );
+  return INT2NUM( (*self)->maxVoices() );
+}
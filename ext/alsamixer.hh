@@ -0,0 +1,56 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef ALSAMIXER_HH
+#define ALSAMIXER_HH
+
+#include "alsaoutput.hh"
+#include "alsavoice.hh"
+#include "audiosource.hh"
+
+// Software mixer playing many voices on one AlsaOutput. Voices are kept in a
+// fixed array of slots which is updated with atomic operations so that neither
+// adding nor removing a voice requires a lock shared with the audio thread.
+// Removed voices are handed back through a second array and released by Ruby.
+class AlsaMixer: public AudioSource
+{
+public:
+  AlsaMixer(AlsaOutputPtr output, int maxVoices) throw (Error);
+  virtual ~AlsaMixer(void);
+  void close(void);
+  AlsaVoicePtr addVoice(int ringSize, float gain) throw (Error);
+  int voices(void);
+  int maxVoices(void);
+  virtual void render(char *data, int frames);
+  static VALUE cRubyClass;
+  static VALUE registerRubyClass( VALUE rbModule );
+  static void deleteRubyObject( void *ptr );
+  static VALUE wrapNew( VALUE rbClass, VALUE rbOutput, VALUE rbMaxVoices );
+  static VALUE wrapClose( VALUE rbSelf );
+  static VALUE wrapVoice( VALUE rbSelf, VALUE rbRingSize, VALUE rbGain );
+  static VALUE wrapVoices( VALUE rbSelf );
+  static VALUE wrapMaxVoices( VALUE rbSelf );
+protected:
+  void reclaim(void);
+  AlsaOutputPtr m_output;
+  int m_maxVoices;
+  boost::shared_array< boost::atomic<AlsaVoicePtr *> > m_slots;
+  boost::shared_array< boost::atomic<AlsaVoicePtr *> > m_retired;
+  boost::shared_array<float> m_mix;
+};
+
+typedef boost::shared_ptr< AlsaMixer > AlsaMixerPtr;
+
+#endif
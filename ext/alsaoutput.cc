@@ -20,50 +20,43 @@ using namespace std;
 VALUE AlsaOutput::cRubyClass = Qnil;
 
 AlsaOutput::AlsaOutput(const string &pcmName, unsigned int rate,
-                       unsigned int channels) throw (Error):
-  m_pcmHandle(NULL), m_pcmName(pcmName), m_rate(rate), m_channels(channels),
-  m_periodSize(1024), m_threadInitialised(false), m_start(0), m_count(0),
-  m_size(rate)
+                       unsigned int channels, SampleFormat format, bool mmap,
+                       unsigned int bufferTime, unsigned int periods,
+                       snd_pcm_uframes_t periodSize, int ringSize,
+                       OverflowPolicy policy) throw (Error):
+  m_pcmHandle(NULL), m_pcmName(pcmName),
+  m_config(pcmName, SND_PCM_STREAM_PLAYBACK, rate, channels, format, mmap, bufferTime,
+           periods, periodSize),
+  m_rate(rate), m_requestedRate(rate),
+  m_channels(channels),
+  m_format(format), m_frameSize(sampleSize(format) * channels), m_mmap(mmap),
+  m_periodSize(1024), m_bufferSize(0), m_periods(0), m_policy(policy),
+  m_threadInitialised(false),
+  m_running(false), m_quit(false), m_idle(false), m_cancel(false), m_source(NULL),
+  m_resampled(0)
 {
   try {
-    snd_pcm_hw_params_t *hwParams;
-    snd_pcm_hw_params_alloca(&hwParams);
-    int err = snd_pcm_open(&m_pcmHandle, m_pcmName.c_str(), SND_PCM_STREAM_PLAYBACK,
-                           SND_PCM_NONBLOCK);
-    ERRORMACRO(err >= 0, Error, , "Error opening PCM device \"" << m_pcmName
-               << "\": " << snd_strerror(err));
-    err = snd_pcm_hw_params_any(m_pcmHandle, hwParams);
-    ERRORMACRO(err >= 0, Error, , "Unable to configure the PCM device \""
-               << m_pcmName << "\": " << snd_strerror(err));
-    err = snd_pcm_hw_params_set_access(m_pcmHandle, hwParams,
-                                       SND_PCM_ACCESS_RW_INTERLEAVED);
-    ERRORMACRO(err >= 0, Error, , "Error setting PCM device \""
-               << m_pcmName << "\" to interlaced access: " << snd_strerror(err));
-    err = snd_pcm_hw_params_set_format(m_pcmHandle, hwParams, SND_PCM_FORMAT_S16_LE);
-    ERRORMACRO(err >= 0, Error, , "Error setting PCM device \"" << m_pcmName
-               << "\" to 16-bit signed integer format: " << snd_strerror(err));
-    err = snd_pcm_hw_params_set_rate_near( m_pcmHandle, hwParams, &m_rate, 0 );
-    ERRORMACRO(err >= 0, Error, , "Error setting sampling rate of PCM device \""
-               << m_pcmName << "\" to " << rate << " Hz: " << snd_strerror(err));
-    err = snd_pcm_hw_params_set_channels(m_pcmHandle, hwParams, channels);
-    ERRORMACRO(err >= 0, Error, , "Error setting number of channels of PCM device \""
-               << m_pcmName << "\" to " << channels << ": " << snd_strerror(err));
-    unsigned int bufferTime = 500000;
-    err = snd_pcm_hw_params_set_buffer_time_near(m_pcmHandle, hwParams, &bufferTime, NULL);
-    ERRORMACRO(err >= 0, Error, , "Error setting buffer time of PCM device \""
-               << m_pcmName << "\" to " << bufferTime << " us: " << snd_strerror(err));
-    unsigned int periods = 16;
-    err = snd_pcm_hw_params_set_periods_near(m_pcmHandle, hwParams, &periods, NULL);
-    ERRORMACRO(err >= 0, Error, , "Error setting periods of PCM device \""
-               << m_pcmName << "\" to " << periods << ": " << snd_strerror(err));
-    err = snd_pcm_hw_params( m_pcmHandle, hwParams );
-    ERRORMACRO( err >= 0, Error, , "Error setting parameters of PCM device \""
-                << m_pcmName << "\": " << snd_strerror( err ) );
-    err = snd_pcm_hw_params_get_period_size(hwParams, &m_periodSize, NULL);
-    ERRORMACRO( err >= 0, Error, , "Error getting period size of PCM device \""
-                << m_pcmName << "\": " << snd_strerror( err ) );
-    err = pthread_mutex_init(&m_mutex, NULL);
-    ERRORMACRO(err == 0, Error, , "Error initialising mutex: " << strerror(err));
+    ERRORMACRO(policy == OVERFLOW_BLOCK || policy == OVERFLOW_DROP_OLDEST ||
+               policy == OVERFLOW_SHORT, Error, , "Overflow policy \""
+               << overflowPolicyName(policy) << "\" is not supported for playback "
+               "(must be one of block, drop_oldest, or short)");
+    PCMHandle handle = PCMPool::acquire(m_config);
+    m_pcmHandle = handle.pcm;
+    m_rate = handle.rate;
+    m_periodSize = handle.periodSize;
+    m_bufferSize = handle.bufferSize;
+    m_periods = handle.periods;
+    if (ringSize <= 0) {
+      ringSize = m_rate;
+      if (ringSize < (int)(2 * m_bufferSize)) ringSize = 2 * m_bufferSize;
+    };
+    ERRORMACRO(ringSize >= (int)m_periodSize, Error, , "Ring buffer of " << ringSize
+               << " frames is smaller than a period of PCM device \"" << m_pcmName
+               << "\" (" << m_periodSize << " frames)");
+    m_ring = RingBufferPtr(new RingBuffer(ringSize, m_frameSize));
+    m_poll = DevicePollPtr(new DevicePoll(m_pcmHandle, m_pcmName));
+    m_watermark = WatermarkPtr(new Watermark(m_ring, true, m_periodSize));
+    m_wait = WatermarkPtr(new Watermark(m_ring, true, m_ring->size()));
   } catch (Error &e) {
     close();
     throw e;
@@ -78,74 +71,104 @@ AlsaOutput::~AlsaOutput(void)
 void AlsaOutput::close(void)
 {
   if (m_pcmHandle != NULL) {
-    drain();
-    pthread_mutex_destroy(&m_mutex);
-    snd_pcm_close( m_pcmHandle );
-    m_pcmHandle = NULL;
+    stopFile();
+    while (m_running && m_source == NULL && m_ring->count() > 0)
+      m_ring->waitWrite(m_ring->size());
+    if (m_source == NULL) {
+      flushResampler();
+      while (m_running && m_ring->count() > 0)
+        m_ring->waitWrite(m_ring->size());
+    };
+    stopThread();
+    m_poll.reset();
+    snd_pcm_drain(m_pcmHandle);
+    releaseDevice();
   };
 }
 
-void AlsaOutput::write(SequencePtr frame) throw (Error)
+int AlsaOutput::write(SequencePtr frame, SampleFormat format, bool block) throw (Error)
 {
   ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
              << "\" is not open. Did you call \"close\" before?");
-  int n = frame->size() / (2 * m_channels);
-  lock();
-  if (!m_data.get()) {
-    if (m_threadInitialised) pthread_join(m_thread, NULL);
-    while(m_size < n) m_size = 2 * m_size;
-    m_data = boost::shared_array<short int>(new short int[m_size * m_channels]);
-    m_start = 0;
-    m_count = 0;
-    pthread_create(&m_thread, NULL, staticThreadFunc, this);
-  };
-  if (m_count + n > m_size) {
-    int m_size_new = m_size;
-    while(m_size_new < m_count + n) m_size_new = 2 * m_size_new;
-    boost::shared_array<short int> data(new short int[m_size_new * m_channels]);
-    if (m_start + m_count > m_size) {
-      memcpy(data.get(), m_data.get() + m_start * m_channels, (m_size - m_start) * 2 * m_channels);
-      memcpy(data.get() + (m_size - m_start) * m_channels, m_data.get(), (m_start + m_count - m_size) * 2 * m_channels);
-    } else
-      memcpy(data.get(), m_data.get() + m_start * m_channels, m_count * 2 * m_channels);
-    m_data = data;
-    m_start = 0;
-    m_size = m_size_new;
+  ERRORMACRO(m_file.get() == NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is playing \"" << m_file->path() << "\"");
+  ERRORMACRO(m_source == NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is driven by a mixer");
+  int frameSize = sampleSize(format) * m_channels;
+  int n = frame->size() / frameSize;
+  char *data = frame->data();
+  int offset = 0;
+  while (offset < n) {
+    int m = n - offset;
+    char *region = m_ring->writeRegion(m);
+    if (m > 0) {
+      if (m_policy == OVERFLOW_DROP_OLDEST) m_ring->requestDiscard(0);
+      convertSamples(data + offset * frameSize, format, region, m_format, m * m_channels);
+      m_ring->commitWrite(m);
+      offset += m;
+    };
+    startThread();
+    if (m_idle) m_poll->wake();
+    if (m == 0) {
+      if (m_policy == OVERFLOW_SHORT || !block) break;
+      if (m_policy == OVERFLOW_DROP_OLDEST) {
+        m_ring->requestDiscard(min(n - offset, m_ring->size()));
+        m_poll->wake();
+      };
+      long long start = StreamStats::now();
+      waitWriteWithoutGVL(m_ring, n - offset, m_wait);
+      m_stats.blocked(StreamStats::now() - start);
+    };
   };
-  int offset = m_start + m_count;
-  if (offset >= m_size) offset -= m_size;
-  if (offset + n > m_size) {
-    memcpy(m_data.get() + offset * m_channels, frame->data(), (m_size - offset) * 2 * m_channels);
-    memcpy(m_data.get(), frame->data() + (m_size - offset) * 2 * m_channels, (n + offset - m_size) * 2 * m_channels);
-  } else
-    memcpy(m_data.get() + offset * m_channels, frame->data(), n * 2 * m_channels);
-  m_count += n;
-  unlock();
+  m_watermark->update();
+  return offset;
 }
 
 void AlsaOutput::drop(void) throw (Error)
 {
   ERRORMACRO( m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
               << "\" is not open. Did you call \"close\" before?" );
-  lock();
-  m_data.reset();
-  m_count = 0;
+  stopFile();
+  stopThread();
+  m_ring->flush();
+  if (m_resampler.get()) m_resampler->reset();
+  m_resampled = 0;
   snd_pcm_drop(m_pcmHandle);
-  unlock();
+  m_watermark->update();
+  if (m_source != NULL) startThread();
 }
 
 void AlsaOutput::drain(void) throw (Error)
 {
-  if (m_threadInitialised) {
-    pthread_join(m_thread, NULL);
-    m_threadInitialised = false;
-  }
   ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
              << "\" is not open. Did you call \"close\" before?");
-  snd_pcm_drain(m_pcmHandle);
+  if (m_file.get()) {
+    while (m_running && !m_file->finished())
+      waitWriteWithoutGVL(m_ring, m_ring->size(), m_wait);
+    stopFile();
+  };
+  while (m_running && m_ring->count() > 0)
+    waitWriteWithoutGVL(m_ring, m_ring->size(), m_wait);
+  flushResampler();
+  while (m_running && m_ring->count() > 0)
+    waitWriteWithoutGVL(m_ring, m_ring->size(), m_wait);
+  if (fiberScheduler()) {
+    // Let other fibers run while the device plays the remaining frames.
+    if (snd_pcm_drain(m_pcmHandle) == -EAGAIN)
+      while (snd_pcm_state(m_pcmHandle) == SND_PCM_STATE_DRAINING)
+        sleepFiber((double)m_periodSize / m_rate);
+  } else {
+    m_cancel = false;
+    callWithoutGVL(staticDrainDevice, this, staticCancelDrain, this);
+  };
 }
 
 unsigned int AlsaOutput::rate(void)
+{
+  return m_resampler.get() ? m_requestedRate : m_rate;
+}
+
+unsigned int AlsaOutput::deviceRate(void)
 {
   return m_rate;
 }
@@ -155,96 +178,486 @@ unsigned int AlsaOutput::channels(void)
   return m_channels;
 }
 
+snd_pcm_uframes_t AlsaOutput::periodSize(void)
+{
+  return m_periodSize;
+}
+
+snd_pcm_uframes_t AlsaOutput::bufferSize(void)
+{
+  return m_bufferSize;
+}
+
+unsigned int AlsaOutput::periods(void)
+{
+  return m_periods;
+}
+
+SampleFormat AlsaOutput::format(void)
+{
+  return m_format;
+}
+
+bool AlsaOutput::mmap(void)
+{
+  return m_mmap;
+}
+
+int AlsaOutput::ringSize(void)
+{
+  return m_ring->size();
+}
+
+OverflowPolicy AlsaOutput::policy(void)
+{
+  return m_policy;
+}
+
+void AlsaOutput::schedule(int priority, const vector<int> &cpus, bool lockMemory,
+                          bool fallback) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(!m_threadInitialised, Error, , "Scheduling of the audio thread for PCM "
+             "device \"" << m_pcmName << "\" must be configured before any audio "
+             "is transferred");
+  m_scheduling.configure(priority, cpus, lockMemory, fallback);
+  if (lockMemory) m_ring->prefault();
+}
+
+bool AlsaOutput::realtime(void)
+{
+  return m_scheduling.realtime();
+}
+
+bool AlsaOutput::memoryLocked(void)
+{
+  return m_scheduling.memoryLocked();
+}
+
+// Convert from the requested sampling rate to the one of the device if they
+// differ. The ring buffer then holds frames at the requested rate.
+bool AlsaOutput::resample(int taps) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(!m_threadInitialised, Error, , "Resampling for PCM device \""
+             << m_pcmName << "\" must be configured before any audio is transferred");
+  if (m_rate != m_requestedRate) {
+    m_resampler = ResamplerPtr(new Resampler(m_requestedRate, m_rate, m_channels, taps,
+                                             m_periodSize));
+    int frames = max(m_resampler->maxInput(m_periodSize), (int)m_periodSize);
+    m_resampleBuffer = boost::shared_array<float>(new float[frames * m_channels]);
+    m_period = boost::shared_array<char>(new char[m_periodSize * m_frameSize]);
+  };
+  return m_resampler.get() != NULL;
+}
+
+bool AlsaOutput::resampling(void)
+{
+  return m_resampler.get() != NULL;
+}
+
+VALUE AlsaOutput::stats(void)
+{
+  return m_stats.toHash();
+}
+
+// Let the audio thread take its data from the specified source instead of the
+// ring buffer filled by write. The caller has to detach the source before it is
+// destroyed.
+void AlsaOutput::attach(AudioSource *source) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(m_source == NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is already driven by a mixer");
+  stopThread();
+  m_ring->flush();
+  m_source = source;
+  startThread();
+}
+
+void AlsaOutput::detach(void)
+{
+  if (m_source != NULL) {
+    stopThread();
+    m_ring->flush();
+    m_source = NULL;
+  };
+}
+
+// Let the audio thread play a WAV or raw file which is mapped into memory. Frames
+// which were written before are discarded.
+void AlsaOutput::playFile(const string &path, SampleFormat rawFormat) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  ERRORMACRO(m_source == NULL || m_file.get() != NULL, Error, , "PCM device \""
+             << m_pcmName << "\" is driven by a mixer");
+  FileSourcePtr file(new FileSource(path, rawFormat, m_channels, rate(), m_format));
+  ERRORMACRO(file->channels() == m_channels, Error, , "File \"" << path << "\" has "
+             << file->channels() << " channel(s) but PCM device \"" << m_pcmName
+             << "\" has " << m_channels);
+  ERRORMACRO(file->rate() == rate(), Error, , "File \"" << path << "\" has a "
+             "sampling rate of " << file->rate() << " Hz but PCM device \""
+             << m_pcmName << "\" plays at " << rate() << " Hz");
+  stopFile();
+  if (m_resampler.get()) m_resampler->reset();
+  m_resampled = 0;
+  attach(file.get());
+  m_file = file;
+}
+
+void AlsaOutput::stopFile(void)
+{
+  if (m_file.get()) {
+    detach();
+    m_file.reset();
+    m_watermark->update();
+  };
+}
+
+bool AlsaOutput::playing(void)
+{
+  return m_file.get() != NULL && !m_file->finished();
+}
+
+long long AlsaOutput::filePosition(void)
+{
+  return m_file.get() ? m_file->position() : 0;
+}
+
+// Let the audio thread process each period with the specified chain before it is
+// written to the device. An empty pointer detaches the chain. The audio thread is
+// restarted if it was running.
+void AlsaOutput::setChain(DSPChainPtr chain) throw (Error)
+{
+  ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
+             << "\" is not open. Did you call \"close\" before?");
+  if (chain == m_chain) return;
+  if (chain.get()) {
+    ERRORMACRO(chain->inputChannels() == (int)m_channels &&
+               chain->outputChannels() == (int)m_channels, Error, , "Processing "
+               "chain converts " << chain->inputChannels() << " to "
+               << chain->outputChannels() << " channel(s) but PCM device \""
+               << m_pcmName << "\" has " << m_channels);
+    chain->prepare(m_periodSize, m_pcmName);
+  };
+  bool running = m_running;
+  stopThread();
+  if (m_chain.get()) m_chain->release();
+  m_chain = chain;
+  if (running) startThread();
+}
+
 int AlsaOutput::delay(void) throw (Error)
 {
   ERRORMACRO(m_pcmHandle != NULL, Error, , "PCM device \"" << m_pcmName
              << "\" is not open. Did you call \"close\" before?");
-  lock();
   snd_pcm_sframes_t frames;
   int err;
   while ((err = snd_pcm_delay(m_pcmHandle, &frames)) < 0) {
     err = snd_pcm_recover(m_pcmHandle, err, 1);
-    if (err < 0) {
-      unlock();
-      ERRORMACRO(false, Error, , "Error querying number of available frames for "
-                 "update of PCM device \"" << m_pcmName << "\": "
-                 << snd_strerror(err));
-    };
+    ERRORMACRO(err >= 0, Error, , "Error querying number of available frames for "
+               "update of PCM device \"" << m_pcmName << "\": "
+               << snd_strerror(err));
   };
-  frames += m_count;
-  unlock();
+  if (m_resampler.get()) frames = frames * m_requestedRate / m_rate;
+  frames += m_ring->count();
   return frames;
 }
 
-void AlsaOutput::lock(void)
+int AlsaOutput::watermark(void)
 {
-  pthread_mutex_lock( &m_mutex );
+  return m_watermark->level();
 }
 
-void AlsaOutput::unlock(void)
+void AlsaOutput::setWatermark(int frames) throw (Error)
 {
-  pthread_mutex_unlock( &m_mutex );
+  ERRORMACRO(frames > 0 && frames <= m_ring->size(), Error, , "Watermark of " << frames
+             << " frames is out of range (must be between 1 and " << m_ring->size()
+             << ")");
+  m_watermark->setLevel(frames);
 }
 
-void AlsaOutput::writei(short int *data, int count) throw (Error)
+int AlsaOutput::watermarkFd(void)
+{
+  return m_watermark->fd();
+}
+
+void AlsaOutput::writei(char *data, int count) throw (Error)
 {
   int err;
-  while ((err = snd_pcm_writei(m_pcmHandle, data, count)) < 0) {
-    if (err == -EBADFD)
-      err = snd_pcm_prepare(m_pcmHandle);
-    else
-      err = snd_pcm_recover(m_pcmHandle, err, 1);
-    ERRORMACRO(err >= 0, Error, , "Error writing audio frames to PCM device \""
-               << m_pcmName << "\": " << snd_strerror(err));
-  };
+  while ((err = snd_pcm_writei(m_pcmHandle, data, count)) < 0)
+    recover(err);
   ERRORMACRO(count == err, Error, , "Only managed to write " << err << " of " << count
              << " frames to PCM device \"" << m_pcmName << "\"");
 }
 
+void AlsaOutput::mmapWrite(char *data, int count) throw (Error)
+{
+  while (count > 0) {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcmHandle);
+    if (avail < 0) {
+      recover(avail);
+      continue;
+    };
+    if (avail == 0) {
+      m_poll->wait(1000);
+      if (m_quit) break;
+      continue;
+    };
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames = count;
+    int err = snd_pcm_mmap_begin(m_pcmHandle, &areas, &offset, &frames);
+    if (err < 0) {
+      recover(err);
+      continue;
+    };
+    char *area = (char *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+    memcpy(area, data, frames * m_frameSize);
+    snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_pcmHandle, offset, frames);
+    if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+      recover(committed >= 0 ? -EPIPE : committed);
+      continue;
+    };
+    if (snd_pcm_state(m_pcmHandle) == SND_PCM_STATE_PREPARED) {
+      err = snd_pcm_start(m_pcmHandle);
+      ERRORMACRO(err >= 0, Error, , "Error starting PCM device \"" << m_pcmName
+                 << "\": " << snd_strerror(err));
+    };
+    data += frames * m_frameSize;
+    count -= frames;
+  };
+}
+
+// Hand the device back to the pool which either keeps it or closes it.
+void AlsaOutput::releaseDevice(void)
+{
+  PCMHandle handle;
+  handle.pcm = m_pcmHandle;
+  handle.rate = m_rate;
+  handle.periodSize = m_periodSize;
+  handle.bufferSize = m_bufferSize;
+  handle.periods = m_periods;
+  PCMPool::release(m_config, handle);
+  m_pcmHandle = NULL;
+  if (m_chain.get()) {
+    m_chain->release();
+    m_chain.reset();
+  };
+}
+
+void AlsaOutput::recover(int err) throw (Error)
+{
+  if (err == -EPIPE) m_stats.xrun();
+  if (err == -EBADFD)
+    err = snd_pcm_prepare(m_pcmHandle);
+  else
+    err = snd_pcm_recover(m_pcmHandle, err, 1);
+  ERRORMACRO(err >= 0, Error, , "Error writing audio frames to PCM device \""
+             << m_pcmName << "\": " << snd_strerror(err));
+  m_stats.recovered();
+}
+
+// Take frames from the ring buffer and convert up to one period to the sampling
+// rate of the device.
+int AlsaOutput::resamplePeriod(void)
+{
+  float *buffer = m_resampleBuffer.get();
+  int needed = m_resampler->needed(m_periodSize);
+  while (needed > 0) {
+    int n = needed;
+    char *data = m_ring->readRegion(n);
+    if (n == 0) break;
+    convertSamples(data, m_format, (char *)buffer, SAMPLE_FLOAT, n * m_channels);
+    m_resampler->push(buffer, n);
+    m_ring->commitRead(n);
+    needed -= n;
+  };
+  int n = min(m_resampler->available(), (int)m_periodSize);
+  if (n > 0) {
+    m_resampler->pull(buffer, n);
+    convertSamples((const char *)buffer, SAMPLE_FLOAT, m_period.get(), m_format,
+                   n * m_channels);
+  };
+  return n;
+}
+
+// Append silence so that the last frames leave the resampling filter. Enough
+// silence is written so that the period still being processed by the audio thread
+// after the ring buffer is empty does not contain any of the caller's frames.
+void AlsaOutput::flushResampler(void)
+{
+  if (m_resampler.get() && m_running) {
+    int frames = m_resampler->maxInput(m_periodSize) + m_resampler->taps();
+    while (frames > 0) {
+      int n = frames;
+      char *region = m_ring->writeRegion(n);
+      if (n == 0) break;
+      memset(region, 0, n * m_frameSize);
+      m_ring->commitWrite(n);
+      frames -= n;
+    };
+    if (m_idle) m_poll->wake();
+  };
+}
+
+void AlsaOutput::startThread(void) throw (Error)
+{
+  if (!m_running.exchange(true)) {
+    if (m_threadInitialised) {
+      pthread_join(m_thread, NULL);
+      m_threadInitialised = false;
+    };
+    int err = m_scheduling.createThread(&m_thread, staticThreadFunc, this);
+    if (err != 0) {
+      m_running = false;
+      ERRORMACRO(false, Error, , "Error creating audio thread for PCM device \""
+                 << m_pcmName << "\": " << strerror(err));
+    };
+    m_threadInitialised = true;
+  };
+}
+
+void AlsaOutput::stopThread(void)
+{
+  m_quit = true;
+  if (m_poll.get()) m_poll->wake();
+  if (m_threadInitialised) {
+    pthread_join(m_thread, NULL);
+    m_threadInitialised = false;
+  };
+  m_quit = false;
+  m_running = false;
+}
+
 void AlsaOutput::threadFunc(void)
 {
-  bool quit = false;
-  while (!quit) {
-    snd_pcm_wait(m_pcmHandle, 1000);
-    try {
-      lock();
+  while (!m_quit) {
+    m_stats.dropped(m_ring->discardPending());
+    if (m_source != NULL && m_ring->count() == 0 && !m_source->finished()) {
       int n = m_periodSize;
-      if (n > m_count) n = m_count;
-      if (m_count <= 0) m_data.reset();
-      if (m_start >= m_size) m_start -= m_size;
-      if (m_data.get()) {
-        if (m_start + n > m_size) n = m_size - m_start;
-        writei(m_data.get() + m_start * m_channels, n);
-        m_start += n;
-        m_count -= n;
+      char *data = m_ring->writeRegion(n);
+      m_source->render(data, n);
+      if (m_source->finished()) {
+        // Leave the ring buffer empty so that drain sees the end of the source.
+        m_watermark->signal();
+        m_wait->signal();
       } else
-        quit = true;
-      unlock();
+        m_ring->commitWrite(n);
+    };
+    int n = m_periodSize;
+    char *data;
+    if (m_resampler.get()) {
+      if (m_resampled == 0) m_resampled = resamplePeriod();
+      n = m_resampled;
+      data = m_period.get();
+    } else
+      data = m_ring->readRegion(n);
+    if (n == 0) {
+      m_idle = true;
+      if (m_ring->count() == 0 && !m_quit) m_poll->waitWakeup(-1);
+      m_idle = false;
+      continue;
+    };
+    try {
+      if (!m_poll->wait(1000)) continue;
+      long long start = StreamStats::now();
+      if (m_chain.get()) m_chain->apply(data, m_format, n);
+      m_stats.fill(m_ring->count());
+      if (m_mmap)
+        mmapWrite(data, n);
+      else
+        writei(data, n);
+      if (m_resampler.get())
+        m_resampled = 0;
+      else
+        m_ring->commitRead(n);
+      m_stats.transferred(n);
+      m_stats.period(StreamStats::now() - start);
+      m_watermark->signal();
+      m_wait->signal();
     } catch (Error &e) {
-      quit = true;
-      m_data.reset();
-      unlock();
+      m_stats.error();
+      m_stats.dropped(m_ring->count());
+      m_ring->flush();
+      if (m_resampler.get()) m_resampler->reset();
+      m_resampled = 0;
+      m_watermark->signal();
+      m_wait->signal();
     }
   };
 }
 
+void AlsaOutput::drainDevice(void)
+{
+  int err = snd_pcm_drain(m_pcmHandle);
+  if (err == -EAGAIN) {
+    useconds_t periodTime = (useconds_t)(m_periodSize * 1000000LL / m_rate);
+    while (!m_cancel && snd_pcm_state(m_pcmHandle) == SND_PCM_STATE_DRAINING)
+      usleep(periodTime);
+  };
+}
+
+void AlsaOutput::cancelDrain(void)
+{
+  m_cancel = true;
+}
+
 void *AlsaOutput::staticThreadFunc( void *self )
 {
   ((AlsaOutput *)self)->threadFunc();
   return self;
 }
 
+void *AlsaOutput::staticDrainDevice( void *self )
+{
+  ((AlsaOutput *)self)->drainDevice();
+  return self;
+}
+
+void AlsaOutput::staticCancelDrain( void *self )
+{
+  ((AlsaOutput *)self)->cancelDrain();
+}
+
 VALUE AlsaOutput::registerRubyClass( VALUE rbModule )
 {
   cRubyClass = rb_define_class_under( rbModule, "AlsaOutput", rb_cObject );
-  rb_define_singleton_method(cRubyClass, "new", RUBY_METHOD_FUNC(wrapNew), 3);
+  rb_define_singleton_method(cRubyClass, "new", RUBY_METHOD_FUNC(wrapNew), 10);
   rb_define_method( cRubyClass, "close", RUBY_METHOD_FUNC( wrapClose ), 0 );
-  rb_define_method( cRubyClass, "write", RUBY_METHOD_FUNC( wrapWrite ), 1 );
+  rb_define_method( cRubyClass, "write", RUBY_METHOD_FUNC( wrapWrite ), 2 );
+  rb_define_method( cRubyClass, "write_nonblock", RUBY_METHOD_FUNC( wrapWriteNonblock ), 2 );
   rb_define_method( cRubyClass, "drop", RUBY_METHOD_FUNC( wrapDrop ), 0 );
   rb_define_method( cRubyClass, "drain", RUBY_METHOD_FUNC( wrapDrain ), 0 );
   rb_define_method( cRubyClass, "rate", RUBY_METHOD_FUNC( wrapRate ), 0 );
+  rb_define_method( cRubyClass, "device_rate", RUBY_METHOD_FUNC( wrapDeviceRate ), 0 );
   rb_define_method( cRubyClass, "channels", RUBY_METHOD_FUNC( wrapChannels ), 0 );
+  rb_define_method( cRubyClass, "format", RUBY_METHOD_FUNC( wrapFormat ), 0 );
+  rb_define_method( cRubyClass, "period_size", RUBY_METHOD_FUNC( wrapPeriodSize ), 0 );
+  rb_define_method( cRubyClass, "buffer_size", RUBY_METHOD_FUNC( wrapBufferSize ), 0 );
+  rb_define_method( cRubyClass, "periods", RUBY_METHOD_FUNC( wrapPeriods ), 0 );
+  rb_define_method( cRubyClass, "mmap?", RUBY_METHOD_FUNC( wrapMMap ), 0 );
+  rb_define_method( cRubyClass, "ring_size", RUBY_METHOD_FUNC( wrapRingSize ), 0 );
+  rb_define_method( cRubyClass, "overflow", RUBY_METHOD_FUNC( wrapPolicy ), 0 );
+  rb_define_method( cRubyClass, "schedule", RUBY_METHOD_FUNC( wrapSchedule ), 4 );
+  rb_define_method( cRubyClass, "realtime?", RUBY_METHOD_FUNC( wrapRealtime ), 0 );
+  rb_define_method( cRubyClass, "memory_locked?", RUBY_METHOD_FUNC( wrapMemoryLocked ), 0 );
+  rb_define_method( cRubyClass, "resample", RUBY_METHOD_FUNC( wrapResample ), 1 );
+  rb_define_method( cRubyClass, "resampling?", RUBY_METHOD_FUNC( wrapResampling ), 0 );
+  rb_define_method( cRubyClass, "stats", RUBY_METHOD_FUNC( wrapStats ), 0 );
   rb_define_method( cRubyClass, "delay", RUBY_METHOD_FUNC( wrapDelay ), 0 );
+  rb_define_method( cRubyClass, "watermark", RUBY_METHOD_FUNC( wrapWatermark ), 0 );
+  rb_define_method( cRubyClass, "watermark=", RUBY_METHOD_FUNC( wrapSetWatermark ), 1 );
+  rb_define_method( cRubyClass, "watermark_fd", RUBY_METHOD_FUNC( wrapWatermarkFd ), 0 );
+  rb_define_method( cRubyClass, "play_file", RUBY_METHOD_FUNC( wrapPlayFile ), 2 );
+  rb_define_method( cRubyClass, "stop_file", RUBY_METHOD_FUNC( wrapStopFile ), 0 );
+  rb_define_method( cRubyClass, "playing?", RUBY_METHOD_FUNC( wrapPlaying ), 0 );
+  rb_define_method( cRubyClass, "file_position", RUBY_METHOD_FUNC( wrapFilePosition ), 0 );
+  rb_define_method( cRubyClass, "chain=", RUBY_METHOD_FUNC( wrapSetChain ), 1 );
 }
 
 void AlsaOutput::deleteRubyObject( void *ptr )
@@ -252,13 +665,23 @@ void AlsaOutput::deleteRubyObject( void *ptr )
   delete (AlsaOutputPtr *)ptr;
 }
 
-VALUE AlsaOutput::wrapNew(VALUE rbClass, VALUE rbPCMName, VALUE rbRate, VALUE rbChannels)
+VALUE AlsaOutput::wrapNew(VALUE rbClass, VALUE rbPCMName, VALUE rbRate, VALUE rbChannels,
+                          VALUE rbFormat, VALUE rbMMap, VALUE rbBufferTime,
+                          VALUE rbPeriods, VALUE rbPeriodSize, VALUE rbRingSize,
+                          VALUE rbPolicy)
 {
   VALUE retVal = Qnil;
   try {
     rb_check_type( rbPCMName, T_STRING );
+    rb_check_type( rbFormat, T_STRING );
+    rb_check_type( rbPolicy, T_STRING );
     AlsaOutputPtr ptr(new AlsaOutput(StringValuePtr(rbPCMName),
-                                     NUM2UINT(rbRate), NUM2UINT(rbChannels)));
+                                     NUM2UINT(rbRate), NUM2UINT(rbChannels),
+                                     parseSampleFormat(StringValuePtr(rbFormat)),
+                                     RTEST(rbMMap), NUM2UINT(rbBufferTime),
+                                     NUM2UINT(rbPeriods), NUM2ULONG(rbPeriodSize),
+                                     NUM2INT(rbRingSize),
+                                     parseOverflowPolicy(StringValuePtr(rbPolicy))));
     retVal = Data_Wrap_Struct( rbClass, 0, deleteRubyObject,
                                new AlsaOutputPtr( ptr ) );
   } catch ( exception &e ) {
@@ -274,16 +697,35 @@ VALUE AlsaOutput::wrapClose( VALUE rbSelf )
   return rbSelf;
 }
 
-VALUE AlsaOutput::wrapWrite( VALUE rbSelf, VALUE rbSequence )
+VALUE AlsaOutput::wrapWrite( VALUE rbSelf, VALUE rbSequence, VALUE rbFormat )
 {
+  VALUE rbRetVal = Qnil;
+  int state = 0;
   try {
     AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
     SequencePtr sequence( new Sequence( rbSequence ) );
-    (*self)->write( sequence );
+    rbRetVal = INT2NUM((*self)->write(sequence, parseSampleFormat(StringValuePtr(rbFormat))));
+  } catch ( Interrupt &e ) {
+    state = e.state();
   } catch ( exception &e ) {
     rb_raise( rb_eRuntimeError, "%s", e.what() );
   };
-  return rbSequence;
+  if ( state != 0 ) rb_jump_tag( state );
+  return rbRetVal;
+}
+
+VALUE AlsaOutput::wrapWriteNonblock( VALUE rbSelf, VALUE rbSequence, VALUE rbFormat )
+{
+  VALUE rbRetVal = Qnil;
+  try {
+    AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+    SequencePtr sequence( new Sequence( rbSequence ) );
+    rbRetVal = INT2NUM((*self)->write(sequence, parseSampleFormat(StringValuePtr(rbFormat)),
+                                      false));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbRetVal;
 }
 
 VALUE AlsaOutput::wrapDrop( VALUE rbSelf )
@@ -299,12 +741,16 @@ VALUE AlsaOutput::wrapDrop( VALUE rbSelf )
 
 VALUE AlsaOutput::wrapDrain( VALUE rbSelf )
 {
+  int state = 0;
   try {
     AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
     (*self)->drain();
+  } catch ( Interrupt &e ) {
+    state = e.state();
   } catch ( exception &e ) {
     rb_raise( rb_eRuntimeError, "%s", e.what() );
   };
+  if ( state != 0 ) rb_jump_tag( state );
   return rbSelf;
 }
 
@@ -314,12 +760,112 @@ VALUE AlsaOutput::wrapRate( VALUE rbSelf )
   return UINT2NUM( (*self)->rate() );
 }
 
+VALUE AlsaOutput::wrapDeviceRate( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return UINT2NUM( (*self)->deviceRate() );
+}
+
 VALUE AlsaOutput::wrapChannels( VALUE rbSelf )
 {
   AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
   return UINT2NUM( (*self)->channels() );
 }
 
+VALUE AlsaOutput::wrapPeriodSize( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return ULONG2NUM( (*self)->periodSize() );
+}
+
+VALUE AlsaOutput::wrapBufferSize( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return ULONG2NUM( (*self)->bufferSize() );
+}
+
+VALUE AlsaOutput::wrapPeriods( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return UINT2NUM( (*self)->periods() );
+}
+
+VALUE AlsaOutput::wrapFormat( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return ID2SYM( rb_intern( sampleFormatName( (*self)->format() ) ) );
+}
+
+VALUE AlsaOutput::wrapMMap( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return (*self)->mmap() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaOutput::wrapRingSize( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return INT2NUM( (*self)->ringSize() );
+}
+
+VALUE AlsaOutput::wrapPolicy( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return ID2SYM( rb_intern( overflowPolicyName( (*self)->policy() ) ) );
+}
+
+VALUE AlsaOutput::wrapSchedule(VALUE rbSelf, VALUE rbPriority, VALUE rbCPUs,
+                               VALUE rbLockMemory, VALUE rbFallback)
+{
+  try {
+    AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+    rb_check_type( rbCPUs, T_ARRAY );
+    vector<int> cpus;
+    for (long i=0; i<RARRAY_LEN(rbCPUs); i++)
+      cpus.push_back(NUM2INT(rb_ary_entry(rbCPUs, i)));
+    (*self)->schedule(NUM2INT(rbPriority), cpus, RTEST(rbLockMemory), RTEST(rbFallback));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaOutput::wrapRealtime( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return (*self)->realtime() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaOutput::wrapMemoryLocked( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return (*self)->memoryLocked() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaOutput::wrapResample( VALUE rbSelf, VALUE rbTaps )
+{
+  VALUE rbRetVal = Qnil;
+  try {
+    AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+    rbRetVal = (*self)->resample(NUM2INT(rbTaps)) ? Qtrue : Qfalse;
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbRetVal;
+}
+
+VALUE AlsaOutput::wrapResampling( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return (*self)->resampling() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaOutput::wrapStats( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return (*self)->stats();
+}
+
 VALUE AlsaOutput::wrapDelay( VALUE rbSelf )
 {
   VALUE rbRetVal = Qnil;
@@ -331,3 +877,77 @@ VALUE AlsaOutput::wrapDelay( VALUE rbSelf )
   };
   return rbRetVal;
 }
+
+VALUE AlsaOutput::wrapWatermark( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return INT2NUM( (*self)->watermark() );
+}
+
+VALUE AlsaOutput::wrapSetWatermark( VALUE rbSelf, VALUE rbFrames )
+{
+  try {
+    AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+    (*self)->setWatermark( NUM2INT( rbFrames ) );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbFrames;
+}
+
+VALUE AlsaOutput::wrapWatermarkFd( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return INT2NUM( (*self)->watermarkFd() );
+}
+
+VALUE AlsaOutput::wrapPlayFile( VALUE rbSelf, VALUE rbPath, VALUE rbFormat )
+{
+  try {
+    AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+    rb_check_type( rbPath, T_STRING );
+    rb_check_type( rbFormat, T_STRING );
+    (*self)->playFile(StringValuePtr(rbPath),
+                      parseSampleFormat(StringValuePtr(rbFormat)));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbSelf;
+}
+
+VALUE AlsaOutput::wrapStopFile( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  (*self)->stopFile();
+  return rbSelf;
+}
+
+VALUE AlsaOutput::wrapPlaying( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return (*self)->playing() ? Qtrue : Qfalse;
+}
+
+VALUE AlsaOutput::wrapFilePosition( VALUE rbSelf )
+{
+  AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+  return LL2NUM((*self)->filePosition());
+}
+
+VALUE AlsaOutput::wrapSetChain( VALUE rbSelf, VALUE rbChain )
+{
+  try {
+    AlsaOutputPtr *self; Data_Get_Struct( rbSelf, AlsaOutputPtr, self );
+    DSPChainPtr chain;
+    if (rbChain != Qnil) {
+      if (!rb_obj_is_kind_of(rbChain, DSPChain::cRubyClass))
+        rb_raise(rb_eTypeError, "Expected DSPChain or nil");
+      DSPChainPtr *ptr; Data_Get_Struct( rbChain, DSPChainPtr, ptr );
+      chain = *ptr;
+    };
+    (*self)->setChain(chain);
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbChain;
+}
@@ -21,50 +21,147 @@
 #include "rubyinc.hh"
 #include "error.hh"
 #include "sequence.hh"
+#include "ringbuffer.hh"
+#include "gvl.hh"
+#include "convert.hh"
+#include "devicepoll.hh"
+#include "threadscheduling.hh"
+#include "streamstats.hh"
+#include "audiosource.hh"
+#include "resampler.hh"
+#include "pcmpool.hh"
+#include "watermark.hh"
+#include "filesource.hh"
+#include "dspchain.hh"
 
 class AlsaOutput
 {
 public:
   AlsaOutput(const std::string &pcmName = "default:0",
-             unsigned int rate = 48000, unsigned int channels = 2) throw (Error);
+             unsigned int rate = 48000, unsigned int channels = 2,
+             SampleFormat format = SAMPLE_S16, bool mmap = false,
+             unsigned int bufferTime = 500000, unsigned int periods = 16,
+             snd_pcm_uframes_t periodSize = 0, int ringSize = 0,
+             OverflowPolicy policy = OVERFLOW_BLOCK) throw (Error);
   virtual ~AlsaOutput(void);
   void close(void);
-  void write( SequencePtr sequence ) throw (Error);
+  int write( SequencePtr sequence, SampleFormat format = SAMPLE_S16,
+             bool block = true ) throw (Error);
   void drop(void) throw (Error);
   void drain(void) throw (Error);
   unsigned int rate(void);
+  unsigned int deviceRate(void);
   unsigned int channels(void);
+  snd_pcm_uframes_t periodSize(void);
+  snd_pcm_uframes_t bufferSize(void);
+  unsigned int periods(void);
+  SampleFormat format(void);
+  bool mmap(void);
+  int ringSize(void);
+  OverflowPolicy policy(void);
+  void schedule(int priority, const std::vector<int> &cpus, bool lockMemory,
+                bool fallback) throw (Error);
+  bool realtime(void);
+  bool memoryLocked(void);
+  bool resample(int taps) throw (Error);
+  bool resampling(void);
+  VALUE stats(void);
   int delay(void) throw (Error);
-  void lock(void);
-  void unlock(void);
+  int watermark(void);
+  void setWatermark(int frames) throw (Error);
+  int watermarkFd(void);
+  void attach(AudioSource *source) throw (Error);
+  void detach(void);
+  void playFile(const std::string &path, SampleFormat rawFormat) throw (Error);
+  void stopFile(void);
+  bool playing(void);
+  long long filePosition(void);
+  void setChain(DSPChainPtr chain) throw (Error);
   static VALUE cRubyClass;
   static VALUE registerRubyClass( VALUE rbModule );
   static void deleteRubyObject( void *ptr );
   static VALUE wrapNew(VALUE rbClass, VALUE rbPCMName, VALUE rbRate,
-                       VALUE rbChannels);
+                       VALUE rbChannels, VALUE rbFormat, VALUE rbMMap,
+                       VALUE rbBufferTime, VALUE rbPeriods, VALUE rbPeriodSize,
+                       VALUE rbRingSize, VALUE rbPolicy);
   static VALUE wrapClose( VALUE rbSelf );
-  static VALUE wrapWrite( VALUE rbSelf, VALUE rbSequence );
+  static VALUE wrapWrite( VALUE rbSelf, VALUE rbSequence, VALUE rbFormat );
+  static VALUE wrapWriteNonblock( VALUE rbSelf, VALUE rbSequence, VALUE rbFormat );
   static VALUE wrapDrop( VALUE rbSelf );
   static VALUE wrapDrain( VALUE rbSelf );
   static VALUE wrapRate( VALUE rbSelf );
+  static VALUE wrapDeviceRate( VALUE rbSelf );
   static VALUE wrapChannels( VALUE rbSelf );
+  static VALUE wrapPeriodSize( VALUE rbSelf );
+  static VALUE wrapBufferSize( VALUE rbSelf );
+  static VALUE wrapPeriods( VALUE rbSelf );
+  static VALUE wrapFormat( VALUE rbSelf );
+  static VALUE wrapMMap( VALUE rbSelf );
+  static VALUE wrapRingSize( VALUE rbSelf );
+  static VALUE wrapPolicy( VALUE rbSelf );
+  static VALUE wrapSchedule(VALUE rbSelf, VALUE rbPriority, VALUE rbCPUs,
+                            VALUE rbLockMemory, VALUE rbFallback);
+  static VALUE wrapRealtime( VALUE rbSelf );
+  static VALUE wrapMemoryLocked( VALUE rbSelf );
+  static VALUE wrapResample( VALUE rbSelf, VALUE rbTaps );
+  static VALUE wrapResampling( VALUE rbSelf );
+  static VALUE wrapStats( VALUE rbSelf );
   static VALUE wrapDelay( VALUE rbSelf );
+  static VALUE wrapWatermark( VALUE rbSelf );
+  static VALUE wrapSetWatermark( VALUE rbSelf, VALUE rbFrames );
+  static VALUE wrapWatermarkFd( VALUE rbSelf );
+  static VALUE wrapPlayFile( VALUE rbSelf, VALUE rbPath, VALUE rbFormat );
+  static VALUE wrapStopFile( VALUE rbSelf );
+  static VALUE wrapPlaying( VALUE rbSelf );
+  static VALUE wrapFilePosition( VALUE rbSelf );
+  static VALUE wrapSetChain( VALUE rbSelf, VALUE rbChain );
 protected:
-  void writei(short int *data, int count) throw (Error);
+  void writei(char *data, int count) throw (Error);
+  void mmapWrite(char *data, int count) throw (Error);
+  void recover(int err) throw (Error);
+  void releaseDevice(void);
+  int resamplePeriod(void);
+  void flushResampler(void);
+  void startThread(void) throw (Error);
+  void stopThread(void);
+  void drainDevice(void);
+  void cancelDrain(void);
   void threadFunc(void);
   static void *staticThreadFunc( void *self );
+  static void *staticDrainDevice( void *self );
+  static void staticCancelDrain( void *self );
   snd_pcm_t *m_pcmHandle;
   std::string m_pcmName;
+  PCMConfig m_config;
   unsigned int m_rate;
+  unsigned int m_requestedRate;
   unsigned int m_channels;
+  SampleFormat m_format;
+  int m_frameSize;
+  bool m_mmap;
   snd_pcm_uframes_t m_periodSize;
+  snd_pcm_uframes_t m_bufferSize;
+  unsigned int m_periods;
+  OverflowPolicy m_policy;
   bool m_threadInitialised;
-  boost::shared_array<short int> m_data;
-  int m_start;
-  int m_count;
-  int m_size;
+  boost::atomic<bool> m_running;
+  boost::atomic<bool> m_quit;
+  boost::atomic<bool> m_idle;
+  boost::atomic<bool> m_cancel;
+  RingBufferPtr m_ring;
+  DevicePollPtr m_poll;
+  WatermarkPtr m_watermark;
+  WatermarkPtr m_wait;
+  ThreadScheduling m_scheduling;
+  StreamStats m_stats;
+  AudioSource *m_source;
+  FileSourcePtr m_file;
+  DSPChainPtr m_chain;
+  ResamplerPtr m_resampler;
+  boost::shared_array<float> m_resampleBuffer;
+  boost::shared_array<char> m_period;
+  int m_resampled;
   pthread_t m_thread;
-  pthread_mutex_t m_mutex;
 };
 
 typedef boost::shared_ptr< AlsaOutput > AlsaOutputPtr;
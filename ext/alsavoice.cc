@@ -0,0 +1,211 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "alsavoice.hh"
+
+using namespace std;
+
+VALUE AlsaVoice::cRubyClass = Qnil;
+
+AlsaVoice::AlsaVoice(unsigned int channels, int ringSize, float gain) throw (Error):
+  m_channels(channels), m_gain(gain), m_closed(false), m_detached(false)
+{
+  m_ring = RingBufferPtr(new RingBuffer(ringSize, channels * sizeof(float)));
+}
+
+AlsaVoice::~AlsaVoice(void)
+{
+}
+
+// The mixer removes the voice as soon as it has played the remaining samples.
+void AlsaVoice::close(void)
+{
+  m_closed = true;
+}
+
+bool AlsaVoice::closed(void)
+{
+  return m_closed;
+}
+
+bool AlsaVoice::finished(void)
+{
+  return m_closed && m_ring->count() == 0;
+}
+
+// Called when the mixer stops playing the voice. Blocked writers are woken up.
+void AlsaVoice::detach(void)
+{
+  m_closed = true;
+  m_detached = true;
+  m_ring->interrupt();
+}
+
+int AlsaVoice::write(SequencePtr frame, SampleFormat format) throw (Error)
+{
+  ERRORMACRO(!m_closed, Error, , "Voice is closed. Did you call \"close\" before?");
+  int frameSize = sampleSize(format) * m_channels;
+  int n = frame->size() / frameSize;
+  char *data = frame->data();
+  int offset = 0;
+  while (offset < n) {
+    int m = n - offset;
+    char *region = m_ring->writeRegion(m);
+    if (m > 0) {
+      convertSamples(data + offset * frameSize, format, region, SAMPLE_FLOAT,
+                     m * m_channels);
+      m_ring->commitWrite(m);
+      offset += m;
+    } else {
+      ERRORMACRO(!m_detached, Error, , "Voice was removed from its mixer");
+      waitWriteWithoutGVL(m_ring, n - offset);
+    };
+  };
+  return offset;
+}
+
+void AlsaVoice::drain(void) throw (Error)
+{
+  while (!m_detached && m_ring->count() > 0)
+    waitWriteWithoutGVL(m_ring, m_ring->size());
+}
+
+unsigned int AlsaVoice::channels(void)
+{
+  return m_channels;
+}
+
+float AlsaVoice::gain(void)
+{
+  return m_gain;
+}
+
+void AlsaVoice::setGain(float gain)
+{
+  m_gain = gain;
+}
+
+int AlsaVoice::pending(void)
+{
+  return m_ring->count();
+}
+
+// Called by the audio thread of the mixer to add up to the specified number of
+// frames to the mix buffer. Missing samples are treated as silence.
+void AlsaVoice::mix(float *data, int frames)
+{
+  float gain = m_gain.load(boost::memory_order_relaxed);
+  int n = 0;
+  while (n < frames) {
+    int m = frames - n;
+    float *region = (float *)m_ring->readRegion(m);
+    if (m == 0) break;
+    mixSamples(region, data + n * m_channels, gain, m * m_channels);
+    m_ring->commitRead(m);
+    n += m;
+  };
+}
+
+VALUE AlsaVoice::registerRubyClass( VALUE rbModule )
+{
+  cRubyClass = rb_define_class_under( rbModule, "AlsaVoice", rb_cObject );
+  rb_undef_alloc_func( cRubyClass );
+  rb_define_method( cRubyClass, "close", RUBY_METHOD_FUNC( wrapClose ), 0 );
+  rb_define_method( cRubyClass, "write", RUBY_METHOD_FUNC( wrapWrite ), 2 );
+  rb_define_method( cRubyClass, "drain", RUBY_METHOD_FUNC( wrapDrain ), 0 );
+  rb_define_method( cRubyClass, "channels", RUBY_METHOD_FUNC( wrapChannels ), 0 );
+  rb_define_method( cRubyClass, "gain", RUBY_METHOD_FUNC( wrapGain ), 0 );
+  rb_define_method( cRubyClass, "gain=", RUBY_METHOD_FUNC( wrapSetGain ), 1 );
+  rb_define_method( cRubyClass, "pending", RUBY_METHOD_FUNC( wrapPending ), 0 );
+  rb_define_method( cRubyClass, "closed?", RUBY_METHOD_FUNC( wrapClosed ), 0 );
+  return cRubyClass;
+}
+
+// A voice which is garbage collected is closed so that the mixer can remove it.
+void AlsaVoice::deleteRubyObject( void *ptr )
+{
+  (*(AlsaVoicePtr *)ptr)->close();
+  delete (AlsaVoicePtr *)ptr;
+}
+
+VALUE AlsaVoice::wrapClose( VALUE rbSelf )
+{
+  AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+  (*self)->close();
+  return rbSelf;
+}
+
+VALUE AlsaVoice::wrapWrite( VALUE rbSelf, VALUE rbSequence, VALUE rbFormat )
+{
+  VALUE rbRetVal = Qnil;
+  int state = 0;
+  try {
+    AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+    SequencePtr sequence( new Sequence( rbSequence ) );
+    rbRetVal = INT2NUM((*self)->write(sequence, parseSampleFormat(StringValuePtr(rbFormat))));
+  } catch ( Interrupt &e ) {
+    state = e.state();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  if ( state != 0 ) rb_jump_tag( state );
+  return rbRetVal;
+}
+
+VALUE AlsaVoice::wrapDrain( VALUE rbSelf )
+{
+  int state = 0;
+  try {
+    AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+    (*self)->drain();
+  } catch ( Interrupt &e ) {
+    state = e.state();
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  if ( state != 0 ) rb_jump_tag( state );
+  return rbSelf;
+}
+
+VALUE AlsaVoice::wrapChannels( VALUE rbSelf )
+{
+  AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+  return UINT2NUM( (*self)->channels() );
+}
+
+VALUE AlsaVoice::wrapGain( VALUE rbSelf )
+{
+  AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+  return rb_float_new( (*self)->gain() );
+}
+
+VALUE AlsaVoice::wrapSetGain( VALUE rbSelf, VALUE rbGain )
+{
+  AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+  (*self)->setGain( NUM2DBL( rbGain ) );
+  return rbGain;
+}
+
+VALUE AlsaVoice::wrapPending( VALUE rbSelf )
+{
+  AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+  return INT2NUM( (*self)->pending() );
+}
+
+VALUE AlsaVoice::wrapClosed( VALUE rbSelf )
+{
+  AlsaVoicePtr *self; Data_Get_Struct( rbSelf, AlsaVoicePtr, self );
+  return (*self)->closed() ? Qtrue : Qfalse;
+}
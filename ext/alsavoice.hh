@@ -0,0 +1,66 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef ALSAVOICE_HH
+#define ALSAVOICE_HH
+
+#include <boost/atomic.hpp>
+#include "rubyinc.hh"
+#include "error.hh"
+#include "sequence.hh"
+#include "ringbuffer.hh"
+#include "gvl.hh"
+#include "convert.hh"
+
+// Logical playback stream of an AlsaMixer. Ruby writes samples into the ring
+// buffer of the voice and the audio thread of the mixer adds them to the mix.
+class AlsaVoice
+{
+public:
+  AlsaVoice(unsigned int channels, int ringSize, float gain) throw (Error);
+  virtual ~AlsaVoice(void);
+  void close(void);
+  bool closed(void);
+  bool finished(void);
+  void detach(void);
+  int write(SequencePtr sequence, SampleFormat format = SAMPLE_S16) throw (Error);
+  void drain(void) throw (Error);
+  unsigned int channels(void);
+  float gain(void);
+  void setGain(float gain);
+  int pending(void);
+  void mix(float *data, int frames);
+  static VALUE cRubyClass;
+  static VALUE registerRubyClass( VALUE rbModule );
+  static void deleteRubyObject( void *ptr );
+  static VALUE wrapClose( VALUE rbSelf );
+  static VALUE wrapWrite( VALUE rbSelf, VALUE rbSequence, VALUE rbFormat );
+  static VALUE wrapDrain( VALUE rbSelf );
+  static VALUE wrapChannels( VALUE rbSelf );
+  static VALUE wrapGain( VALUE rbSelf );
+  static VALUE wrapSetGain( VALUE rbSelf, VALUE rbGain );
+  static VALUE wrapPending( VALUE rbSelf );
+  static VALUE wrapClosed( VALUE rbSelf );
+protected:
+  unsigned int m_channels;
+  boost::atomic<float> m_gain;
+  boost::atomic<bool> m_closed;
+  boost::atomic<bool> m_detached;
+  RingBufferPtr m_ring;
+};
+
+typedef boost::shared_ptr< AlsaVoice > AlsaVoicePtr;
+
+#endif
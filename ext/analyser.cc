@@ -0,0 +1,252 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "analyser.hh"
+
+using namespace std;
+
+// Number of independent accumulators per channel. Keeping several partial results
+// lets the compiler vectorise the level loop without reordering floating point
+// operations.
+#define LANES 8
+
+// The hop count is published as two floats after the results so that it is read
+// together with them. Each half is exact in single precision.
+#define COUNT_BASE 65536.0f
+
+Analyser::Analyser(int channels, int fftSize, int hop, int maxFrames) throw (Error):
+  m_channels(channels), m_fftSize(fftSize), m_hop(hop), m_maxFrames(maxFrames),
+  m_scale(0.0f), m_lanes(LANES * channels), m_position(0), m_filled(0),
+  m_reset(false), m_blocks(0),
+  m_results((2 + fftSize / 2 + 1) * (channels > 0 ? channels : 1) + 2)
+{
+  ERRORMACRO(channels > 0, Error, , "Analyser must have at least one channel (was "
+             << channels << ")");
+  ERRORMACRO(fftSize >= 16 && fftSize <= 65536 && (fftSize & (fftSize - 1)) == 0,
+             Error, , "FFT size must be a power of two between 16 and 65536 (was "
+             << fftSize << ")");
+  ERRORMACRO(hop > 0 && hop <= fftSize, Error, , "Hop size must be between 1 and "
+             << fftSize << " (was " << hop << ")");
+  ERRORMACRO(maxFrames > 0, Error, , "Period size must be positive (was "
+             << maxFrames << ")");
+  int half = fftSize / 2;
+  m_bitReverse = boost::shared_array<int>(new int[half]);
+  int bits = 0;
+  while ((1 << bits) < half) bits++;
+  for (int i=0; i<half; i++) {
+    int r = 0;
+    for (int b=0; b<bits; b++)
+      if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+    m_bitReverse[i] = r;
+  };
+  m_cos = boost::shared_array<float>(new float[half / 2]);
+  m_sin = boost::shared_array<float>(new float[half / 2]);
+  for (int j=0; j<half / 2; j++) {
+    m_cos[j] = cos(2 * M_PI * j / half);
+    m_sin[j] = sin(2 * M_PI * j / half);
+  };
+  m_splitCos = boost::shared_array<float>(new float[half + 1]);
+  m_splitSin = boost::shared_array<float>(new float[half + 1]);
+  for (int k=0; k<=half; k++) {
+    m_splitCos[k] = cos(2 * M_PI * k / fftSize);
+    m_splitSin[k] = sin(2 * M_PI * k / fftSize);
+  };
+  m_window = boost::shared_array<float>(new float[fftSize]);
+  double sum = 0.0;
+  for (int n=0; n<fftSize; n++) {
+    m_window[n] = 0.5 - 0.5 * cos(2 * M_PI * n / fftSize);
+    sum += m_window[n];
+  };
+  // Scale the magnitudes so that a full-scale sine wave shows up as 1.
+  m_scale = 2.0 / sum;
+  m_samples = boost::shared_array<float>(new float[maxFrames * channels]);
+  m_history = boost::shared_array<float>(new float[fftSize * channels]);
+  m_real = boost::shared_array<float>(new float[half]);
+  m_imag = boost::shared_array<float>(new float[half]);
+  m_peak = boost::shared_array<float>(new float[m_lanes]);
+  m_sum = boost::shared_array<float>(new float[m_lanes]);
+  m_output = boost::shared_array<float>(new float[m_results.size()]);
+  m_cache = boost::shared_array<float>(new float[m_results.size()]);
+  for (int i=0; i<m_results.size(); i++)
+    m_cache[i] = 0.0f;
+  clear();
+}
+
+// Called by the audio thread for each period.
+void Analyser::analyse(const char *data, SampleFormat format, int frames)
+{
+  if (format == SAMPLE_FLOAT) {
+    analyse((const float *)data, frames);
+    return;
+  };
+  int frameSize = sampleSize(format) * m_channels;
+  for (int offset=0; offset<frames; offset+=m_maxFrames) {
+    int n = min(frames - offset, m_maxFrames);
+    convertSamples(data + offset * frameSize, format, (char *)m_samples.get(),
+                   SAMPLE_FLOAT, n * m_channels);
+    analyse(m_samples.get(), n);
+  };
+}
+
+void Analyser::analyse(const float *data, int frames)
+{
+  if (m_reset.exchange(false)) clear();
+  int mask = m_fftSize - 1;
+  int offset = 0;
+  while (offset < frames) {
+    int n = min(frames - offset, m_hop - m_filled);
+    const float *p = data + offset * m_channels;
+    levels(p, n);
+    for (int c=0; c<m_channels; c++) {
+      float *history = m_history.get() + c * m_fftSize;
+      for (int i=0; i<n; i++)
+        history[(m_position + i) & mask] = p[i * m_channels + c];
+    };
+    m_position = (m_position + n) & mask;
+    m_filled += n;
+    offset += n;
+    if (m_filled == m_hop) {
+      for (int c=0; c<m_channels; c++)
+        transform(c);
+      publish();
+      m_filled = 0;
+    };
+  };
+}
+
+// Copy the latest results. The arrays must hold channels, channels, and
+// bins * channels values. The spectrum is interleaved like the samples. Returns
+// the number of hops analysed so far.
+long long Analyser::latest(float *peak, float *rms, float *spectrum)
+{
+  m_results.update(m_cache.get());
+  const float *cache = m_cache.get();
+  memcpy(peak, cache, m_channels * sizeof(float));
+  memcpy(rms, cache + m_channels, m_channels * sizeof(float));
+  memcpy(spectrum, cache + 2 * m_channels, bins() * m_channels * sizeof(float));
+  const float *count = cache + m_results.size() - 2;
+  return (long long)count[1] * (long long)COUNT_BASE + (long long)count[0];
+}
+
+// Discard the analysed frames. The audio thread does this before processing the
+// next period.
+void Analyser::reset(void)
+{
+  m_reset = true;
+}
+
+void Analyser::clear(void)
+{
+  for (int i=0; i<m_fftSize * m_channels; i++)
+    m_history[i] = 0.0f;
+  for (int l=0; l<m_lanes; l++) {
+    m_peak[l] = 0.0f;
+    m_sum[l] = 0.0f;
+  };
+  m_position = 0;
+  m_filled = 0;
+}
+
+// Accumulate peak and energy. Lane l collects every m_lanes-th sample starting at
+// l, which always belongs to channel l modulo the number of channels.
+void Analyser::levels(const float *data, int frames)
+{
+  int n = frames * m_channels;
+  float *peak = m_peak.get();
+  float *sum = m_sum.get();
+  int i = 0;
+  for (; i + m_lanes <= n; i += m_lanes)
+    for (int l=0; l<m_lanes; l++) {
+      float x = data[i + l];
+      float a = fabsf(x);
+      peak[l] = peak[l] > a ? peak[l] : a;
+      sum[l] += x * x;
+    };
+  for (int l=0; i<n; i++, l++) {
+    float x = data[i];
+    peak[l] = max(peak[l], fabsf(x));
+    sum[l] += x * x;
+  };
+}
+
+// Windowed FFT of the last fftSize frames of one channel. The even and odd samples
+// form the real and imaginary part of a complex sequence of half the length. Its
+// spectrum is split into the spectrum of the real input afterwards.
+void Analyser::transform(int channel)
+{
+  int half = m_fftSize / 2;
+  int mask = m_fftSize - 1;
+  const float *history = m_history.get() + channel * m_fftSize;
+  const float *window = m_window.get();
+  float *re = m_real.get();
+  float *im = m_imag.get();
+  // The oldest frame is at the write position.
+  for (int n=0; n<half; n++) {
+    int r = m_bitReverse[n];
+    re[r] = history[(m_position + 2 * n) & mask] * window[2 * n];
+    im[r] = history[(m_position + 2 * n + 1) & mask] * window[2 * n + 1];
+  };
+  for (int len=2; len<=half; len<<=1) {
+    int h = len >> 1;
+    int step = half / len;
+    for (int i=0; i<half; i+=len)
+      for (int j=0; j<h; j++) {
+        float wr = m_cos[j * step], wi = -m_sin[j * step];
+        int p = i + j, q = p + h;
+        float tr = wr * re[q] - wi * im[q];
+        float ti = wr * im[q] + wi * re[q];
+        re[q] = re[p] - tr;
+        im[q] = im[p] - ti;
+        re[p] += tr;
+        im[p] += ti;
+      };
+  };
+  float *spectrum = m_output.get() + 2 * m_channels + channel;
+  for (int k=0; k<=half; k++) {
+    int a = k == half ? 0 : k, b = k == 0 ? 0 : half - k;
+    float er = 0.5f * (re[a] + re[b]), ei = 0.5f * (im[a] - im[b]);
+    float orr = 0.5f * (im[a] + im[b]), oi = -0.5f * (re[a] - re[b]);
+    float c = m_splitCos[k], s = m_splitSin[k];
+    float xr = er + c * orr + s * oi, xi = ei + c * oi - s * orr;
+    float scale = k == 0 || k == half ? 0.5f * m_scale : m_scale;
+    spectrum[k * m_channels] = sqrtf(xr * xr + xi * xi) * scale;
+  };
+}
+
+void Analyser::publish(void)
+{
+  float *output = m_output.get();
+  for (int c=0; c<m_channels; c++) {
+    float peak = 0.0f, sum = 0.0f;
+    for (int l=c; l<m_lanes; l+=m_channels) {
+      peak = max(peak, m_peak[l]);
+      sum += m_sum[l];
+    };
+    output[c] = peak;
+    output[m_channels + c] = sqrtf(sum / m_hop);
+  };
+  for (int l=0; l<m_lanes; l++) {
+    m_peak[l] = 0.0f;
+    m_sum[l] = 0.0f;
+  };
+  m_blocks++;
+  float *count = output + m_results.size() - 2;
+  count[0] = (float)(m_blocks % (long long)COUNT_BASE);
+  count[1] = (float)(m_blocks / (long long)COUNT_BASE);
+  m_results.set(output, m_results.size(), 0);
+}
@@ -0,0 +1,82 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef ANALYSER_HH
+#define ANALYSER_HH
+
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+#include "convert.hh"
+#include "dspstage.hh"
+
+// Level meter and spectrum analyser running in the audio thread of a capture
+// device. Every "hop" frames the analyser publishes the peak and RMS level of each
+// channel over the hop and the magnitude spectrum of the last fftSize frames
+// weighted with a Hann window. The results are published through sequence-locked
+// slots so that the audio thread never waits for Ruby. The FFT plan (bit reversal,
+// twiddle factors, and window) is computed once by the constructor. A real input
+// of fftSize samples is transformed with a complex FFT of half the size.
+class Analyser
+{
+public:
+  Analyser(int channels, int fftSize, int hop, int maxFrames) throw (Error);
+  int channels(void) { return m_channels; }
+  int fftSize(void) { return m_fftSize; }
+  int hop(void) { return m_hop; }
+  int bins(void) { return m_fftSize / 2 + 1; }
+  void analyse(const char *data, SampleFormat format, int frames);
+  void analyse(const float *data, int frames);
+  long long latest(float *peak, float *rms, float *spectrum);
+  void reset(void);
+protected:
+  void clear(void);
+  void levels(const float *data, int frames);
+  void transform(int channel);
+  void publish(void);
+  int m_channels;
+  int m_fftSize;
+  int m_hop;
+  int m_maxFrames;
+  // Plan of the FFT.
+  boost::shared_array<int> m_bitReverse;
+  boost::shared_array<float> m_cos;
+  boost::shared_array<float> m_sin;
+  boost::shared_array<float> m_splitCos;
+  boost::shared_array<float> m_splitSin;
+  boost::shared_array<float> m_window;
+  float m_scale;
+  // State of the audio thread.
+  boost::shared_array<float> m_samples;
+  boost::shared_array<float> m_history;
+  boost::shared_array<float> m_real;
+  boost::shared_array<float> m_imag;
+  boost::shared_array<float> m_peak;
+  boost::shared_array<float> m_sum;
+  int m_lanes;
+  boost::shared_array<float> m_output;
+  int m_position;
+  int m_filled;
+  boost::atomic<bool> m_reset;
+  long long m_blocks;
+  // Results read by Ruby.
+  ParameterSlots m_results;
+  boost::shared_array<float> m_cache;
+};
+
+typedef boost::shared_ptr< Analyser > AnalyserPtr;
+
+#endif
@@ -0,0 +1,30 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef AUDIOSOURCE_HH
+#define AUDIOSOURCE_HH
+
+// Producer of audio frames which can be attached to an AlsaOutput. The audio
+// thread of the output calls render whenever it needs the next period until the
+// source reports that it has finished.
+class AudioSource
+{
+public:
+  virtual ~AudioSource(void) {}
+  virtual void render(char *data, int frames) = 0;
+  virtual bool finished(void) { return false; }
+};
+
+#endif
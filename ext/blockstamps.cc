@@ -0,0 +1,67 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "blockstamps.hh"
+
+BlockStamps::BlockStamps(int blocks) throw (Error):
+  m_mask(0), m_head(0), m_tail(0)
+{
+  ERRORMACRO(blocks > 0 && blocks <= 0x40000000, Error, , "Number of " << blocks
+             << " timestamps is out of range");
+  unsigned int size = 1;
+  while (size < (unsigned int)blocks) size = 2 * size;
+  m_mask = size - 1;
+  m_stamps = boost::shared_array<Stamp>(new Stamp[size]);
+}
+
+BlockStamps::~BlockStamps(void)
+{
+}
+
+void BlockStamps::record(unsigned int position, int frames, long long frame,
+                         long long time)
+{
+  unsigned int head = m_head.load(boost::memory_order_relaxed);
+  Stamp &stamp = m_stamps[head & m_mask];
+  stamp.position = position;
+  stamp.frames = frames;
+  stamp.frame = frame;
+  stamp.time = time;
+  m_head.store(head + 1, boost::memory_order_release);
+}
+
+bool BlockStamps::lookup(unsigned int position, unsigned int rate, long long &frame,
+                         long long &time)
+{
+  unsigned int head = m_head.load(boost::memory_order_acquire);
+  if (head - m_tail > m_mask + 1) m_tail = head - (m_mask + 1);
+  while (m_tail != head) {
+    Stamp &stamp = m_stamps[m_tail & m_mask];
+    int offset = (int)(position - stamp.position);
+    if (offset < 0) return false;
+    if (offset < stamp.frames) {
+      frame = stamp.frame + offset;
+      time = stamp.time + offset * 1000000000LL / rate;
+      return true;
+    };
+    m_tail++;
+  };
+  return false;
+}
+
+void BlockStamps::reset(void)
+{
+  m_tail = m_head.load();
+}
@@ -0,0 +1,51 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef BLOCKSTAMPS_HH
+#define BLOCKSTAMPS_HH
+
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+
+// Timestamps of the blocks in a capture ring buffer. The audio thread records the
+// ring position, frame index, and time of the first frame of every block it
+// commits. The reader looks up the block containing a ring position and
+// interpolates within the block so that no system call is required.
+class BlockStamps
+{
+public:
+  BlockStamps(int blocks) throw (Error);
+  virtual ~BlockStamps(void);
+  void record(unsigned int position, int frames, long long frame, long long time);
+  bool lookup(unsigned int position, unsigned int rate, long long &frame,
+              long long &time);
+  void reset(void);
+protected:
+  struct Stamp {
+    unsigned int position;
+    int frames;
+    long long frame;
+    long long time;
+  };
+  boost::shared_array<Stamp> m_stamps;
+  unsigned int m_mask;
+  boost::atomic<unsigned int> m_head;
+  unsigned int m_tail;
+};
+
+typedef boost::shared_ptr< BlockStamps > BlockStampsPtr;
+
+#endif
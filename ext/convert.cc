@@ -0,0 +1,420 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_DISPATCH
+#endif
+#include "convert.hh"
+
+using namespace std;
+
+#define S32_MAX_FLOAT 2147483520.0f
+
+SampleFormat parseSampleFormat(const string &name) throw (Error)
+{
+  if (name == "s16") return SAMPLE_S16;
+  if (name == "s24") return SAMPLE_S24;
+  if (name == "s32") return SAMPLE_S32;
+  if (name == "float") return SAMPLE_FLOAT;
+  ERRORMACRO(false, Error, , "Unsupported sample format \"" << name
+             << "\" (must be one of s16, s24, s32, or float)");
+  return SAMPLE_S16;
+}
+
+const char *sampleFormatName(SampleFormat format)
+{
+  switch (format) {
+  case SAMPLE_S24:
+    return "s24";
+  case SAMPLE_S32:
+    return "s32";
+  case SAMPLE_FLOAT:
+    return "float";
+  default:
+    return "s16";
+  };
+}
+
+const char *sampleFormatDescription(SampleFormat format)
+{
+  switch (format) {
+  case SAMPLE_S24:
+    return "24-bit signed integer";
+  case SAMPLE_S32:
+    return "32-bit signed integer";
+  case SAMPLE_FLOAT:
+    return "32-bit floating point";
+  default:
+    return "16-bit signed integer";
+  };
+}
+
+snd_pcm_format_t alsaFormat(SampleFormat format)
+{
+  switch (format) {
+  case SAMPLE_S24:
+    return SND_PCM_FORMAT_S24;
+  case SAMPLE_S32:
+    return SND_PCM_FORMAT_S32;
+  case SAMPLE_FLOAT:
+    return SND_PCM_FORMAT_FLOAT;
+  default:
+    return SND_PCM_FORMAT_S16;
+  };
+}
+
+int sampleSize(SampleFormat format)
+{
+  return format == SAMPLE_S16 ? 2 : 4;
+}
+
+static int sampleBits(SampleFormat format)
+{
+  switch (format) {
+  case SAMPLE_S16:
+    return 16;
+  case SAMPLE_S24:
+    return 24;
+  default:
+    return 32;
+  };
+}
+
+static inline int32_t roundClip(float x, float scale, float lo, float hi)
+{
+  float y = x * scale;
+  y = y > lo ? y : lo;
+  y = y < hi ? y : hi;
+  return (int32_t)lrintf(y);
+}
+
+#ifdef HAVE_AVX2_DISPATCH
+static bool haveAVX2(void)
+{
+  static int result = -1;
+  if (result < 0) {
+    __builtin_cpu_init();
+    result = __builtin_cpu_supports("avx2") ? 1 : 0;
+  };
+  return result != 0;
+}
+
+__attribute__((target("avx2")))
+static int floatToS16AVX2(const float *source, int16_t *dest, int samples)
+{
+  const __m256 scale = _mm256_set1_ps(32768.0f);
+  const __m256 lo = _mm256_set1_ps(-32768.0f);
+  const __m256 hi = _mm256_set1_ps(32767.0f);
+  int i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(source + i), scale);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(source + i + 8), scale);
+    a = _mm256_min_ps(_mm256_max_ps(a, lo), hi);
+    b = _mm256_min_ps(_mm256_max_ps(b, lo), hi);
+    __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_permute4x64_epi64(packed, 0xD8));
+  };
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int floatToInt32AVX2(const float *source, int32_t *dest, int samples,
+                            float scale, float lo, float hi)
+{
+  const __m256 s = _mm256_set1_ps(scale);
+  const __m256 l = _mm256_set1_ps(lo);
+  const __m256 h = _mm256_set1_ps(hi);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(source + i), s);
+    a = _mm256_min_ps(_mm256_max_ps(a, l), h);
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_cvtps_epi32(a));
+  };
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int s16ToFloatAVX2(const int16_t *source, float *dest, int samples)
+{
+  const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(source + i)));
+    _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+  };
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int int32ToFloatAVX2(const int32_t *source, float *dest, int samples,
+                            float scale, int shift)
+{
+  const __m256 s = _mm256_set1_ps(scale);
+  const __m128i n = _mm_cvtsi32_si128(shift);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(source + i));
+    x = _mm256_sra_epi32(_mm256_sll_epi32(x, n), n);
+    _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), s));
+  };
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int mixAVX2(const float *source, float *dest, float gain, int samples)
+{
+  const __m256 g = _mm256_set1_ps(gain);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(source + i), g);
+    _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_loadu_ps(dest + i), a));
+  };
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int dotAVX2(const float *a, const float *b, int n, float &sum)
+{
+  __m256 acc = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                           _mm256_loadu_ps(b + i)));
+  __m128 x = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+  x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+  sum += _mm_cvtss_f32(x);
+  return i;
+}
+#endif
+
+#ifdef __SSE2__
+static int floatToS16SSE2(const float *source, int16_t *dest, int samples)
+{
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  const __m128 lo = _mm_set1_ps(-32768.0f);
+  const __m128 hi = _mm_set1_ps(32767.0f);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(source + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(source + i + 4), scale);
+    a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+    b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+    _mm_storeu_si128((__m128i *)(dest + i),
+                     _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+  };
+  return i;
+}
+
+static int floatToInt32SSE2(const float *source, int32_t *dest, int samples,
+                            float scale, float lo, float hi)
+{
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128 l = _mm_set1_ps(lo);
+  const __m128 h = _mm_set1_ps(hi);
+  int i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(source + i), s);
+    a = _mm_min_ps(_mm_max_ps(a, l), h);
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_cvtps_epi32(a));
+  };
+  return i;
+}
+
+static int s16ToFloatSSE2(const int16_t *source, float *dest, int samples)
+{
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(source + i));
+    __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+    _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+  };
+  return i;
+}
+
+static int int32ToFloatSSE2(const int32_t *source, float *dest, int samples,
+                            float scale, int shift)
+{
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128i n = _mm_cvtsi32_si128(shift);
+  int i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(source + i));
+    x = _mm_sra_epi32(_mm_sll_epi32(x, n), n);
+    _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(x), s));
+  };
+  return i;
+}
+
+static int mixSSE2(const float *source, float *dest, float gain, int samples)
+{
+  const __m128 g = _mm_set1_ps(gain);
+  int i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(source + i), g);
+    _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), a));
+  };
+  return i;
+}
+
+static int dotSSE2(const float *a, const float *b, int n, float &sum)
+{
+  __m128 acc = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+  sum += _mm_cvtss_f32(acc);
+  return i;
+}
+#endif
+
+static void floatToS16(const float *source, int16_t *dest, int samples)
+{
+  int i = 0;
+#ifdef HAVE_AVX2_DISPATCH
+  if (haveAVX2()) i = floatToS16AVX2(source, dest, samples);
+#endif
+#ifdef __SSE2__
+  i += floatToS16SSE2(source + i, dest + i, samples - i);
+#endif
+  for (; i < samples; i++)
+    dest[i] = (int16_t)roundClip(source[i], 32768.0f, -32768.0f, 32767.0f);
+}
+
+static void floatToInt32(const float *source, int32_t *dest, int samples,
+                         float scale, float lo, float hi)
+{
+  int i = 0;
+#ifdef HAVE_AVX2_DISPATCH
+  if (haveAVX2()) i = floatToInt32AVX2(source, dest, samples, scale, lo, hi);
+#endif
+#ifdef __SSE2__
+  i += floatToInt32SSE2(source + i, dest + i, samples - i, scale, lo, hi);
+#endif
+  for (; i < samples; i++)
+    dest[i] = roundClip(source[i], scale, lo, hi);
+}
+
+static void s16ToFloat(const int16_t *source, float *dest, int samples)
+{
+  int i = 0;
+#ifdef HAVE_AVX2_DISPATCH
+  if (haveAVX2()) i = s16ToFloatAVX2(source, dest, samples);
+#endif
+#ifdef __SSE2__
+  i += s16ToFloatSSE2(source + i, dest + i, samples - i);
+#endif
+  for (; i < samples; i++)
+    dest[i] = source[i] * (1.0f / 32768.0f);
+}
+
+static void int32ToFloat(const int32_t *source, float *dest, int samples,
+                         float scale, int shift)
+{
+  int i = 0;
+#ifdef HAVE_AVX2_DISPATCH
+  if (haveAVX2()) i = int32ToFloatAVX2(source, dest, samples, scale, shift);
+#endif
+#ifdef __SSE2__
+  i += int32ToFloatSSE2(source + i, dest + i, samples - i, scale, shift);
+#endif
+  for (; i < samples; i++)
+    dest[i] = ((int32_t)((uint32_t)source[i] << shift) >> shift) * scale;
+}
+
+template< typename S, typename D >
+static void shiftSamples(const S *source, D *dest, int samples, int left, int right)
+{
+  for (int i = 0; i < samples; i++)
+    dest[i] = (D)((int32_t)((uint32_t)(int32_t)source[i] << left) >> right);
+}
+
+void convertSamples(const char *source, SampleFormat sourceFormat, char *dest,
+                    SampleFormat destFormat, int samples)
+{
+  if (sourceFormat == destFormat)
+    memcpy(dest, source, samples * sampleSize(sourceFormat));
+  else if (destFormat == SAMPLE_FLOAT) {
+    if (sourceFormat == SAMPLE_S16)
+      s16ToFloat((const int16_t *)source, (float *)dest, samples);
+    else if (sourceFormat == SAMPLE_S24)
+      int32ToFloat((const int32_t *)source, (float *)dest, samples,
+                   1.0f / 8388608.0f, 8);
+    else
+      int32ToFloat((const int32_t *)source, (float *)dest, samples,
+                   1.0f / 2147483648.0f, 0);
+  } else if (sourceFormat == SAMPLE_FLOAT) {
+    if (destFormat == SAMPLE_S16)
+      floatToS16((const float *)source, (int16_t *)dest, samples);
+    else if (destFormat == SAMPLE_S24)
+      floatToInt32((const float *)source, (int32_t *)dest, samples,
+                   8388608.0f, -8388608.0f, 8388607.0f);
+    else
+      floatToInt32((const float *)source, (int32_t *)dest, samples,
+                   2147483648.0f, -2147483648.0f, S32_MAX_FLOAT);
+  } else {
+    int left = 32 - sampleBits(sourceFormat);
+    int right = 32 - sampleBits(destFormat);
+    if (sourceFormat == SAMPLE_S16)
+      shiftSamples((const int16_t *)source, (int32_t *)dest, samples, left, right);
+    else if (destFormat == SAMPLE_S16)
+      shiftSamples((const int32_t *)source, (int16_t *)dest, samples, left, right);
+    else
+      shiftSamples((const int32_t *)source, (int32_t *)dest, samples, left, right);
+  };
+}
+
+// Add samples scaled by a gain to a floating point mix buffer. The sum is clipped
+// when it is converted to the sample format of the device.
+void mixSamples(const float *source, float *dest, float gain, int samples)
+{
+  int i = 0;
+#ifdef HAVE_AVX2_DISPATCH
+  if (haveAVX2()) i = mixAVX2(source, dest, gain, samples);
+#endif
+#ifdef __SSE2__
+  i += mixSSE2(source + i, dest + i, gain, samples - i);
+#endif
+  for (; i < samples; i++)
+    dest[i] += source[i] * gain;
+}
+
+// Dot product of two vectors of floating point numbers (used by the resampler).
+float dotProduct(const float *a, const float *b, int n)
+{
+  float sum = 0.0f;
+  int i = 0;
+#ifdef HAVE_AVX2_DISPATCH
+  if (haveAVX2()) i = dotAVX2(a, b, n, sum);
+#endif
+#ifdef __SSE2__
+  i += dotSSE2(a + i, b + i, n - i, sum);
+#endif
+  for (; i < n; i++)
+    sum += a[i] * b[i];
+  return sum;
+}
@@ -0,0 +1,41 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef CONVERT_HH
+#define CONVERT_HH
+
+#include <alsa/asoundlib.h>
+#include <string>
+#include "error.hh"
+
+enum SampleFormat
+{
+  SAMPLE_S16,
+  SAMPLE_S24,
+  SAMPLE_S32,
+  SAMPLE_FLOAT
+};
+
+SampleFormat parseSampleFormat(const std::string &name) throw (Error);
+const char *sampleFormatName(SampleFormat format);
+const char *sampleFormatDescription(SampleFormat format);
+snd_pcm_format_t alsaFormat(SampleFormat format);
+int sampleSize(SampleFormat format);
+void convertSamples(const char *source, SampleFormat sourceFormat, char *dest,
+                    SampleFormat destFormat, int samples);
+void mixSamples(const float *source, float *dest, float gain, int samples);
+float dotProduct(const float *a, const float *b, int n);
+
+#endif
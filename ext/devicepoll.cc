@@ -0,0 +1,142 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include "devicepoll.hh"
+
+using namespace std;
+
+DevicePoll::DevicePoll(snd_pcm_t *pcmHandle, const string &pcmName) throw (Error):
+  m_pcmHandles(1, pcmHandle), m_pcmName(pcmName), m_eventFd(-1)
+{
+  init();
+}
+
+DevicePoll::DevicePoll(const vector<snd_pcm_t *> &pcmHandles,
+                       const string &pcmName) throw (Error):
+  m_pcmHandles(pcmHandles), m_pcmName(pcmName), m_eventFd(-1)
+{
+  init();
+}
+
+DevicePoll::~DevicePoll(void)
+{
+  if (m_eventFd >= 0) ::close(m_eventFd);
+}
+
+void DevicePoll::init(void) throw (Error)
+{
+  int total = 0;
+  m_offsets.push_back(0);
+  for (unsigned int i=0; i<m_pcmHandles.size(); i++) {
+    int count = snd_pcm_poll_descriptors_count(m_pcmHandles[i]);
+    ERRORMACRO(count > 0, Error, , "Error getting poll descriptors of PCM device \""
+               << m_pcmName << "\": " << snd_strerror(count));
+    total += count;
+    m_offsets.push_back(total);
+  };
+  m_ready.resize(m_pcmHandles.size(), false);
+  m_enabled.resize(m_pcmHandles.size(), true);
+  m_fds = boost::shared_array<struct pollfd>(new struct pollfd[total + 1]);
+  for (unsigned int i=0; i<m_pcmHandles.size(); i++) {
+    int count = m_offsets[i + 1] - m_offsets[i];
+    int err = snd_pcm_poll_descriptors(m_pcmHandles[i], m_fds.get() + m_offsets[i],
+                                       count);
+    ERRORMACRO(err == count, Error, , "Error getting poll descriptors of PCM device \""
+               << m_pcmName << "\": " << snd_strerror(err));
+  };
+  m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ERRORMACRO(m_eventFd >= 0, Error, , "Error creating wakeup descriptor for PCM device \""
+             << m_pcmName << "\": " << strerror(errno));
+  m_fds[total].fd = m_eventFd;
+  m_fds[total].events = POLLIN;
+}
+
+bool DevicePoll::wait(int timeout) throw (Error)
+{
+  int total = m_offsets.back();
+  for (int i=0; i<=total; i++)
+    m_fds[i].revents = 0;
+  for (unsigned int i=0; i<m_ready.size(); i++)
+    m_ready[i] = false;
+  int err = poll(m_fds.get(), total + 1, timeout);
+  if (err < 0) {
+    ERRORMACRO(errno == EINTR, Error, , "Error waiting for PCM device \"" << m_pcmName
+               << "\": " << strerror(errno));
+    return false;
+  };
+  if (m_fds[total].revents & POLLIN) {
+    clearWakeup();
+    return false;
+  };
+  if (err == 0) return false;
+  bool result = false;
+  for (unsigned int i=0; i<m_pcmHandles.size(); i++) {
+    if (!m_enabled[i]) continue;
+    unsigned short revents;
+    err = snd_pcm_poll_descriptors_revents(m_pcmHandles[i], m_fds.get() + m_offsets[i],
+                                           m_offsets[i + 1] - m_offsets[i], &revents);
+    ERRORMACRO(err >= 0, Error, , "Error waiting for PCM device \"" << m_pcmName
+               << "\": " << snd_strerror(err));
+    m_ready[i] = (revents & (POLLIN | POLLOUT | POLLERR)) != 0;
+    result = result || m_ready[i];
+  };
+  return result;
+}
+
+// Stop polling a device, e.g. after it failed. Otherwise a device which reports
+// POLLERR permanently would let every wait return at once. poll ignores negative
+// descriptors so the original ones are kept as their complement.
+void DevicePoll::disable(int index)
+{
+  if (m_enabled[index]) {
+    for (int i=m_offsets[index]; i<m_offsets[index + 1]; i++)
+      m_fds[i].fd = ~m_fds[i].fd;
+    m_enabled[index] = false;
+  };
+}
+
+void DevicePoll::enable(int index)
+{
+  if (!m_enabled[index]) {
+    for (int i=m_offsets[index]; i<m_offsets[index + 1]; i++)
+      m_fds[i].fd = ~m_fds[i].fd;
+    m_enabled[index] = true;
+  };
+}
+
+void DevicePoll::waitWakeup(int timeout)
+{
+  struct pollfd fd;
+  fd.fd = m_eventFd;
+  fd.events = POLLIN;
+  fd.revents = 0;
+  if (poll(&fd, 1, timeout) > 0) clearWakeup();
+}
+
+void DevicePoll::wake(void)
+{
+  uint64_t value = 1;
+  ssize_t result = ::write(m_eventFd, &value, sizeof(value));
+  (void)result;
+}
+
+void DevicePoll::clearWakeup(void)
+{
+  uint64_t value;
+  ssize_t result = ::read(m_eventFd, &value, sizeof(value));
+  (void)result;
+}
@@ -0,0 +1,56 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef DEVICEPOLL_HH
+#define DEVICEPOLL_HH
+
+#include <alsa/asoundlib.h>
+#include <poll.h>
+#include <string>
+#include <vector>
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+
+// Waits for one or more PCM devices to become ready or for an explicit wakeup
+// through an eventfd so that an audio thread can react to new data and stop
+// requests at once.
+class DevicePoll
+{
+public:
+  DevicePoll(snd_pcm_t *pcmHandle, const std::string &pcmName) throw (Error);
+  DevicePoll(const std::vector<snd_pcm_t *> &pcmHandles,
+             const std::string &pcmName) throw (Error);
+  virtual ~DevicePoll(void);
+  bool wait(int timeout) throw (Error);
+  bool ready(int index) { return m_ready[index]; }
+  void enable(int index);
+  void disable(int index);
+  void waitWakeup(int timeout);
+  void wake(void);
+protected:
+  void init(void) throw (Error);
+  void clearWakeup(void);
+  std::vector<snd_pcm_t *> m_pcmHandles;
+  std::string m_pcmName;
+  int m_eventFd;
+  std::vector<int> m_offsets;
+  std::vector<bool> m_ready;
+  std::vector<bool> m_enabled;
+  boost::shared_array<struct pollfd> m_fds;
+};
+
+typedef boost::shared_ptr< DevicePoll > DevicePollPtr;
+
+#endif
@@ -0,0 +1,344 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstring>
+#include "dspchain.hh"
+
+using namespace std;
+
+VALUE DSPChain::cRubyClass = Qnil;
+
+DSPChain::DSPChain(int channels) throw (Error):
+  m_inputChannels(channels), m_maxFrames(0), m_attached(false), m_reset(false)
+{
+  ERRORMACRO(channels > 0, Error, , "Processing chain must have at least one "
+             "channel (was " << channels << ")");
+}
+
+// Append a stage and return its index. The stage has to accept the output of the
+// previous stage.
+int DSPChain::add(DSPStagePtr stage) throw (Error)
+{
+  ERRORMACRO(!m_attached, Error, , "Cannot add stage \"" << stage->name()
+             << "\" to processing chain while it is attached to \"" << m_device
+             << "\"");
+  ERRORMACRO(stage->inputChannels() == outputChannels(), Error, , "Stage \""
+             << stage->name() << "\" expects " << stage->inputChannels()
+             << " channel(s) but the processing chain provides " << outputChannels());
+  m_stages.push_back(stage);
+  return m_stages.size() - 1;
+}
+
+int DSPChain::size(void)
+{
+  return m_stages.size();
+}
+
+int DSPChain::inputChannels(void)
+{
+  return m_inputChannels;
+}
+
+int DSPChain::outputChannels(void)
+{
+  return m_stages.empty() ? m_inputChannels : m_stages.back()->outputChannels();
+}
+
+DSPStagePtr DSPChain::stage(int index) throw (Error)
+{
+  ERRORMACRO(index >= 0 && index < (int)m_stages.size(), Error, , "Index of stage "
+             "must be between 0 and " << (int)m_stages.size() - 1 << " (was " << index
+             << ")");
+  return m_stages[index];
+}
+
+// Clear the filter states. The audio thread does this before processing the next
+// period.
+void DSPChain::reset(void)
+{
+  if (m_attached)
+    m_reset = true;
+  else
+    for (unsigned int i=0; i<m_stages.size(); i++)
+      m_stages[i]->reset();
+}
+
+bool DSPChain::attached(void)
+{
+  return m_attached;
+}
+
+// Allocate the buffers for periods of up to maxFrames frames. A chain can only be
+// attached to one device at a time.
+void DSPChain::prepare(int maxFrames, const string &device) throw (Error)
+{
+  ERRORMACRO(!m_attached, Error, , "Processing chain is already attached to \""
+             << m_device << "\"");
+  int samples = maxFrames * maxChannels();
+  for (int i=0; i<2; i++)
+    m_buffer[i] = boost::shared_array<float>(new float[samples]);
+  m_samples = boost::shared_array<float>(new float[samples]);
+  m_result = boost::shared_array<float>(new float[samples]);
+  m_maxFrames = maxFrames;
+  m_device = device;
+  m_reset = false;
+  for (unsigned int i=0; i<m_stages.size(); i++)
+    m_stages[i]->reset();
+  m_attached = true;
+}
+
+// Called once the audio thread does not use the chain any more.
+void DSPChain::release(void)
+{
+  m_attached = false;
+  m_device.clear();
+}
+
+// Process interleaved samples of the device in place. The chain must have the same
+// number of input and output channels.
+void DSPChain::apply(char *data, SampleFormat format, int frames)
+{
+  if (m_stages.empty()) return;
+  if (format == SAMPLE_FLOAT)
+    run((float *)data, frames);
+  else {
+    convertSamples(data, format, (char *)m_samples.get(), SAMPLE_FLOAT,
+                   frames * m_inputChannels);
+    process(m_samples.get(), m_result.get(), frames);
+    convertSamples((const char *)m_result.get(), SAMPLE_FLOAT, data, format,
+                   frames * m_inputChannels);
+  };
+}
+
+void DSPChain::run(float *data, int frames)
+{
+  if (m_stages.empty()) return;
+  process(data, m_result.get(), frames);
+  memcpy(data, m_result.get(), frames * m_inputChannels * sizeof(float));
+}
+
+// Stages alternate between two buffers and the last stage writes to the output.
+void DSPChain::process(const float *input, float *output, int frames)
+{
+  if (m_reset.exchange(false))
+    for (unsigned int i=0; i<m_stages.size(); i++)
+      m_stages[i]->reset();
+  int n = m_stages.size();
+  if (n == 0) {
+    memcpy(output, input, frames * m_inputChannels * sizeof(float));
+    return;
+  };
+  const float *source = input;
+  for (int i=0; i<n; i++) {
+    float *target = i == n - 1 ? output : m_buffer[i % 2].get();
+    m_stages[i]->run(source, target, frames);
+    source = target;
+  };
+}
+
+int DSPChain::maxChannels(void)
+{
+  int retVal = m_inputChannels;
+  for (unsigned int i=0; i<m_stages.size(); i++)
+    retVal = max(retVal, m_stages[i]->outputChannels());
+  return retVal;
+}
+
+VALUE DSPChain::registerRubyClass( VALUE rbModule )
+{
+  cRubyClass = rb_define_class_under( rbModule, "DSPChain", rb_cObject );
+  rb_define_singleton_method( cRubyClass, "new", RUBY_METHOD_FUNC( wrapNew ), 1 );
+  rb_define_method( cRubyClass, "add_gain", RUBY_METHOD_FUNC( wrapAddGain ), 1 );
+  rb_define_method( cRubyClass, "add_biquad", RUBY_METHOD_FUNC( wrapAddBiquad ), 1 );
+  rb_define_method( cRubyClass, "add_dc_block", RUBY_METHOD_FUNC( wrapAddDCBlock ), 1 );
+  rb_define_method( cRubyClass, "add_remap", RUBY_METHOD_FUNC( wrapAddRemap ), 2 );
+  rb_define_method( cRubyClass, "size", RUBY_METHOD_FUNC( wrapSize ), 0 );
+  rb_define_method( cRubyClass, "input_channels",
+                    RUBY_METHOD_FUNC( wrapInputChannels ), 0 );
+  rb_define_method( cRubyClass, "output_channels",
+                    RUBY_METHOD_FUNC( wrapOutputChannels ), 0 );
+  rb_define_method( cRubyClass, "stage_name", RUBY_METHOD_FUNC( wrapStageName ), 1 );
+  rb_define_method( cRubyClass, "parameters", RUBY_METHOD_FUNC( wrapParameters ), 1 );
+  rb_define_method( cRubyClass, "set_parameters",
+                    RUBY_METHOD_FUNC( wrapSetParameters ), 3 );
+  rb_define_method( cRubyClass, "reset", RUBY_METHOD_FUNC( wrapReset ), 0 );
+  rb_define_method( cRubyClass, "attached?", RUBY_METHOD_FUNC( wrapAttached ), 0 );
+  return cRubyClass;
+}
+
+void DSPChain::deleteRubyObject( void *ptr )
+{
+  delete (DSPChainPtr *)ptr;
+}
+
+static vector<float> floatArray(VALUE rbArray)
+{
+  rb_check_type( rbArray, T_ARRAY );
+  vector<float> retVal(RARRAY_LEN(rbArray));
+  for (long i=0; i<RARRAY_LEN(rbArray); i++)
+    retVal[i] = NUM2DBL(rb_ary_entry(rbArray, i));
+  return retVal;
+}
+
+VALUE DSPChain::wrapNew( VALUE rbClass, VALUE rbChannels )
+{
+  VALUE retVal = Qnil;
+  try {
+    DSPChainPtr ptr(new DSPChain(NUM2INT(rbChannels)));
+    retVal = Data_Wrap_Struct( rbClass, 0, deleteRubyObject, new DSPChainPtr( ptr ) );
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE DSPChain::wrapAddGain( VALUE rbSelf, VALUE rbGain )
+{
+  VALUE retVal = Qnil;
+  try {
+    DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+    int channels = (*self)->outputChannels();
+    retVal = INT2NUM((*self)->add(DSPStagePtr(new GainStage(channels,
+                                                           NUM2DBL(rbGain)))));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE DSPChain::wrapAddBiquad( VALUE rbSelf, VALUE rbCoefficients )
+{
+  VALUE retVal = Qnil;
+  try {
+    DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+    vector<float> coefficients = floatArray(rbCoefficients);
+    ERRORMACRO(coefficients.size() == 5, Error, , "Biquad filter requires five "
+               "coefficients (b0, b1, b2, a1, a2) but got " << coefficients.size());
+    int channels = (*self)->outputChannels();
+    retVal = INT2NUM((*self)->add(DSPStagePtr(new BiquadStage(channels,
+                                                             coefficients))));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE DSPChain::wrapAddDCBlock( VALUE rbSelf, VALUE rbPole )
+{
+  VALUE retVal = Qnil;
+  try {
+    DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+    int channels = (*self)->outputChannels();
+    retVal = INT2NUM((*self)->add(DSPStagePtr(new DCBlockStage(channels,
+                                                              NUM2DBL(rbPole)))));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE DSPChain::wrapAddRemap( VALUE rbSelf, VALUE rbChannels, VALUE rbMatrix )
+{
+  VALUE retVal = Qnil;
+  try {
+    DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+    int inputChannels = (*self)->outputChannels();
+    int outputChannels = NUM2INT(rbChannels);
+    ERRORMACRO(outputChannels > 0, Error, , "Remapping requires at least one output "
+               "channel (was " << outputChannels << ")");
+    vector<float> matrix = floatArray(rbMatrix);
+    ERRORMACRO(matrix.empty() || (int)matrix.size() == inputChannels * outputChannels,
+               Error, , "Remapping " << inputChannels << " to " << outputChannels
+               << " channel(s) requires " << inputChannels * outputChannels
+               << " weights but got " << matrix.size());
+    retVal = INT2NUM((*self)->add(DSPStagePtr(new RemapStage(inputChannels,
+                                                            outputChannels,
+                                                            matrix))));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE DSPChain::wrapSize( VALUE rbSelf )
+{
+  DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+  return INT2NUM( (*self)->size() );
+}
+
+VALUE DSPChain::wrapInputChannels( VALUE rbSelf )
+{
+  DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+  return INT2NUM( (*self)->inputChannels() );
+}
+
+VALUE DSPChain::wrapOutputChannels( VALUE rbSelf )
+{
+  DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+  return INT2NUM( (*self)->outputChannels() );
+}
+
+VALUE DSPChain::wrapStageName( VALUE rbSelf, VALUE rbStage )
+{
+  VALUE retVal = Qnil;
+  try {
+    DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+    retVal = rb_str_new2((*self)->stage(NUM2INT(rbStage))->name());
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE DSPChain::wrapParameters( VALUE rbSelf, VALUE rbStage )
+{
+  VALUE retVal = Qnil;
+  try {
+    DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+    vector<float> values = (*self)->stage(NUM2INT(rbStage))->parameterValues();
+    retVal = rb_ary_new2(values.size());
+    for (unsigned int i=0; i<values.size(); i++)
+      rb_ary_push(retVal, rb_float_new(values[i]));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return retVal;
+}
+
+VALUE DSPChain::wrapSetParameters( VALUE rbSelf, VALUE rbStage, VALUE rbValues,
+                                   VALUE rbOffset )
+{
+  try {
+    DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+    (*self)->stage(NUM2INT(rbStage))->setParameters(floatArray(rbValues),
+                                                    NUM2INT(rbOffset));
+  } catch ( exception &e ) {
+    rb_raise( rb_eRuntimeError, "%s", e.what() );
+  };
+  return rbValues;
+}
+
+VALUE DSPChain::wrapReset( VALUE rbSelf )
+{
+  DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+  (*self)->reset();
+  return rbSelf;
+}
+
+VALUE DSPChain::wrapAttached( VALUE rbSelf )
+{
+  DSPChainPtr *self; Data_Get_Struct( rbSelf, DSPChainPtr, self );
+  return (*self)->attached() ? Qtrue : Qfalse;
+}
@@ -0,0 +1,81 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef DSPCHAIN_HH
+#define DSPCHAIN_HH
+
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "rubyinc.hh"
+#include "error.hh"
+#include "convert.hh"
+#include "dspstage.hh"
+#include "duplexkernel.hh"
+
+// Sequence of processing stages run by the audio thread of an AlsaInput,
+// AlsaOutput, or AlsaDuplex once per period. Stages can only be added while the
+// chain is not attached to a device. The parameters of the stages can be changed
+// at any time without blocking the audio thread.
+class DSPChain: public DuplexKernel
+{
+public:
+  DSPChain(int channels) throw (Error);
+  virtual ~DSPChain(void) {}
+  int add(DSPStagePtr stage) throw (Error);
+  int size(void);
+  int inputChannels(void);
+  int outputChannels(void);
+  DSPStagePtr stage(int index) throw (Error);
+  void reset(void);
+  bool attached(void);
+  void prepare(int maxFrames, const std::string &device) throw (Error);
+  void release(void);
+  void apply(char *data, SampleFormat format, int frames);
+  void run(float *data, int frames);
+  virtual void process(const float *input, float *output, int frames);
+  static VALUE cRubyClass;
+  static VALUE registerRubyClass( VALUE rbModule );
+  static void deleteRubyObject( void *ptr );
+  static VALUE wrapNew( VALUE rbClass, VALUE rbChannels );
+  static VALUE wrapAddGain( VALUE rbSelf, VALUE rbGain );
+  static VALUE wrapAddBiquad( VALUE rbSelf, VALUE rbCoefficients );
+  static VALUE wrapAddDCBlock( VALUE rbSelf, VALUE rbPole );
+  static VALUE wrapAddRemap( VALUE rbSelf, VALUE rbChannels, VALUE rbMatrix );
+  static VALUE wrapSize( VALUE rbSelf );
+  static VALUE wrapInputChannels( VALUE rbSelf );
+  static VALUE wrapOutputChannels( VALUE rbSelf );
+  static VALUE wrapStageName( VALUE rbSelf, VALUE rbStage );
+  static VALUE wrapParameters( VALUE rbSelf, VALUE rbStage );
+  static VALUE wrapSetParameters( VALUE rbSelf, VALUE rbStage, VALUE rbValues,
+                                  VALUE rbOffset );
+  static VALUE wrapReset( VALUE rbSelf );
+  static VALUE wrapAttached( VALUE rbSelf );
+protected:
+  int maxChannels(void);
+  int m_inputChannels;
+  std::vector<DSPStagePtr> m_stages;
+  boost::shared_array<float> m_buffer[2];
+  boost::shared_array<float> m_samples;
+  boost::shared_array<float> m_result;
+  int m_maxFrames;
+  std::string m_device;
+  boost::atomic<bool> m_attached;
+  boost::atomic<bool> m_reset;
+};
+
+typedef boost::shared_ptr< DSPChain > DSPChainPtr;
+
+#endif
@@ -0,0 +1,230 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "dspstage.hh"
+
+using namespace std;
+
+ParameterSlots::ParameterSlots(int size):
+  m_size(size), m_values(new boost::atomic<float>[size > 0 ? size : 1]), m_version(0),
+  m_seen(0), m_scratch(new float[size > 0 ? size : 1])
+{
+  for (int i=0; i<m_size; i++)
+    m_values[i].store(0.0f, boost::memory_order_relaxed);
+}
+
+// Called by the writer.
+void ParameterSlots::set(const float *values, int count, int offset)
+{
+  unsigned int version = m_version.load(boost::memory_order_relaxed);
+  m_version.store(version + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  for (int i=0; i<count; i++)
+    m_values[offset + i].store(values[i], boost::memory_order_relaxed);
+  m_version.store(version + 2, boost::memory_order_release);
+}
+
+// Called by the writer.
+void ParameterSlots::get(float *values)
+{
+  for (int i=0; i<m_size; i++)
+    values[i] = m_values[i].load(boost::memory_order_relaxed);
+}
+
+// Called by the reader. Returns true if the cache was updated.
+bool ParameterSlots::update(float *cache)
+{
+  unsigned int version = m_version.load(boost::memory_order_acquire);
+  if (version == m_seen || (version & 1) != 0) return false;
+  float *values = m_scratch.get();
+  for (int i=0; i<m_size; i++)
+    values[i] = m_values[i].load(boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_acquire);
+  if (m_version.load(boost::memory_order_relaxed) != version) return false;
+  for (int i=0; i<m_size; i++)
+    cache[i] = values[i];
+  m_seen = version;
+  return true;
+}
+
+DSPStage::DSPStage(const char *name, int inputChannels, int outputChannels,
+                   const vector<float> &parameters):
+  m_name(name), m_inputChannels(inputChannels), m_outputChannels(outputChannels),
+  m_slots(parameters.size()),
+  m_parameters(new float[parameters.empty() ? 1 : parameters.size()])
+{
+  if (!parameters.empty()) {
+    m_slots.set(&parameters[0], parameters.size(), 0);
+    m_slots.update(m_parameters.get());
+  };
+}
+
+void DSPStage::setParameters(const vector<float> &values, int offset) throw (Error)
+{
+  ERRORMACRO(offset >= 0 && offset + (int)values.size() <= m_slots.size(), Error, ,
+             "Stage \"" << m_name << "\" has " << m_slots.size() << " parameter(s) "
+             "(cannot set " << values.size() << " starting at " << offset << ")");
+  if (!values.empty()) m_slots.set(&values[0], values.size(), offset);
+}
+
+vector<float> DSPStage::parameterValues(void)
+{
+  vector<float> retVal(m_slots.size());
+  if (!retVal.empty()) m_slots.get(&retVal[0]);
+  return retVal;
+}
+
+// Called by the audio thread for each period.
+void DSPStage::run(const float *input, float *output, int frames)
+{
+  if (m_slots.update(m_parameters.get())) update();
+  process(input, output, frames);
+}
+
+static vector<float> gainParameters(float gain)
+{
+  vector<float> retVal(2);
+  retVal[0] = gain;
+  retVal[1] = 0.0f;
+  return retVal;
+}
+
+GainStage::GainStage(int channels, float gain):
+  DSPStage("gain", channels, channels, gainParameters(gain)), m_current(gain)
+{
+}
+
+void GainStage::process(const float *input, float *output, int frames)
+{
+  float target = m_parameters[1] != 0.0f ? 0.0f : m_parameters[0];
+  int samples = frames * m_outputChannels;
+  if (target == m_current) {
+    // Plain loops like this one are vectorised by the compiler.
+    for (int i=0; i<samples; i++)
+      output[i] = input[i] * target;
+  } else {
+    float step = (target - m_current) / frames;
+    for (int f=0; f<frames; f++) {
+      float gain = m_current + step * (f + 1);
+      for (int c=0; c<m_outputChannels; c++)
+        output[f * m_outputChannels + c] = input[f * m_outputChannels + c] * gain;
+    };
+    m_current = target;
+  };
+}
+
+static vector<float> biquadParameters(const vector<float> &coefficients)
+{
+  if (coefficients.size() == 5) return coefficients;
+  vector<float> retVal(5, 0.0f);
+  retVal[0] = 1.0f;
+  return retVal;
+}
+
+BiquadStage::BiquadStage(int channels, const vector<float> &coefficients):
+  DSPStage("biquad", channels, channels, biquadParameters(coefficients)),
+  m_state(new double[2 * channels])
+{
+  reset();
+}
+
+void BiquadStage::reset(void)
+{
+  for (int i=0; i<2 * m_outputChannels; i++)
+    m_state[i] = 0.0;
+}
+
+void BiquadStage::process(const float *input, float *output, int frames)
+{
+  double b0 = m_parameters[0], b1 = m_parameters[1], b2 = m_parameters[2],
+         a1 = m_parameters[3], a2 = m_parameters[4];
+  int channels = m_outputChannels;
+  // The recursion is serial in time but independent for each channel.
+  for (int c=0; c<channels; c++) {
+    double z1 = m_state[2 * c], z2 = m_state[2 * c + 1];
+    for (int f=0; f<frames; f++) {
+      double x = input[f * channels + c];
+      double y = b0 * x + z1;
+      z1 = b1 * x - a1 * y + z2;
+      z2 = b2 * x - a2 * y;
+      output[f * channels + c] = (float)y;
+    };
+    m_state[2 * c] = z1;
+    m_state[2 * c + 1] = z2;
+  };
+}
+
+DCBlockStage::DCBlockStage(int channels, float pole):
+  DSPStage("dc_block", channels, channels, vector<float>(1, pole)),
+  m_state(new float[2 * channels])
+{
+  reset();
+}
+
+void DCBlockStage::reset(void)
+{
+  for (int i=0; i<2 * m_outputChannels; i++)
+    m_state[i] = 0.0f;
+}
+
+void DCBlockStage::process(const float *input, float *output, int frames)
+{
+  float r = m_parameters[0];
+  int channels = m_outputChannels;
+  for (int c=0; c<channels; c++) {
+    float x1 = m_state[2 * c], y1 = m_state[2 * c + 1];
+    for (int f=0; f<frames; f++) {
+      float x = input[f * channels + c];
+      y1 = x - x1 + r * y1;
+      x1 = x;
+      output[f * channels + c] = y1;
+    };
+    m_state[2 * c] = x1;
+    m_state[2 * c + 1] = y1;
+  };
+}
+
+static vector<float> remapParameters(int inputChannels, int outputChannels,
+                                     const vector<float> &matrix)
+{
+  if ((int)matrix.size() == inputChannels * outputChannels) return matrix;
+  vector<float> retVal(inputChannels * outputChannels, 0.0f);
+  for (int o=0; o<outputChannels; o++)
+    retVal[o * inputChannels + o % inputChannels] = 1.0f;
+  return retVal;
+}
+
+RemapStage::RemapStage(int inputChannels, int outputChannels,
+                       const vector<float> &matrix):
+  DSPStage("remap", inputChannels, outputChannels,
+           remapParameters(inputChannels, outputChannels, matrix))
+{
+}
+
+void RemapStage::process(const float *input, float *output, int frames)
+{
+  const float *matrix = m_parameters.get();
+  for (int f=0; f<frames; f++) {
+    const float *p = input + f * m_inputChannels;
+    float *q = output + f * m_outputChannels;
+    for (int o=0; o<m_outputChannels; o++) {
+      const float *row = matrix + o * m_inputChannels;
+      float sum = 0.0f;
+      for (int i=0; i<m_inputChannels; i++)
+        sum += row[i] * p[i];
+      q[o] = sum;
+    };
+  };
+}
@@ -0,0 +1,119 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef DSPSTAGE_HH
+#define DSPSTAGE_HH
+
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+
+// Values shared between one writer and one reader thread, e.g. parameters of a
+// processing stage set by Ruby and read by the audio thread. The writer brackets
+// each update with an odd and an even version number (a sequence lock). The
+// reader copies the values to its own cache only if the version did not change
+// while it was copying so that it never sees a partial update (e.g. mismatching
+// filter coefficients). Neither side ever waits for the other.
+class ParameterSlots
+{
+public:
+  ParameterSlots(int size);
+  int size(void) { return m_size; }
+  void set(const float *values, int count, int offset);
+  void get(float *values);
+  bool update(float *cache);
+protected:
+  int m_size;
+  boost::shared_array< boost::atomic<float> > m_values;
+  boost::atomic<unsigned int> m_version;
+  unsigned int m_seen;
+  boost::shared_array<float> m_scratch;
+};
+
+// Processing stage running in an audio thread. The stage converts frames with
+// inputChannels channels to frames with outputChannels channels. Input and output
+// never overlap.
+class DSPStage
+{
+public:
+  DSPStage(const char *name, int inputChannels, int outputChannels,
+           const std::vector<float> &parameters);
+  virtual ~DSPStage(void) {}
+  const char *name(void) { return m_name; }
+  int inputChannels(void) { return m_inputChannels; }
+  int outputChannels(void) { return m_outputChannels; }
+  int parameters(void) { return m_slots.size(); }
+  void setParameters(const std::vector<float> &values, int offset) throw (Error);
+  std::vector<float> parameterValues(void);
+  void run(const float *input, float *output, int frames);
+  virtual void reset(void) {}
+protected:
+  virtual void update(void) {}
+  virtual void process(const float *input, float *output, int frames) = 0;
+  const char *m_name;
+  int m_inputChannels;
+  int m_outputChannels;
+  ParameterSlots m_slots;
+  boost::shared_array<float> m_parameters;
+};
+
+typedef boost::shared_ptr< DSPStage > DSPStagePtr;
+
+// Gain with mute. Parameters: gain, mute (non-zero mutes). Changes are ramped
+// over one period to avoid clicks.
+class GainStage: public DSPStage
+{
+public:
+  GainStage(int channels, float gain);
+protected:
+  virtual void process(const float *input, float *output, int frames);
+  float m_current;
+};
+
+// Biquad filter in transposed direct form II. Parameters: b0, b1, b2, a1, a2
+// (normalised so that a0 is one).
+class BiquadStage: public DSPStage
+{
+public:
+  BiquadStage(int channels, const std::vector<float> &coefficients);
+  virtual void reset(void);
+protected:
+  virtual void process(const float *input, float *output, int frames);
+  boost::shared_array<double> m_state;
+};
+
+// First-order DC blocking filter y[n] = x[n] - x[n-1] + r * y[n-1]. Parameter: r.
+class DCBlockStage: public DSPStage
+{
+public:
+  DCBlockStage(int channels, float pole);
+  virtual void reset(void);
+protected:
+  virtual void process(const float *input, float *output, int frames);
+  boost::shared_array<float> m_state;
+};
+
+// Channel remapping and downmixing with a matrix. Parameters: the weights of the
+// input channels for output channel 0, then for output channel 1, and so on.
+class RemapStage: public DSPStage
+{
+public:
+  RemapStage(int inputChannels, int outputChannels, const std::vector<float> &matrix);
+protected:
+  virtual void process(const float *input, float *output, int frames);
+};
+
+#endif
@@ -0,0 +1,39 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "duplexkernel.hh"
+
+PassthroughKernel::PassthroughKernel(int inputChannels, int outputChannels):
+  m_inputChannels(inputChannels), m_outputChannels(outputChannels), m_gain(1.0f)
+{
+}
+
+void PassthroughKernel::process(const float *input, float *output, int frames)
+{
+  float gain = m_gain.load(boost::memory_order_relaxed);
+  if (m_inputChannels == m_outputChannels) {
+    // Simple loop which the compiler vectorises.
+    int samples = frames * m_outputChannels;
+    for (int i=0; i<samples; i++)
+      output[i] = input[i] * gain;
+  } else {
+    for (int f=0; f<frames; f++) {
+      const float *p = input + f * m_inputChannels;
+      float *q = output + f * m_outputChannels;
+      for (int c=0; c<m_outputChannels; c++)
+        q[c] = p[c % m_inputChannels] * gain;
+    };
+  };
+}
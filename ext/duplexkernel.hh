@@ -0,0 +1,52 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef DUPLEXKERNEL_HH
+#define DUPLEXKERNEL_HH
+
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+
+// Native processing kernel of an AlsaDuplex. The audio thread calls process once
+// per period with interleaved floating point samples of the capture device and
+// expects the samples for the playback device in return. Implementations must not
+// allocate memory, take locks, or make system calls.
+class DuplexKernel
+{
+public:
+  virtual ~DuplexKernel(void) {}
+  virtual void process(const float *input, float *output, int frames) = 0;
+};
+
+typedef boost::shared_ptr< DuplexKernel > DuplexKernelPtr;
+
+// Default kernel copying the captured samples to the playback device. Output
+// channel i takes input channel i modulo the number of input channels.
+class PassthroughKernel: public DuplexKernel
+{
+public:
+  PassthroughKernel(int inputChannels, int outputChannels);
+  virtual void process(const float *input, float *output, int frames);
+  float gain(void) { return m_gain; }
+  void setGain(float gain) { m_gain = gain; }
+protected:
+  int m_inputChannels;
+  int m_outputChannels;
+  boost::atomic<float> m_gain;
+};
+
+typedef boost::shared_ptr< PassthroughKernel > PassthroughKernelPtr;
+
+#endif
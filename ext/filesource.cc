@@ -0,0 +1,169 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "filesource.hh"
+
+using namespace std;
+
+static unsigned int getLE(const char *p, int bytes)
+{
+  unsigned int retVal = 0;
+  for (int i=0; i<bytes; i++)
+    retVal |= (unsigned int)(unsigned char)p[i] << (8 * i);
+  return retVal;
+}
+
+FileSource::FileSource(const string &path, SampleFormat rawFormat,
+                       unsigned int channels, unsigned int rate,
+                       SampleFormat deviceFormat) throw (Error):
+  m_path(path), m_map(NULL), m_mapSize(0), m_data(NULL), m_format(rawFormat),
+  m_channels(channels), m_rate(rate), m_deviceFormat(deviceFormat), m_frameSize(0),
+  m_frames(0), m_page(sysconf(_SC_PAGESIZE)), m_window(0), m_advised(0),
+  m_released(0), m_position(0), m_finished(false)
+{
+  int fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+  ERRORMACRO(fd >= 0, Error, , "Error opening \"" << m_path << "\": "
+             << strerror(errno));
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    int err = errno;
+    ::close(fd);
+    ERRORMACRO(false, Error, , "Error reading size of \"" << m_path << "\": "
+               << strerror(err));
+  };
+  if (info.st_size == 0) {
+    ::close(fd);
+    ERRORMACRO(false, Error, , "File \"" << m_path << "\" is empty");
+  };
+  m_mapSize = info.st_size;
+  void *map = mmap(NULL, m_mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  int err = errno;
+  // The mapping stays valid after closing the descriptor.
+  ::close(fd);
+  ERRORMACRO(map != MAP_FAILED, Error, , "Error mapping \"" << m_path << "\": "
+             << strerror(err));
+  m_map = (char *)map;
+  try {
+    size_t size = m_mapSize;
+    if (m_mapSize >= 12 && memcmp(m_map, "RIFF", 4) == 0 &&
+        memcmp(m_map + 8, "WAVE", 4) == 0) {
+      size = parseWAV();
+    } else
+      m_data = m_map;
+    m_frameSize = sampleSize(m_format) * m_channels;
+    m_frames = size / m_frameSize;
+    m_window = ((size_t)m_rate * m_frameSize + m_page - 1) / m_page * m_page;
+    madvise(m_map, m_mapSize, MADV_SEQUENTIAL);
+    advise();
+  } catch (Error &e) {
+    munmap(m_map, m_mapSize);
+    throw e;
+  };
+}
+
+FileSource::~FileSource(void)
+{
+  munmap(m_map, m_mapSize);
+}
+
+// Called by the audio thread. Frames after the end of the file are silent.
+void FileSource::render(char *data, int frames)
+{
+  long long position = m_position;
+  int n = m_frames - position < frames ? (int)(m_frames - position) : frames;
+  if (n > 0) {
+    convertSamples(m_data + position * m_frameSize, m_format, data, m_deviceFormat,
+                   n * m_channels);
+    m_position = position + n;
+    advise();
+  } else
+    // The previous frames have left the ring buffer when the next period is requested.
+    m_finished = true;
+  if (n < frames) {
+    int deviceFrameSize = sampleSize(m_deviceFormat) * m_channels;
+    memset(data + n * deviceFrameSize, 0, (frames - n) * deviceFrameSize);
+  };
+}
+
+// Locate the format and the data chunk and return the size of the audio data.
+size_t FileSource::parseWAV(void) throw (Error)
+{
+  size_t offset = 12, dataSize = 0;
+  int tag = -1, bits = 0;
+  while (m_data == NULL && offset + 8 <= m_mapSize) {
+    const char *chunk = m_map + offset;
+    size_t size = getLE(chunk + 4, 4);
+    if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16 && offset + 8 + size <= m_mapSize) {
+      tag = getLE(chunk + 8, 2);
+      m_channels = getLE(chunk + 10, 2);
+      m_rate = getLE(chunk + 12, 4);
+      bits = getLE(chunk + 22, 2);
+      // WAVE_FORMAT_EXTENSIBLE keeps the actual format in the sub-format GUID.
+      if (tag == 0xFFFE && size >= 40) tag = getLE(chunk + 32, 2);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      m_data = chunk + 8;
+      // Chunks such as LIST or cue may follow the audio data. The size is only
+      // ignored if the writer did not know it or if it saturated at 4 GiB.
+      size_t remaining = m_map + m_mapSize - m_data;
+      if (size == 0 || size == 0xFFFFFFFF || size > remaining)
+        dataSize = remaining;
+      else
+        dataSize = size;
+    };
+    offset += 8 + size + (size & 1);
+  };
+  ERRORMACRO(tag >= 0, Error, , "WAV file \"" << m_path << "\" has no format chunk");
+  ERRORMACRO(m_data != NULL, Error, , "WAV file \"" << m_path
+             << "\" has no data chunk");
+  if (tag == 1 && bits == 16)
+    m_format = SAMPLE_S16;
+  else if (tag == 1 && bits == 32)
+    m_format = SAMPLE_S32;
+  else if (tag == 3 && bits == 32)
+    m_format = SAMPLE_FLOAT;
+  else
+    ERRORMACRO(false, Error, , "WAV file \"" << m_path << "\" has unsupported "
+               "sample format (format tag " << tag << ", " << bits << " bits). "
+               "Only 16 bit and 32 bit PCM and 32 bit float are supported");
+  ERRORMACRO(m_channels > 0, Error, , "WAV file \"" << m_path
+             << "\" has no channels");
+  return dataSize;
+}
+
+// Request the pages of the next second of audio data and release the pages of
+// the second before the play position.
+void FileSource::advise(void)
+{
+  size_t position = m_data - m_map + m_position * m_frameSize;
+  if (m_advised < position + m_window && m_advised < m_mapSize) {
+    size_t start = m_advised / m_page * m_page;
+    size_t end = position + 2 * m_window;
+    if (end > m_mapSize) end = m_mapSize;
+    madvise(m_map + start, end - start, MADV_WILLNEED);
+    m_advised = end;
+  };
+  if (position > m_released + 2 * m_window) {
+    size_t end = (position - m_window) / m_page * m_page;
+    madvise(m_map + m_released, end - m_released, MADV_DONTNEED);
+    m_released = end;
+  };
+}
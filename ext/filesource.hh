@@ -0,0 +1,66 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef FILESOURCE_HH
+#define FILESOURCE_HH
+
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+#include "convert.hh"
+#include "audiosource.hh"
+
+// Audio source playing a WAV or raw file which is mapped into memory. The audio
+// thread converts the frames directly from the page cache. Pages ahead of the
+// play position are requested with madvise and pages behind it are released so
+// that the resident memory does not grow with the length of the file.
+class FileSource: public AudioSource
+{
+public:
+  FileSource(const std::string &path, SampleFormat rawFormat, unsigned int channels,
+             unsigned int rate, SampleFormat deviceFormat) throw (Error);
+  virtual ~FileSource(void);
+  virtual void render(char *data, int frames);
+  const std::string &path(void) { return m_path; }
+  unsigned int channels(void) { return m_channels; }
+  unsigned int rate(void) { return m_rate; }
+  long long frames(void) { return m_frames; }
+  long long position(void) { return m_position; }
+  virtual bool finished(void) { return m_finished; }
+protected:
+  size_t parseWAV(void) throw (Error);
+  void advise(void);
+  std::string m_path;
+  char *m_map;
+  size_t m_mapSize;
+  const char *m_data;
+  SampleFormat m_format;
+  unsigned int m_channels;
+  unsigned int m_rate;
+  SampleFormat m_deviceFormat;
+  int m_frameSize;
+  long long m_frames;
+  size_t m_page;
+  size_t m_window;
+  size_t m_advised;
+  size_t m_released;
+  boost::atomic<long long> m_position;
+  boost::atomic<bool> m_finished;
+};
+
+typedef boost::shared_ptr< FileSource > FileSourcePtr;
+
+#endif
@@ -0,0 +1,152 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "gvl.hh"
+
+using namespace std;
+
+struct RingWait
+{
+  RingBuffer *ring;
+  int frames;
+};
+
+static void *waitRead(void *ptr)
+{
+  RingWait *wait = (RingWait *)ptr;
+  wait->ring->waitRead(wait->frames);
+  return NULL;
+}
+
+static void *waitWrite(void *ptr)
+{
+  RingWait *wait = (RingWait *)ptr;
+  wait->ring->waitWrite(wait->frames);
+  return NULL;
+}
+
+static void interruptRing(void *ptr)
+{
+  ((RingBuffer *)ptr)->interrupt();
+}
+
+#ifdef HAVE_FIBER_SCHEDULER
+struct FiberWait
+{
+  VALUE scheduler;
+  VALUE io;
+  double seconds;
+};
+
+static VALUE waitDescriptor(VALUE ptr)
+{
+  FiberWait *wait = (FiberWait *)ptr;
+  rb_fiber_scheduler_io_wait(wait->scheduler, wait->io, INT2NUM(RUBY_IO_READABLE),
+                             Qnil);
+  return Qnil;
+}
+
+static VALUE sleepScheduler(VALUE ptr)
+{
+  FiberWait *wait = (FiberWait *)ptr;
+  rb_fiber_scheduler_kernel_sleep(wait->scheduler, rb_float_new(wait->seconds));
+  return Qnil;
+}
+#endif
+
+static VALUE checkInterrupts(VALUE rbDummy)
+{
+  rb_thread_check_ints();
+  return Qnil;
+}
+
+void callWithoutGVL(void *(*func)(void *), void *data, void (*ubf)(void *),
+                    void *ubfData) throw (Error)
+{
+  rb_thread_call_without_gvl(func, data, ubf, ubfData);
+  int state = 0;
+  rb_protect(checkInterrupts, Qnil, &state);
+  if (state != 0) {
+    Interrupt e(state);
+    throw e;
+  };
+}
+
+// Wait until the ring buffer holds the specified number of frames. If a fiber
+// scheduler is active and a watermark is given, only the current fiber waits.
+void waitReadWithoutGVL(RingBufferPtr ring, int frames, WatermarkPtr wait) throw (Error)
+{
+  if (wait.get() && fiberScheduler()) {
+    wait->setLevel(min(frames, ring->size()));
+    waitReadable(wait);
+    wait->resume();
+  } else {
+    RingWait ringWait = { ring.get(), frames };
+    callWithoutGVL(waitRead, &ringWait, interruptRing, ring.get());
+  };
+}
+
+// Wait until the ring buffer has space for the specified number of frames. If a
+// fiber scheduler is active and a watermark is given, only the current fiber waits.
+void waitWriteWithoutGVL(RingBufferPtr ring, int frames, WatermarkPtr wait) throw (Error)
+{
+  if (wait.get() && fiberScheduler()) {
+    wait->setLevel(min(frames, ring->size()));
+    waitReadable(wait);
+    wait->resume();
+  } else {
+    RingWait ringWait = { ring.get(), frames };
+    callWithoutGVL(waitWrite, &ringWait, interruptRing, ring.get());
+  };
+}
+
+// Check whether the current fiber is non-blocking and runs under a fiber scheduler.
+bool fiberScheduler(void)
+{
+#ifdef HAVE_FIBER_SCHEDULER
+  return rb_fiber_scheduler_current() != Qnil;
+#else
+  return false;
+#endif
+}
+
+// Let the fiber scheduler run other fibers until the descriptor of the watermark
+// is readable.
+void waitReadable(WatermarkPtr watermark) throw (Error)
+{
+#ifdef HAVE_FIBER_SCHEDULER
+  FiberWait wait = { rb_fiber_scheduler_current(), watermark->rubyIO(), 0.0 };
+  int state = 0;
+  rb_protect(waitDescriptor, (VALUE)&wait, &state);
+  if (state != 0) {
+    Interrupt e(state);
+    throw e;
+  };
+#endif
+}
+
+// Let the fiber scheduler run other fibers for the specified time.
+void sleepFiber(double seconds) throw (Error)
+{
+#ifdef HAVE_FIBER_SCHEDULER
+  FiberWait wait = { rb_fiber_scheduler_current(), Qnil, seconds };
+  int state = 0;
+  rb_protect(sleepScheduler, (VALUE)&wait, &state);
+  if (state != 0) {
+    Interrupt e(state);
+    throw e;
+  };
+#endif
+}
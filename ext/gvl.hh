@@ -0,0 +1,48 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef GVL_HH
+#define GVL_HH
+
+#include "rubyinc.hh"
+#include "error.hh"
+#include "ringbuffer.hh"
+#include "watermark.hh"
+
+// Exception used to unwind the C++ stack when a Ruby interrupt (e.g. Thread#raise
+// or a signal) arrives while waiting. The wrapper function resumes the Ruby
+// exception with rb_jump_tag once all destructors have run.
+class Interrupt: public Error
+{
+public:
+  Interrupt(int state): m_state(state) {}
+  Interrupt(Interrupt &e): Error(e), m_state(e.m_state) {}
+  virtual ~Interrupt(void) throw() {}
+  int state(void) { return m_state; }
+protected:
+  int m_state;
+};
+
+void callWithoutGVL(void *(*func)(void *), void *data, void (*ubf)(void *),
+                    void *ubfData) throw (Error);
+void waitReadWithoutGVL(RingBufferPtr ring, int frames,
+                        WatermarkPtr wait = WatermarkPtr()) throw (Error);
+void waitWriteWithoutGVL(RingBufferPtr ring, int frames,
+                         WatermarkPtr wait = WatermarkPtr()) throw (Error);
+bool fiberScheduler(void);
+void waitReadable(WatermarkPtr watermark) throw (Error);
+void sleepFiber(double seconds) throw (Error);
+
+#endif
@@ -15,6 +15,11 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 #include "alsaoutput.hh"
 #include "alsainput.hh"
+#include "alsainputgroup.hh"
+#include "alsamixer.hh"
+#include "alsaduplex.hh"
+#include "dspchain.hh"
+#include "pcmpool.hh"
 
 #ifdef WIN32
 #define DLLEXPORT __declspec(dllexport)
@@ -32,8 +37,16 @@ extern "C" {
   {
     rb_eval_string( "require 'multiarray'" );
     VALUE rbHornetseye = rb_define_module( "Hornetseye" );
+    Sequence::initRuby( rbHornetseye );
+    Watermark::initRuby();
     AlsaOutput::registerRubyClass( rbHornetseye );
     AlsaInput::registerRubyClass( rbHornetseye );
+    AlsaInputGroup::registerRubyClass( rbHornetseye );
+    AlsaVoice::registerRubyClass( rbHornetseye );
+    AlsaMixer::registerRubyClass( rbHornetseye );
+    AlsaDuplex::registerRubyClass( rbHornetseye );
+    DSPChain::registerRubyClass( rbHornetseye );
+    PCMPool::registerRubyClass( rbHornetseye );
     rb_require( "hornetseye_alsa_ext.rb" );
   }
 
@@ -0,0 +1,244 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include "pcmpool.hh"
+
+using namespace std;
+
+VALUE PCMPool::cRubyClass = Qnil;
+
+multimap<PCMConfig, PCMHandle> PCMPool::m_handles;
+
+int PCMPool::m_capacity = 0;
+
+pthread_mutex_t PCMPool::m_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+PCMConfig::PCMConfig(const string &name, snd_pcm_stream_t stream, unsigned int rate,
+                     unsigned int channels, SampleFormat format, bool mmap,
+                     unsigned int bufferTime, unsigned int periods,
+                     snd_pcm_uframes_t periodSize):
+  name(name), stream(stream), rate(rate), channels(channels), format(format),
+  mmap(mmap), bufferTime(bufferTime), periods(periods), periodSize(periodSize)
+{
+}
+
+bool PCMConfig::operator<(const PCMConfig &other) const
+{
+  if (name != other.name) return name < other.name;
+  if (stream != other.stream) return stream < other.stream;
+  if (rate != other.rate) return rate < other.rate;
+  if (channels != other.channels) return channels < other.channels;
+  if (format != other.format) return format < other.format;
+  if (mmap != other.mmap) return mmap < other.mmap;
+  if (bufferTime != other.bufferTime) return bufferTime < other.bufferTime;
+  if (periods != other.periods) return periods < other.periods;
+  return periodSize < other.periodSize;
+}
+
+// Take a prepared device from the pool or open and configure a new one.
+PCMHandle PCMPool::acquire(const PCMConfig &config) throw (Error)
+{
+  pthread_mutex_lock(&m_mutex);
+  multimap<PCMConfig, PCMHandle>::iterator i = m_handles.find(config);
+  bool found = i != m_handles.end();
+  PCMHandle retVal;
+  if (found) {
+    retVal = i->second;
+    m_handles.erase(i);
+  };
+  pthread_mutex_unlock(&m_mutex);
+  if (!found) retVal = open(config);
+  return retVal;
+}
+
+// Stop the device and keep it for later use if there is space in the pool.
+// Otherwise the device is closed.
+void PCMPool::release(const PCMConfig &config, const PCMHandle &handle)
+{
+  snd_pcm_drop(handle.pcm);
+  bool keep = false;
+  pthread_mutex_lock(&m_mutex);
+  if ((int)m_handles.size() < m_capacity && snd_pcm_prepare(handle.pcm) >= 0) {
+    m_handles.insert(make_pair(config, handle));
+    keep = true;
+  };
+  pthread_mutex_unlock(&m_mutex);
+  if (!keep) snd_pcm_close(handle.pcm);
+}
+
+int PCMPool::capacity(void)
+{
+  return m_capacity;
+}
+
+void PCMPool::setCapacity(int capacity)
+{
+  pthread_mutex_lock(&m_mutex);
+  m_capacity = capacity > 0 ? capacity : 0;
+  trim();
+  pthread_mutex_unlock(&m_mutex);
+}
+
+int PCMPool::size(void)
+{
+  pthread_mutex_lock(&m_mutex);
+  int retVal = m_handles.size();
+  pthread_mutex_unlock(&m_mutex);
+  return retVal;
+}
+
+void PCMPool::clear(void)
+{
+  pthread_mutex_lock(&m_mutex);
+  int capacity = m_capacity;
+  m_capacity = 0;
+  trim();
+  m_capacity = capacity;
+  pthread_mutex_unlock(&m_mutex);
+}
+
+// Close devices exceeding the capacity. The mutex must be locked by the caller.
+void PCMPool::trim(void)
+{
+  while ((int)m_handles.size() > m_capacity) {
+    multimap<PCMConfig, PCMHandle>::iterator i = m_handles.begin();
+    snd_pcm_close(i->second.pcm);
+    m_handles.erase(i);
+  };
+}
+
+PCMHandle PCMPool::open(const PCMConfig &config) throw (Error)
+{
+  PCMHandle retVal;
+  retVal.pcm = NULL;
+  retVal.rate = config.rate;
+  retVal.periodSize = 1024;
+  retVal.bufferSize = 0;
+  retVal.periods = 0;
+  bool capture = config.stream == SND_PCM_STREAM_CAPTURE;
+  const string &name = config.name;
+  try {
+    snd_pcm_hw_params_t *hwParams;
+    snd_pcm_hw_params_alloca(&hwParams);
+    int err = snd_pcm_open(&retVal.pcm, name.c_str(), config.stream,
+                           capture ? 0 : SND_PCM_NONBLOCK);
+    ERRORMACRO(err >= 0, Error, , "Error opening PCM device \"" << name
+               << "\": " << snd_strerror(err));
+    err = snd_pcm_hw_params_any(retVal.pcm, hwParams);
+    ERRORMACRO(err >= 0, Error, , "Unable to configure the PCM device \""
+               << name << "\": " << snd_strerror(err));
+    err = snd_pcm_hw_params_set_access(retVal.pcm, hwParams,
+                                       config.mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED :
+                                                     SND_PCM_ACCESS_RW_INTERLEAVED);
+    ERRORMACRO(err >= 0, Error, , "Error setting PCM device \""
+               << name << "\" to " << (config.mmap ? "memory-mapped " : "")
+               << "interlaced access: " << snd_strerror(err));
+    err = snd_pcm_hw_params_set_format(retVal.pcm, hwParams, alsaFormat(config.format));
+    ERRORMACRO(err >= 0, Error, , "Error setting PCM device \"" << name
+               << "\" to " << sampleFormatDescription(config.format) << " format: "
+               << snd_strerror(err));
+    err = snd_pcm_hw_params_set_rate_near(retVal.pcm, hwParams, &retVal.rate, 0);
+    ERRORMACRO(err >= 0, Error, , "Error setting sampling rate of PCM device \""
+               << name << "\" to " << config.rate << " Hz: " << snd_strerror(err));
+    err = snd_pcm_hw_params_set_channels(retVal.pcm, hwParams, config.channels);
+    ERRORMACRO(err >= 0, Error, , "Error setting number of channels of PCM device \""
+               << name << "\" to " << config.channels << ": " << snd_strerror(err));
+    unsigned int bufferTime = config.bufferTime;
+    err = snd_pcm_hw_params_set_buffer_time_near(retVal.pcm, hwParams, &bufferTime, NULL);
+    ERRORMACRO(err >= 0, Error, , "Error setting buffer time of PCM device \""
+               << name << "\" to " << config.bufferTime << " us: " << snd_strerror(err));
+    if (config.periodSize > 0) {
+      retVal.periodSize = config.periodSize;
+      err = snd_pcm_hw_params_set_period_size_near(retVal.pcm, hwParams,
+                                                   &retVal.periodSize, NULL);
+      ERRORMACRO(err >= 0, Error, , "Error setting period size of PCM device \""
+                 << name << "\" to " << config.periodSize << " frames: "
+                 << snd_strerror(err));
+    } else {
+      unsigned int periods = config.periods;
+      err = snd_pcm_hw_params_set_periods_near(retVal.pcm, hwParams, &periods, NULL);
+      ERRORMACRO(err >= 0, Error, , "Error setting periods of PCM device \""
+                 << name << "\" to " << config.periods << ": " << snd_strerror(err));
+    };
+    err = snd_pcm_hw_params(retVal.pcm, hwParams);
+    ERRORMACRO(err >= 0, Error, , "Error setting parameters of PCM device \""
+               << name << "\": " << snd_strerror(err));
+    err = snd_pcm_hw_params_get_period_size(hwParams, &retVal.periodSize, NULL);
+    ERRORMACRO(err >= 0, Error, , "Error getting period size of PCM device \""
+               << name << "\": " << snd_strerror(err));
+    err = snd_pcm_hw_params_get_buffer_size(hwParams, &retVal.bufferSize);
+    ERRORMACRO(err >= 0, Error, , "Error getting buffer size of PCM device \""
+               << name << "\": " << snd_strerror(err));
+    err = snd_pcm_hw_params_get_periods(hwParams, &retVal.periods, NULL);
+    ERRORMACRO(err >= 0, Error, , "Error getting number of periods of PCM device \""
+               << name << "\": " << snd_strerror(err));
+    if (capture) {
+      // Captured blocks are timestamped using the status of the device.
+      snd_pcm_sw_params_t *swParams;
+      snd_pcm_sw_params_alloca(&swParams);
+      err = snd_pcm_sw_params_current(retVal.pcm, swParams);
+      ERRORMACRO(err >= 0, Error, , "Error getting software parameters of PCM device \""
+                 << name << "\": " << snd_strerror(err));
+      err = snd_pcm_sw_params_set_tstamp_mode(retVal.pcm, swParams,
+                                              SND_PCM_TSTAMP_ENABLE);
+      ERRORMACRO(err >= 0, Error, , "Error enabling timestamps of PCM device \""
+                 << name << "\": " << snd_strerror(err));
+      err = snd_pcm_sw_params_set_tstamp_type(retVal.pcm, swParams,
+                                              SND_PCM_TSTAMP_TYPE_MONOTONIC);
+      ERRORMACRO(err >= 0, Error, , "Error selecting monotonic timestamps for PCM "
+                 "device \"" << name << "\": " << snd_strerror(err));
+      err = snd_pcm_sw_params(retVal.pcm, swParams);
+      ERRORMACRO(err >= 0, Error, , "Error setting software parameters of PCM device \""
+                 << name << "\": " << snd_strerror(err));
+    };
+  } catch (Error &e) {
+    if (retVal.pcm != NULL) snd_pcm_close(retVal.pcm);
+    throw e;
+  };
+  return retVal;
+}
+
+VALUE PCMPool::registerRubyClass( VALUE rbModule )
+{
+  cRubyClass = rb_define_module_under( rbModule, "AlsaPool" );
+  rb_define_singleton_method( cRubyClass, "capacity", RUBY_METHOD_FUNC( wrapCapacity ), 0 );
+  rb_define_singleton_method( cRubyClass, "capacity=",
+                              RUBY_METHOD_FUNC( wrapSetCapacity ), 1 );
+  rb_define_singleton_method( cRubyClass, "size", RUBY_METHOD_FUNC( wrapSize ), 0 );
+  rb_define_singleton_method( cRubyClass, "clear", RUBY_METHOD_FUNC( wrapClear ), 0 );
+  return cRubyClass;
+}
+
+VALUE PCMPool::wrapCapacity( VALUE rbClass )
+{
+  return INT2NUM( capacity() );
+}
+
+VALUE PCMPool::wrapSetCapacity( VALUE rbClass, VALUE rbCapacity )
+{
+  setCapacity( NUM2INT( rbCapacity ) );
+  return rbCapacity;
+}
+
+VALUE PCMPool::wrapSize( VALUE rbClass )
+{
+  return INT2NUM( size() );
+}
+
+VALUE PCMPool::wrapClear( VALUE rbClass )
+{
+  clear();
+  return rbClass;
+}
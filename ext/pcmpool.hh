@@ -0,0 +1,85 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef PCMPOOL_HH
+#define PCMPOOL_HH
+
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <map>
+#include <string>
+#include "rubyinc.hh"
+#include "error.hh"
+#include "convert.hh"
+
+// Requested parameters of a PCM device. They are also the key of the pool.
+struct PCMConfig
+{
+  PCMConfig(const std::string &name, snd_pcm_stream_t stream, unsigned int rate,
+            unsigned int channels, SampleFormat format, bool mmap,
+            unsigned int bufferTime, unsigned int periods,
+            snd_pcm_uframes_t periodSize);
+  bool operator<(const PCMConfig &other) const;
+  std::string name;
+  snd_pcm_stream_t stream;
+  unsigned int rate;
+  unsigned int channels;
+  SampleFormat format;
+  bool mmap;
+  unsigned int bufferTime;
+  unsigned int periods;
+  snd_pcm_uframes_t periodSize;
+};
+
+// Configured PCM device together with the negotiated parameters.
+struct PCMHandle
+{
+  snd_pcm_t *pcm;
+  unsigned int rate;
+  snd_pcm_uframes_t periodSize;
+  snd_pcm_uframes_t bufferSize;
+  unsigned int periods;
+};
+
+// Process-wide pool of configured PCM devices. Opening a device and negotiating the
+// hardware parameters takes a long time compared with playing a short clip.
+// Closed devices are therefore kept prepared (up to the capacity of the pool) and
+// handed out again when a device with the same parameters is requested. The pool
+// is disabled by default because an idle device in the pool stays unavailable to
+// other processes.
+class PCMPool
+{
+public:
+  static PCMHandle acquire(const PCMConfig &config) throw (Error);
+  static void release(const PCMConfig &config, const PCMHandle &handle);
+  static int capacity(void);
+  static void setCapacity(int capacity);
+  static int size(void);
+  static void clear(void);
+  static VALUE cRubyClass;
+  static VALUE registerRubyClass( VALUE rbModule );
+  static VALUE wrapCapacity( VALUE rbClass );
+  static VALUE wrapSetCapacity( VALUE rbClass, VALUE rbCapacity );
+  static VALUE wrapSize( VALUE rbClass );
+  static VALUE wrapClear( VALUE rbClass );
+protected:
+  static PCMHandle open(const PCMConfig &config) throw (Error);
+  static void trim(void);
+  static std::multimap<PCMConfig, PCMHandle> m_handles;
+  static int m_capacity;
+  static pthread_mutex_t m_mutex;
+};
+
+#endif
@@ -0,0 +1,276 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "recorder.hh"
+
+using namespace std;
+
+// Size of the file header and alignment of the staging buffer and of the writes.
+// The header is padded so that the audio data starts at a block boundary.
+#define BLOCK_ALIGN 4096
+
+RecordContainer parseRecordContainer(const string &name) throw (Error)
+{
+  if (name == "raw") return RECORD_RAW;
+  if (name == "wav") return RECORD_WAV;
+  if (name == "caf") return RECORD_CAF;
+  ERRORMACRO(false, Error, , "Unsupported file format \"" << name
+             << "\" (must be one of raw, wav, or caf)");
+  return RECORD_RAW;
+}
+
+static char *putTag(char *p, const char *tag)
+{
+  memcpy(p, tag, 4);
+  return p + 4;
+}
+
+static char *putLE(char *p, unsigned long long value, int bytes)
+{
+  for (int i=0; i<bytes; i++)
+    *p++ = (char)(value >> (8 * i));
+  return p;
+}
+
+static char *putBE(char *p, unsigned long long value, int bytes)
+{
+  for (int i=bytes-1; i>=0; i--)
+    *p++ = (char)(value >> (8 * i));
+  return p;
+}
+
+Recorder::Recorder(RingBufferPtr ring, const string &path, RecordContainer container,
+                   unsigned int rate, unsigned int channels,
+                   SampleFormat sourceFormat, SampleFormat format) throw (Error):
+  m_ring(ring), m_path(path), m_container(container), m_rate(rate),
+  m_channels(channels), m_sourceFormat(sourceFormat), m_format(format),
+  m_frameSize(sampleSize(format) * channels), m_fd(-1),
+  m_dataOffset(container == RECORD_RAW ? 0 : BLOCK_ALIGN), m_chunk(0),
+  m_staging(NULL), m_stagingSize(0), m_staged(0), m_written(0), m_headerFrames(0),
+  m_frames(0), m_quit(false), m_failed(false), m_threadInitialised(false)
+{
+  // WAV and CAF expect left-aligned samples while 24 bit samples are stored in the
+  // lower bits of 32 bit words.
+  if (m_container != RECORD_RAW && m_format == SAMPLE_S24) m_format = SAMPLE_S32;
+  try {
+    m_chunk = m_ring->size() / 4;
+    if (m_chunk < 1) m_chunk = 1;
+    // One extra block guarantees that a full staging buffer holds at least one
+    // complete block.
+    m_stagingSize = (m_chunk * m_frameSize + 2 * BLOCK_ALIGN - 1) /
+      BLOCK_ALIGN * BLOCK_ALIGN;
+    void *staging = NULL;
+    int err = posix_memalign(&staging, BLOCK_ALIGN, m_stagingSize);
+    ERRORMACRO(err == 0, Error, , "Error allocating " << m_stagingSize
+               << " bytes for recording to \"" << m_path << "\": " << strerror(err));
+    m_staging = (char *)staging;
+    m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    ERRORMACRO(m_fd >= 0, Error, , "Error opening \"" << m_path << "\" for "
+               "recording: " << strerror(errno));
+    writeHeader();
+    err = pthread_create(&m_thread, NULL, staticThreadFunc, this);
+    ERRORMACRO(err == 0, Error, , "Error creating writer thread for \"" << m_path
+               << "\": " << strerror(err));
+    m_threadInitialised = true;
+  } catch (Error &e) {
+    if (m_fd >= 0) ::close(m_fd);
+    free(m_staging);
+    throw e;
+  };
+}
+
+Recorder::~Recorder(void)
+{
+  stop();
+  free(m_staging);
+}
+
+// Stop the writer thread, write the remaining frames, and finalise the header.
+// Errors are kept for "check".
+void Recorder::stop(void)
+{
+  if (m_threadInitialised) {
+    m_quit = true;
+    m_ring->interrupt();
+    pthread_join(m_thread, NULL);
+    m_threadInitialised = false;
+  };
+  if (m_fd >= 0) {
+    if (!m_failed) {
+      try {
+        transfer();
+        flush(true);
+        writeHeader();
+      } catch (Error &e) {
+        m_error = e.what();
+        m_failed = true;
+      };
+    };
+    ::close(m_fd);
+    m_fd = -1;
+  };
+}
+
+void Recorder::check(void) throw (Error)
+{
+  ERRORMACRO(!m_failed, Error, , m_error);
+}
+
+void Recorder::threadFunc(void)
+{
+  while (!m_quit) {
+    try {
+      if (m_ring->count() < m_chunk) m_ring->waitRead(m_chunk);
+      transfer();
+      flush(false);
+      // Rewrite the header about once a second.
+      long long frames = m_written / m_frameSize;
+      if (frames - m_headerFrames >= m_rate) {
+        writeHeader();
+        m_headerFrames = frames;
+      };
+    } catch (Error &e) {
+      m_error = e.what();
+      m_failed = true;
+      break;
+    };
+  };
+}
+
+// Move all available frames from the ring buffer to the staging buffer. Full
+// blocks are written to the file when the staging buffer runs out of space.
+void Recorder::transfer(void) throw (Error)
+{
+  while (true) {
+    int n = (int)((m_stagingSize - m_staged) / m_frameSize);
+    if (n == 0) {
+      flush(false);
+      continue;
+    };
+    char *region = m_ring->readRegion(n);
+    if (n == 0) break;
+    convertSamples(region, m_sourceFormat, m_staging + m_staged, m_format,
+                   n * m_channels);
+    // The audio thread may have dropped the region while it was being copied.
+    if (m_ring->tryCommitRead(n)) {
+      m_staged += n * m_frameSize;
+      m_frames += n;
+    };
+  };
+}
+
+// Write the complete blocks of the staging buffer or everything if "all" is set.
+void Recorder::flush(bool all) throw (Error)
+{
+  size_t size = all ? m_staged : m_staged / BLOCK_ALIGN * BLOCK_ALIGN;
+  if (size == 0) return;
+  writeAll(m_staging, size, m_dataOffset + m_written);
+  m_written += size;
+  m_staged -= size;
+  memmove(m_staging, m_staging + size, m_staged);
+}
+
+void Recorder::writeHeader(void) throw (Error)
+{
+  if (m_container == RECORD_RAW) return;
+  char header[BLOCK_ALIGN];
+  memset(header, 0, sizeof(header));
+  char *p = header;
+  bool ieee = m_format == SAMPLE_FLOAT;
+  int bits = sampleSize(m_format) * 8;
+  unsigned long long data = m_written;
+  if (m_container == RECORD_WAV) {
+    // The RIFF sizes saturate at 4 GiB. Use CAF for longer recordings.
+    bool extensible = m_channels > 2;
+    int fmtSize = extensible ? 40 : 16;
+    unsigned long long riff = BLOCK_ALIGN - 8 + data;
+    p = putTag(p, "RIFF");
+    p = putLE(p, riff < 0xFFFFFFFFULL ? riff : 0xFFFFFFFFULL, 4);
+    p = putTag(p, "WAVE");
+    p = putTag(p, "fmt ");
+    p = putLE(p, fmtSize, 4);
+    p = putLE(p, extensible ? 0xFFFE : (ieee ? 3 : 1), 2);
+    p = putLE(p, m_channels, 2);
+    p = putLE(p, m_rate, 4);
+    p = putLE(p, m_rate * m_frameSize, 4);
+    p = putLE(p, m_frameSize, 2);
+    p = putLE(p, bits, 2);
+    if (extensible) {
+      static const unsigned char guid[] =
+        { 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+      p = putLE(p, 22, 2);
+      p = putLE(p, bits, 2);
+      p = putLE(p, 0, 4);
+      p = putLE(p, ieee ? 3 : 1, 4);
+      memcpy(p, guid, sizeof(guid));
+      p += sizeof(guid);
+    };
+    p = putTag(p, "JUNK");
+    p = putLE(p, BLOCK_ALIGN - 36 - fmtSize, 4);
+    p = header + BLOCK_ALIGN - 8;
+    p = putTag(p, "data");
+    p = putLE(p, data < 0xFFFFFFFFULL ? data : 0xFFFFFFFFULL, 4);
+  } else {
+    double rate = m_rate;
+    uint64_t rateBits;
+    memcpy(&rateBits, &rate, sizeof(rateBits));
+    p = putTag(p, "caff");
+    p = putBE(p, 1, 2);
+    p = putBE(p, 0, 2);
+    p = putTag(p, "desc");
+    p = putBE(p, 32, 8);
+    p = putBE(p, rateBits, 8);
+    p = putTag(p, "lpcm");
+    // kCAFLinearPCMFormatFlagIsFloat and kCAFLinearPCMFormatFlagIsLittleEndian
+    p = putBE(p, (ieee ? 1 : 0) | 2, 4);
+    p = putBE(p, m_frameSize, 4);
+    p = putBE(p, 1, 4);
+    p = putBE(p, m_channels, 4);
+    p = putBE(p, bits, 4);
+    p = putTag(p, "free");
+    p = putBE(p, BLOCK_ALIGN - 80, 8);
+    p = header + BLOCK_ALIGN - 16;
+    p = putTag(p, "data");
+    // The chunk includes the edit count preceding the audio data.
+    p = putBE(p, data + 4, 8);
+    p = putBE(p, 0, 4);
+  };
+  writeAll(header, BLOCK_ALIGN, 0);
+}
+
+void Recorder::writeAll(const char *data, size_t size, off_t offset) throw (Error)
+{
+  while (size > 0) {
+    ssize_t n = ::pwrite(m_fd, data, size, offset);
+    if (n < 0 && errno == EINTR) continue;
+    ERRORMACRO(n > 0, Error, , "Error writing to \"" << m_path << "\": "
+               << (n < 0 ? strerror(errno) : "no space left"));
+    data += n;
+    size -= n;
+    offset += n;
+  };
+}
+
+void *Recorder::staticThreadFunc(void *self)
+{
+  ((Recorder *)self)->threadFunc();
+  return self;
+}
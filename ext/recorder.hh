@@ -0,0 +1,85 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef RECORDER_HH
+#define RECORDER_HH
+
+#include <pthread.h>
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+#include "ringbuffer.hh"
+#include "convert.hh"
+
+enum RecordContainer
+{
+  RECORD_RAW,
+  RECORD_WAV,
+  RECORD_CAF
+};
+
+RecordContainer parseRecordContainer(const std::string &name) throw (Error);
+
+// Writer thread which takes the place of Ruby as the consumer of a capture ring
+// buffer and appends the audio frames to a file. Frames are converted into a
+// page-aligned staging buffer and written in large blocks. The header is
+// rewritten about once a second so that the file stays readable if the process
+// dies while recording.
+class Recorder
+{
+public:
+  Recorder(RingBufferPtr ring, const std::string &path, RecordContainer container,
+           unsigned int rate, unsigned int channels, SampleFormat sourceFormat,
+           SampleFormat format) throw (Error);
+  virtual ~Recorder(void);
+  void stop(void);
+  void check(void) throw (Error);
+  long long frames(void) { return m_frames; }
+  const std::string &path(void) { return m_path; }
+protected:
+  void threadFunc(void);
+  void transfer(void) throw (Error);
+  void flush(bool all) throw (Error);
+  void writeHeader(void) throw (Error);
+  void writeAll(const char *data, size_t size, off_t offset) throw (Error);
+  static void *staticThreadFunc(void *self);
+  RingBufferPtr m_ring;
+  std::string m_path;
+  RecordContainer m_container;
+  unsigned int m_rate;
+  unsigned int m_channels;
+  SampleFormat m_sourceFormat;
+  SampleFormat m_format;
+  int m_frameSize;
+  int m_fd;
+  off_t m_dataOffset;
+  int m_chunk;
+  char *m_staging;
+  size_t m_stagingSize;
+  size_t m_staged;
+  long long m_written;
+  long long m_headerFrames;
+  boost::atomic<long long> m_frames;
+  boost::atomic<bool> m_quit;
+  boost::atomic<bool> m_failed;
+  bool m_threadInitialised;
+  std::string m_error;
+  pthread_t m_thread;
+};
+
+typedef boost::shared_ptr< Recorder > RecorderPtr;
+
+#endif
@@ -0,0 +1,162 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cmath>
+#include <cstring>
+#include "convert.hh"
+#include "resampler.hh"
+
+using namespace std;
+
+#define MAX_PHASES 1024
+#define KAISER_BETA 8.0
+#define PASSBAND 0.9
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+  while (b != 0) {
+    unsigned int c = a % b;
+    a = b;
+    b = c;
+  };
+  return a;
+}
+
+// Modified Bessel function of the first kind and order zero.
+static double besselI0(double x)
+{
+  double sum = 1.0, term = 1.0;
+  for (int k=1; k<50 && term > 1e-12 * sum; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  };
+  return sum;
+}
+
+Resampler::Resampler(unsigned int inputRate, unsigned int outputRate, int channels,
+                     int taps, int maxFrames) throw (Error):
+  m_inputRate(inputRate), m_outputRate(outputRate), m_channels(channels),
+  m_position(0), m_fill(0)
+{
+  ERRORMACRO(inputRate > 0 && outputRate > 0, Error, , "Cannot resample from "
+             << inputRate << " Hz to " << outputRate << " Hz");
+  ERRORMACRO(taps >= 4 && taps <= 256, Error, , "Number of resampling filter taps "
+             "must be between 4 and 256 (but was " << taps << ")");
+  unsigned int divisor = gcd(inputRate, outputRate);
+  m_up = outputRate / divisor;
+  m_down = inputRate / divisor;
+  m_phases = m_up < MAX_PHASES ? (int)m_up : MAX_PHASES;
+  // Widen the filter when decimating so that it covers the same number of zero
+  // crossings of the lower cut-off frequency.
+  double ratio = (double)m_down / m_up;
+  if (ratio > 1.0) taps = (int)ceil(taps * ratio);
+  m_taps = (taps + 7) & ~7;
+  double cutoff = PASSBAND * (ratio > 1.0 ? 1.0 / ratio : 1.0);
+  double half = m_taps / 2;
+  m_filter = boost::shared_array<float>(new float[m_phases * m_taps]);
+  for (int p=0; p<m_phases; p++) {
+    float *coefficients = m_filter.get() + p * m_taps;
+    double sum = 0.0;
+    for (int i=0; i<m_taps; i++) {
+      double d = i - (half - 1) - (double)p / m_phases;
+      double x = M_PI * cutoff * d;
+      double sinc = fabs(x) < 1e-9 ? 1.0 : sin(x) / x;
+      double r = d / half;
+      double window = fabs(r) < 1.0 ?
+        besselI0(KAISER_BETA * sqrt(1.0 - r * r)) / besselI0(KAISER_BETA) : 0.0;
+      coefficients[i] = (float)(sinc * window);
+      sum += coefficients[i];
+    };
+    for (int i=0; i<m_taps; i++)
+      coefficients[i] = (float)(coefficients[i] / sum);
+  };
+  m_capacity = (int)ceil(maxFrames * (ratio > 1.0 ? ratio : 1.0) + ratio) + m_taps + 2;
+  m_buffer = boost::shared_array<float>(new float[m_channels * m_capacity]);
+}
+
+Resampler::~Resampler(void)
+{
+}
+
+// Upper bound for the number of input frames required for the specified number of
+// output frames.
+int Resampler::maxInput(int frames)
+{
+  return (int)(frames * m_down / m_up) + m_taps + 2;
+}
+
+// Number of input frames which still have to be pushed before the specified number
+// of output frames can be pulled.
+int Resampler::needed(int frames)
+{
+  if (frames <= 0) return 0;
+  int last = (int)((m_position + (frames - 1) * m_down) / m_up) + m_taps;
+  return last > m_fill ? last - m_fill : 0;
+}
+
+// Number of output frames which can be pulled without pushing more input.
+int Resampler::available(void)
+{
+  if (m_fill < m_taps) return 0;
+  return (int)(((m_fill - m_taps + 1) * m_up - m_position + m_down - 1) / m_down);
+}
+
+// Position of the next output frame relative to the next input frame to be pushed
+// in units of input frames. The value is negative because of the filter delay.
+double Resampler::position(void)
+{
+  return m_taps / 2 - 1 + (double)m_position / m_up - m_fill;
+}
+
+void Resampler::push(const float *data, int frames)
+{
+  if (m_fill + frames > m_capacity) frames = m_capacity - m_fill;
+  for (int c=0; c<m_channels; c++) {
+    float *channel = m_buffer.get() + c * m_capacity + m_fill;
+    for (int i=0; i<frames; i++)
+      channel[i] = data[i * m_channels + c];
+  };
+  m_fill += frames;
+}
+
+void Resampler::pull(float *data, int frames)
+{
+  for (int k=0; k<frames; k++) {
+    long long position = m_position + k * m_down;
+    int base = (int)(position / m_up);
+    int phase = (int)((position % m_up) * m_phases / m_up);
+    const float *coefficients = m_filter.get() + phase * m_taps;
+    for (int c=0; c<m_channels; c++)
+      data[k * m_channels + c] =
+        dotProduct(coefficients, m_buffer.get() + c * m_capacity + base, m_taps);
+  };
+  m_position += frames * m_down;
+  int consumed = (int)(m_position / m_up);
+  m_position %= m_up;
+  if (consumed > m_fill) consumed = m_fill;
+  if (consumed > 0) {
+    for (int c=0; c<m_channels; c++) {
+      float *channel = m_buffer.get() + c * m_capacity;
+      memmove(channel, channel + consumed, (m_fill - consumed) * sizeof(float));
+    };
+    m_fill -= consumed;
+  };
+}
+
+void Resampler::reset(void)
+{
+  m_position = 0;
+  m_fill = 0;
+}
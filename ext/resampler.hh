@@ -0,0 +1,61 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef RESAMPLER_HH
+#define RESAMPLER_HH
+
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+
+// Streaming polyphase resampler for interleaved floating point frames. The ratio of
+// the sampling rates is reduced to a fraction L/M and the position of the next
+// output frame is kept as an exact multiple of 1/L input frames. The filter is a
+// Kaiser-windowed sinc which is precomputed for every phase so that the audio
+// thread only computes dot products. Input frames are kept in one planar buffer
+// per channel so that the dot products run over contiguous memory.
+class Resampler
+{
+public:
+  Resampler(unsigned int inputRate, unsigned int outputRate, int channels,
+            int taps, int maxFrames) throw (Error);
+  virtual ~Resampler(void);
+  unsigned int inputRate(void) { return m_inputRate; }
+  unsigned int outputRate(void) { return m_outputRate; }
+  int taps(void) { return m_taps; }
+  int maxInput(int frames);
+  int needed(int frames);
+  int available(void);
+  double position(void);
+  void push(const float *data, int frames);
+  void pull(float *data, int frames);
+  void reset(void);
+protected:
+  unsigned int m_inputRate;
+  unsigned int m_outputRate;
+  int m_channels;
+  int m_taps;
+  long long m_up;
+  long long m_down;
+  int m_phases;
+  long long m_position;
+  int m_capacity;
+  int m_fill;
+  boost::shared_array<float> m_filter;
+  boost::shared_array<float> m_buffer;
+};
+
+typedef boost::shared_ptr< Resampler > ResamplerPtr;
+
+#endif
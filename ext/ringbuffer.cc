@@ -0,0 +1,260 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <cstring>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <boost/static_assert.hpp>
+#include "ringbuffer.hh"
+
+using namespace std;
+
+OverflowPolicy parseOverflowPolicy(const string &name) throw (Error)
+{
+  if (name == "block") return OVERFLOW_BLOCK;
+  if (name == "drop_oldest") return OVERFLOW_DROP_OLDEST;
+  if (name == "drop_newest") return OVERFLOW_DROP_NEWEST;
+  if (name == "short") return OVERFLOW_SHORT;
+  if (name == "error") return OVERFLOW_ERROR;
+  ERRORMACRO(false, Error, , "Unsupported overflow policy \"" << name
+             << "\" (must be one of block, drop_oldest, drop_newest, short, or "
+             "error)");
+  return OVERFLOW_BLOCK;
+}
+
+const char *overflowPolicyName(OverflowPolicy policy)
+{
+  switch (policy) {
+  case OVERFLOW_DROP_OLDEST:
+    return "drop_oldest";
+  case OVERFLOW_DROP_NEWEST:
+    return "drop_newest";
+  case OVERFLOW_SHORT:
+    return "short";
+  case OVERFLOW_ERROR:
+    return "error";
+  default:
+    return "block";
+  };
+}
+
+RingBuffer::RingBuffer(int frames, int frameSize) throw (Error):
+  m_frameSize(frameSize), m_mask(0), m_head(0), m_tail(0), m_waiting(0),
+  m_discard(0), m_readTail(0), m_interrupted(false), m_event(0)
+{
+  ERRORMACRO(frames > 0 && frames <= 0x40000000, Error, , "Ring buffer size of "
+             << frames << " frames is out of range");
+  unsigned int size = 1;
+  while (size < (unsigned int)frames) size = 2 * size;
+  m_mask = size - 1;
+  m_data = boost::shared_array<char>(new char[size * m_frameSize]);
+}
+
+RingBuffer::~RingBuffer(void)
+{
+}
+
+int RingBuffer::count(void)
+{
+  return m_head.load() - m_tail.load();
+}
+
+int RingBuffer::space(void)
+{
+  return size() - count();
+}
+
+int RingBuffer::write(const char *data, int frames)
+{
+  int n = 0;
+  while (n < frames) {
+    int m = frames - n;
+    char *region = writeRegion(m);
+    if (m == 0) break;
+    memcpy(region, data + n * m_frameSize, m * m_frameSize);
+    commitWrite(m);
+    n += m;
+  };
+  return n;
+}
+
+int RingBuffer::read(char *data, int frames)
+{
+  int n = 0;
+  while (n < frames) {
+    int m = frames - n;
+    char *region = readRegion(m);
+    if (m == 0) break;
+    memcpy(data + n * m_frameSize, region, m * m_frameSize);
+    commitRead(m);
+    n += m;
+  };
+  return n;
+}
+
+char *RingBuffer::writeRegion(int &frames)
+{
+  unsigned int head = m_head.load(boost::memory_order_relaxed);
+  unsigned int tail = m_tail.load(boost::memory_order_acquire);
+  unsigned int offset = head & m_mask;
+  int n = size() - (int)(head - tail);
+  if (n > (int)(size() - offset)) n = size() - offset;
+  if (frames > n) frames = n;
+  return m_data.get() + offset * m_frameSize;
+}
+
+void RingBuffer::commitWrite(int frames)
+{
+  m_head.fetch_add(frames);
+  notify();
+}
+
+char *RingBuffer::readRegion(int &frames)
+{
+  unsigned int tail = m_tail.load(boost::memory_order_acquire);
+  unsigned int head = m_head.load(boost::memory_order_acquire);
+  m_readTail = tail;
+  unsigned int offset = tail & m_mask;
+  int n = head - tail;
+  if (n > (int)(size() - offset)) n = size() - offset;
+  if (frames > n) frames = n;
+  return m_data.get() + offset * m_frameSize;
+}
+
+void RingBuffer::commitRead(int frames)
+{
+  m_tail.fetch_add(frames);
+  notify();
+}
+
+// Commit a region obtained with readRegion unless the producer has dropped it
+// with dropOldest in the meantime. In that case the region may have been
+// overwritten while it was being copied and the caller has to read again.
+bool RingBuffer::tryCommitRead(int frames)
+{
+  unsigned int tail = m_readTail;
+  if (!m_tail.compare_exchange_strong(tail, tail + frames)) return false;
+  notify();
+  return true;
+}
+
+void RingBuffer::flush(void)
+{
+  m_discard = 0;
+  m_tail.store(m_head.load());
+  notify();
+}
+
+// The producer may not move m_tail. Instead it tells the consumer how many free
+// frames it needs. The next time the consumer calls discardPending it discards as
+// many of the oldest frames as are still missing. The request is a level and not
+// a sum so that it can be withdrawn with zero once the producer has found room.
+void RingBuffer::requestDiscard(int frames)
+{
+  m_discard.store(frames);
+}
+
+int RingBuffer::discardPending(void)
+{
+  if (m_discard.load(boost::memory_order_relaxed) == 0) return 0;
+  int n = count();
+  int frames = m_discard.exchange(0) - (size() - n);
+  if (frames > n) frames = n;
+  if (frames <= 0) return 0;
+  m_tail.fetch_add(frames);
+  notify();
+  return frames;
+}
+
+// Called by the producer to make room by discarding the oldest frames. The
+// consumer has to use tryCommitRead in order to detect overwritten regions.
+int RingBuffer::dropOldest(int frames)
+{
+  unsigned int tail = m_tail.load();
+  while (true) {
+    int n = m_head.load(boost::memory_order_relaxed) - tail;
+    if (frames > n) frames = n;
+    if (frames <= 0) return 0;
+    if (m_tail.compare_exchange_weak(tail, tail + frames)) break;
+  };
+  notify();
+  return frames;
+}
+
+void RingBuffer::prefault(void)
+{
+  // Touch every page so that the audio thread does not take page faults later.
+  memset(m_data.get(), 0, size() * m_frameSize);
+}
+
+// The event counter is read before checking the condition. A commit after that
+// changes the counter so that the futex does not go to sleep.
+bool RingBuffer::waitRead(int frames)
+{
+  if (frames > size()) frames = size();
+  m_waiting.fetch_add(1);
+  while (true) {
+    unsigned int event = m_event.load();
+    if (m_interrupted || count() >= frames) break;
+    sleep(event);
+  };
+  m_waiting.fetch_sub(1);
+  return !m_interrupted.exchange(false);
+}
+
+bool RingBuffer::waitWrite(int frames)
+{
+  if (frames > size()) frames = size();
+  m_waiting.fetch_add(1);
+  while (true) {
+    unsigned int event = m_event.load();
+    if (m_interrupted || space() >= frames) break;
+    sleep(event);
+  };
+  m_waiting.fetch_sub(1);
+  return !m_interrupted.exchange(false);
+}
+
+void RingBuffer::interrupt(void)
+{
+  m_interrupted = true;
+  wake();
+}
+
+// Called after every commit. The commits are sequentially consistent so that
+// either the waiter sees the new position or this sees the waiter.
+void RingBuffer::notify(void)
+{
+  if (m_waiting.load() > 0) wake();
+}
+
+// The futex operates on the value of the atomic counter.
+BOOST_STATIC_ASSERT(sizeof(boost::atomic<unsigned int>) == sizeof(unsigned int));
+
+void RingBuffer::wake(void)
+{
+  m_event.fetch_add(1);
+  syscall(SYS_futex, (unsigned int *)&m_event, FUTEX_WAKE_PRIVATE, INT_MAX, NULL,
+          NULL, 0);
+}
+
+void RingBuffer::sleep(unsigned int event)
+{
+  // Returns straight away if the counter does not hold the expected value any more.
+  syscall(SYS_futex, (unsigned int *)&m_event, FUTEX_WAIT_PRIVATE, event, NULL,
+          NULL, 0);
+}
@@ -0,0 +1,82 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef RINGBUFFER_HH
+#define RINGBUFFER_HH
+
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "error.hh"
+
+// What a producer does when the ring buffer is full.
+enum OverflowPolicy { OVERFLOW_BLOCK, OVERFLOW_DROP_OLDEST, OVERFLOW_DROP_NEWEST,
+                      OVERFLOW_SHORT, OVERFLOW_ERROR };
+
+OverflowPolicy parseOverflowPolicy(const std::string &name) throw (Error);
+
+const char *overflowPolicyName(OverflowPolicy policy);
+
+// Single-producer/single-consumer ring buffer of audio frames. The producer only
+// advances m_head and the consumer only advances m_tail so that neither side ever
+// has to take a lock to transfer data. A thread with nothing to do sleeps on a
+// futex. The other side bumps the event counter and wakes it with a system call
+// without taking a lock, so a real-time audio thread is never blocked by a
+// waiting Ruby thread.
+class RingBuffer
+{
+public:
+  RingBuffer(int frames, int frameSize) throw (Error);
+  virtual ~RingBuffer(void);
+  int size(void) { return m_mask + 1; }
+  int frameSize(void) { return m_frameSize; }
+  int count(void);
+  int space(void);
+  int write(const char *data, int frames);
+  int read(char *data, int frames);
+  char *writeRegion(int &frames);
+  void commitWrite(int frames);
+  char *readRegion(int &frames);
+  void commitRead(int frames);
+  bool tryCommitRead(int frames);
+  unsigned int readPosition(void) { return m_readTail; }
+  unsigned int writePosition(void) { return m_head.load(boost::memory_order_relaxed); }
+  void flush(void);
+  void requestDiscard(int frames);
+  int discardPending(void);
+  int dropOldest(int frames);
+  void prefault(void);
+  bool waitRead(int frames);
+  bool waitWrite(int frames);
+  void interrupt(void);
+protected:
+  void notify(void);
+  void wake(void);
+  void sleep(unsigned int event);
+  boost::shared_array<char> m_data;
+  int m_frameSize;
+  unsigned int m_mask;
+  boost::atomic<unsigned int> m_head;
+  boost::atomic<unsigned int> m_tail;
+  boost::atomic<int> m_waiting;
+  boost::atomic<int> m_discard;
+  unsigned int m_readTail;
+  boost::atomic<bool> m_interrupted;
+  boost::atomic<unsigned int> m_event;
+};
+
+typedef boost::shared_ptr< RingBuffer > RingBufferPtr;
+
+#endif
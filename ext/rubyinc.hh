@@ -23,6 +23,14 @@
 #define gettimeofday rubygettimeofday
 #define timezone rubygettimezone
 #include <ruby.h>
+#include <ruby/thread.h>
+#include <ruby/version.h>
+#if RUBY_API_VERSION_MAJOR > 3 || \
+    ( RUBY_API_VERSION_MAJOR == 3 && RUBY_API_VERSION_MINOR >= 1 )
+#include <ruby/io.h>
+#include <ruby/fiber/scheduler.h>
+#define HAVE_FIBER_SCHEDULER
+#endif
 // #include <version.h>
 #undef timezone
 #undef gettimeofday
@@ -17,30 +17,29 @@
 
 using namespace std;
 
+VALUE Sequence::cMalloc = Qnil;
+VALUE Sequence::cSequence = Qnil;
+VALUE Sequence::rbUBYTE = Qnil;
+ID Sequence::idNew = 0;
+ID Sequence::idImport = 0;
+ID Sequence::idSize = 0;
+ID Sequence::idMemory = 0;
+
 Sequence::Sequence( int size ):
-  m_sequence( Qnil )
+  m_sequence( Qnil ), m_size( size ), m_data( NULL )
 {
-  VALUE mModule = rb_define_module( "Hornetseye" );
-  VALUE cMalloc = rb_define_class_under( mModule, "Malloc", rb_cObject );
-  VALUE cSequence = rb_define_class_under( mModule, "Sequence", rb_cObject );
   VALUE rbSize = INT2NUM( size );
-  VALUE rbMemory = rb_funcall( cMalloc, rb_intern( "new" ), 1, rbSize );
-  m_sequence = rb_funcall( cSequence, rb_intern( "import" ), 3,
-                           rb_const_get( mModule, rb_intern( "UBYTE" ) ),
-                           rbMemory, rbSize );
-}
-
-int Sequence::size(void)
-{
-  return NUM2INT( rb_funcall( m_sequence, rb_intern( "size" ), 0 ) );
+  VALUE rbMemory = rb_funcall( cMalloc, idNew, 1, rbSize );
+  m_sequence = rb_funcall( cSequence, idImport, 3, rbUBYTE, rbMemory, rbSize );
+  Data_Get_Struct( rbMemory, char, m_data );
 }
 
-char *Sequence::data(void)
+Sequence::Sequence( VALUE rbSequence ):
+  m_sequence( rbSequence ), m_size( 0 ), m_data( NULL )
 {
-  VALUE rbMemory = rb_funcall( m_sequence, rb_intern( "memory" ), 0 );
-  char *ptr;
-  Data_Get_Struct( rbMemory, char, ptr );
-  return ptr;
+  m_size = NUM2INT( rb_funcall( m_sequence, idSize, 0 ) );
+  VALUE rbMemory = rb_funcall( m_sequence, idMemory, 0 );
+  Data_Get_Struct( rbMemory, char, m_data );
 }
 
 void Sequence::markRubyMember(void)
@@ -48,3 +47,16 @@ void Sequence::markRubyMember(void)
   rb_gc_mark( m_sequence );
 }
 
+void Sequence::initRuby( VALUE rbModule )
+{
+  cMalloc = rb_define_class_under( rbModule, "Malloc", rb_cObject );
+  cSequence = rb_define_class_under( rbModule, "Sequence", rb_cObject );
+  rbUBYTE = rb_const_get( rbModule, rb_intern( "UBYTE" ) );
+  rb_global_variable( &cMalloc );
+  rb_global_variable( &cSequence );
+  rb_global_variable( &rbUBYTE );
+  idNew = rb_intern( "new" );
+  idImport = rb_intern( "import" );
+  idSize = rb_intern( "size" );
+  idMemory = rb_intern( "memory" );
+}
@@ -24,14 +24,24 @@ class Sequence
 {
 public:
   Sequence( int size );
-  Sequence( VALUE rbSequence ): m_sequence( rbSequence ) {}
+  Sequence( VALUE rbSequence );
   virtual ~Sequence(void) {}
-  int size(void);
-  char *data(void);
+  int size(void) { return m_size; }
+  char *data(void) { return m_data; }
   VALUE rubyObject(void) { return m_sequence; }
   void markRubyMember(void);
+  static void initRuby( VALUE rbModule );
 protected:
   VALUE m_sequence;
+  int m_size;
+  char *m_data;
+  static VALUE cMalloc;
+  static VALUE cSequence;
+  static VALUE rbUBYTE;
+  static ID idNew;
+  static ID idImport;
+  static ID idSize;
+  static ID idMemory;
 };
 
 typedef boost::shared_ptr< Sequence > SequencePtr;
@@ -0,0 +1,71 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <time.h>
+#include "streamstats.hh"
+
+StreamStats::StreamStats(void):
+  m_xruns(0), m_recovered(0), m_errors(0), m_dropped(0), m_frames(0), m_highWater(0),
+  m_blocked(0)
+{
+  for (int i=0; i<LATENCY_BUCKETS; i++)
+    m_latency[i] = 0;
+}
+
+void StreamStats::fill(long frames)
+{
+  if (frames > m_highWater.load(boost::memory_order_relaxed))
+    m_highWater.store(frames, boost::memory_order_relaxed);
+}
+
+void StreamStats::period(long long nanoseconds)
+{
+  long long microseconds = nanoseconds / 1000;
+  int bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && microseconds >= (1LL << bucket))
+    bucket++;
+  increment(m_latency[bucket], 1);
+}
+
+VALUE StreamStats::toHash(void)
+{
+  VALUE rbLatency = rb_ary_new2(LATENCY_BUCKETS);
+  for (int i=0; i<LATENCY_BUCKETS; i++)
+    rb_ary_push(rbLatency, LONG2NUM(m_latency[i].load(boost::memory_order_relaxed)));
+  VALUE rbRetVal = rb_hash_new();
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("xruns")),
+               LONG2NUM(m_xruns.load(boost::memory_order_relaxed)));
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("recovered")),
+               LONG2NUM(m_recovered.load(boost::memory_order_relaxed)));
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("errors")),
+               LONG2NUM(m_errors.load(boost::memory_order_relaxed)));
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("dropped")),
+               LONG2NUM(m_dropped.load(boost::memory_order_relaxed)));
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("frames")),
+               LONG2NUM(m_frames.load(boost::memory_order_relaxed)));
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("high_water")),
+               LONG2NUM(m_highWater.load(boost::memory_order_relaxed)));
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("blocked_time")),
+               rb_float_new(m_blocked.load(boost::memory_order_relaxed) * 1e-9));
+  rb_hash_aset(rbRetVal, ID2SYM(rb_intern("latency")), rbLatency);
+  return rbRetVal;
+}
+
+long long StreamStats::now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
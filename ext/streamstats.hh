@@ -0,0 +1,59 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef STREAMSTATS_HH
+#define STREAMSTATS_HH
+
+#include <boost/atomic.hpp>
+#include "rubyinc.hh"
+
+// Counters of an audio stream. Each counter has a single writer (either the audio
+// thread or the Ruby thread holding the GVL) so that updates are plain relaxed
+// loads and stores without any locking or read-modify-write instructions.
+class StreamStats
+{
+public:
+  // Number of buckets of the period latency histogram. Bucket i counts periods
+  // which took less than 2^i microseconds (and at least 2^(i-1) microseconds).
+  static const int LATENCY_BUCKETS = 21;
+  StreamStats(void);
+  void xrun(void) { increment(m_xruns, 1); }
+  void recovered(void) { increment(m_recovered, 1); }
+  void error(void) { increment(m_errors, 1); }
+  void dropped(long frames) { increment(m_dropped, frames); }
+  long droppedFrames(void) { return m_dropped.load(boost::memory_order_relaxed); }
+  void transferred(long frames) { increment(m_frames, frames); }
+  void fill(long frames);
+  void blocked(long long nanoseconds) { increment(m_blocked, nanoseconds); }
+  void period(long long nanoseconds);
+  VALUE toHash(void);
+  static long long now(void);
+protected:
+  template< typename T, typename U >
+  static void increment(boost::atomic<T> &counter, U value) {
+    counter.store(counter.load(boost::memory_order_relaxed) + value,
+                  boost::memory_order_relaxed);
+  }
+  boost::atomic<long> m_xruns;
+  boost::atomic<long> m_recovered;
+  boost::atomic<long> m_errors;
+  boost::atomic<long> m_dropped;
+  boost::atomic<long> m_frames;
+  boost::atomic<long> m_highWater;
+  boost::atomic<long long> m_blocked;
+  boost::atomic<long> m_latency[LATENCY_BUCKETS];
+};
+
+#endif
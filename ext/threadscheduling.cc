@@ -0,0 +1,113 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <sys/mman.h>
+#include <cerrno>
+#include <cstring>
+#include "threadscheduling.hh"
+
+using namespace std;
+
+ThreadScheduling::ThreadScheduling(void):
+  m_priority(0), m_affinity(false), m_memoryLocked(false)
+{
+  CPU_ZERO(&m_cpus);
+}
+
+void ThreadScheduling::configure(int priority, const vector<int> &cpus,
+                                 bool lockMemory, bool fallback) throw (Error)
+{
+  if (priority > 0) {
+    int minimum = sched_get_priority_min(SCHED_FIFO);
+    int maximum = sched_get_priority_max(SCHED_FIFO);
+    ERRORMACRO(priority >= minimum && priority <= maximum, Error, ,
+               "Real-time priority must be in the range " << minimum << " to "
+               << maximum << " (but was " << priority << ")");
+  };
+  cpu_set_t available;
+  CPU_ZERO(&available);
+  if (!cpus.empty()) {
+    int err = sched_getaffinity(0, sizeof(available), &available);
+    ERRORMACRO(err == 0, Error, , "Error getting CPU affinity of process: "
+               << strerror(errno));
+  };
+  cpu_set_t selected;
+  CPU_ZERO(&selected);
+  for (vector<int>::const_iterator i=cpus.begin(); i!=cpus.end(); i++) {
+    ERRORMACRO(*i >= 0 && *i < CPU_SETSIZE && CPU_ISSET(*i, &available), Error, ,
+               "CPU " << *i << " is not available to this process");
+    CPU_SET(*i, &selected);
+  };
+  m_priority = priority;
+  m_affinity = !cpus.empty();
+  m_cpus = selected;
+  if (m_priority > 0) {
+    // Start a thread which does nothing to find out whether we are allowed to
+    // use real-time scheduling (CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO).
+    pthread_t thread;
+    int err = createThread(&thread, probe, NULL);
+    if (err == 0)
+      pthread_join(thread, NULL);
+    else if (err == EPERM && fallback) {
+      m_priority = 0;
+      err = createThread(&thread, probe, NULL);
+      if (err == 0) pthread_join(thread, NULL);
+    };
+    if (err != 0) {
+      m_priority = 0;
+      ERRORMACRO(err != EPERM, Error, , "Not permitted to use real-time priority "
+                 << priority << " (requires CAP_SYS_NICE or RLIMIT_RTPRIO of at "
+                 "least " << priority << ")");
+      ERRORMACRO(false, Error, , "Error creating audio thread: " << strerror(err));
+    };
+  };
+  if (lockMemory && !m_memoryLocked) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      m_memoryLocked = true;
+    else
+      ERRORMACRO(fallback, Error, , "Error locking memory: " << strerror(errno)
+                 << " (requires CAP_IPC_LOCK or a sufficient RLIMIT_MEMLOCK)");
+  };
+}
+
+int ThreadScheduling::createThread(pthread_t *thread, void *(*func)(void *), void *arg)
+{
+  pthread_attr_t attr;
+  int err = pthread_attr_init(&attr);
+  if (err != 0) return err;
+  initAttributes(&attr);
+  err = pthread_create(thread, &attr, func, arg);
+  pthread_attr_destroy(&attr);
+  return err;
+}
+
+void ThreadScheduling::initAttributes(pthread_attr_t *attr)
+{
+  if (m_priority > 0) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = m_priority;
+    pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+    pthread_attr_setschedparam(attr, &param);
+  };
+  if (m_affinity)
+    pthread_attr_setaffinity_np(attr, sizeof(m_cpus), &m_cpus);
+}
+
+void *ThreadScheduling::probe(void *)
+{
+  return NULL;
+}
@@ -0,0 +1,47 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef THREADSCHEDULING_HH
+#define THREADSCHEDULING_HH
+
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+#include "error.hh"
+
+// Scheduling policy, CPU affinity, and memory locking for an audio thread. The
+// settings are checked when they are configured so that missing privileges are
+// reported (or the fallback to normal scheduling happens) before any audio is
+// transferred.
+class ThreadScheduling
+{
+public:
+  ThreadScheduling(void);
+  void configure(int priority, const std::vector<int> &cpus, bool lockMemory,
+                 bool fallback) throw (Error);
+  int createThread(pthread_t *thread, void *(*func)(void *), void *arg);
+  int priority(void) { return m_priority; }
+  bool realtime(void) { return m_priority > 0; }
+  bool memoryLocked(void) { return m_memoryLocked; }
+protected:
+  void initAttributes(pthread_attr_t *attr);
+  static void *probe(void *arg);
+  int m_priority;
+  bool m_affinity;
+  cpu_set_t m_cpus;
+  bool m_memoryLocked;
+};
+
+#endif
@@ -0,0 +1,117 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include "watermark.hh"
+
+using namespace std;
+
+ID Watermark::idForFd = 0;
+ID Watermark::idAutoclose = 0;
+
+Watermark::Watermark(RingBufferPtr ring, bool space, int level) throw (Error):
+  m_ring(ring), m_space(space), m_fd(-1), m_level(level), m_signalled(false),
+  m_interrupted(false), m_io(Qnil)
+{
+  m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ERRORMACRO(m_fd >= 0, Error, , "Error creating watermark descriptor: "
+             << strerror(errno));
+  update();
+}
+
+Watermark::~Watermark(void)
+{
+  if (m_io != Qnil) rb_gc_unregister_address(&m_io);
+  ::close(m_fd);
+}
+
+void Watermark::setLevel(int level)
+{
+  m_level = level;
+  update();
+}
+
+// Called by the audio thread after it has transferred frames.
+void Watermark::signal(void)
+{
+  if (frames() >= m_level && !m_signalled.exchange(true)) set();
+}
+
+// Called by Ruby after it has transferred frames.
+void Watermark::update(void)
+{
+  if (m_interrupted || frames() >= m_level) {
+    if (!m_signalled.exchange(true)) set();
+  } else if (m_signalled.exchange(false)) {
+    uint64_t value;
+    ssize_t result = ::read(m_fd, &value, sizeof(value));
+    (void)result;
+    // The audio thread may have signalled in between and its event was consumed.
+    if (m_interrupted || frames() >= m_level) {
+      m_signalled = true;
+      set();
+    };
+  };
+}
+
+// Keep the descriptor readable regardless of the level until "resume" is called
+// (e.g. when the audio thread stopped because of an error).
+void Watermark::interrupt(void)
+{
+  m_interrupted = true;
+  m_signalled = true;
+  set();
+}
+
+void Watermark::resume(void)
+{
+  m_interrupted = false;
+}
+
+// IO object for waiting on the descriptor with a fiber scheduler. The object is
+// created on first use and kept for the lifetime of the watermark so that waiting
+// does not allocate Ruby objects. It does not close the descriptor.
+VALUE Watermark::rubyIO(void)
+{
+  if (m_io == Qnil) {
+    VALUE rbIO = rb_funcall(rb_cIO, idForFd, 1, INT2NUM(m_fd));
+    rb_funcall(rbIO, idAutoclose, 1, Qfalse);
+    m_io = rbIO;
+    rb_gc_register_address(&m_io);
+  };
+  return m_io;
+}
+
+void Watermark::initRuby(void)
+{
+  idForFd = rb_intern("for_fd");
+  idAutoclose = rb_intern("autoclose=");
+}
+
+int Watermark::frames(void)
+{
+  return m_space ? m_ring->space() : m_ring->count();
+}
+
+void Watermark::set(void)
+{
+  uint64_t value = 1;
+  ssize_t result = ::write(m_fd, &value, sizeof(value));
+  (void)result;
+}
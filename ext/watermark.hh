@@ -0,0 +1,62 @@
+/* HornetsEye - Computer Vision with Ruby
+   Copyright (C) 2012  Jan Wedekind
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef WATERMARK_HH
+#define WATERMARK_HH
+
+#include <boost/atomic.hpp>
+#include <boost/smart_ptr.hpp>
+#include "rubyinc.hh"
+#include "error.hh"
+#include "ringbuffer.hh"
+
+// Event file descriptor which is readable while the free space (playback) or the
+// fill level (capture) of a ring buffer is at or above a watermark. This lets an
+// event loop wait for many audio streams with one call to select or poll.
+//
+// The audio thread only ever sets the descriptor and Ruby is the only one clearing
+// it so that no lock is required. The descriptor may occasionally be readable
+// although the level has dropped below the watermark in the meantime.
+class Watermark
+{
+public:
+  Watermark(RingBufferPtr ring, bool space, int level) throw (Error);
+  virtual ~Watermark(void);
+  int fd(void) { return m_fd; }
+  int level(void) { return m_level; }
+  void setLevel(int level);
+  void signal(void);
+  void update(void);
+  void interrupt(void);
+  void resume(void);
+  VALUE rubyIO(void);
+  static void initRuby(void);
+protected:
+  int frames(void);
+  void set(void);
+  RingBufferPtr m_ring;
+  bool m_space;
+  int m_fd;
+  boost::atomic<int> m_level;
+  boost::atomic<bool> m_signalled;
+  boost::atomic<bool> m_interrupted;
+  VALUE m_io;
+  static ID idForFd;
+  static ID idAutoclose;
+};
+
+typedef boost::shared_ptr< Watermark > WatermarkPtr;
+
+#endif
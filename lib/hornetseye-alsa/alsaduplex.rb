@@ -0,0 +1,136 @@
+# hornetseye-alsa - Play audio data using libalsa
+# Copyright (C) 2012 Jan Wedekind
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+# Namespace of Hornetseye computer vision library
+module Hornetseye
+
+  # Class for processing audio from a capture device to a playback device
+  #
+  # One audio thread reads each period from the capture device, runs it through a
+  # native processing kernel, and writes the result to the playback device straight
+  # away. The default kernel copies the captured samples and applies {#gain}. The
+  # round-trip latency is the prefill of the playback device plus one period.
+  #
+  # @see AlsaInput
+  # @see AlsaOutput
+  class AlsaDuplex
+
+    class << self
+
+      # Alias for native constructor
+      #
+      # @return [AlsaDuplex] An object for loopback processing.
+      #
+      # @private
+      alias_method :orig_new, :new
+
+      # Open a capture and a playback device and start processing
+      #
+      # @example Monitor the microphone with a latency of two periods
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   duplex = AlsaDuplex.new 'hw:0', 'hw:0', 48_000, 2, :period_size => 128,
+      #                           :priority => 80, :realtime_fallback => true
+      #   sleep 60
+      #   duplex.close
+      #
+      # @param [String] capture_name Name of the capture device.
+      # @param [String] playback_name Name of the playback device.
+      # @param [Integer] rate Sampling rate of both devices.
+      # @param [Integer] channels Number of capture channels.
+      # @param [Hash] options Additional options.
+      # @option options [Integer] :playback_channels Number of playback channels
+      #   (default: same as capture).
+      # @option options [Symbol] :format (:s16) Sample format of both devices.
+      # @option options [Integer] :period_size (256) Period size in frames. Both
+      #   devices must accept the same period size.
+      # @option options [Integer] :periods (3) Number of periods in the buffers of
+      #   the devices.
+      # @option options [Integer] :prefill (1) Number of silent periods written to
+      #   the playback device before starting.
+      # @option options [Float] :tap_time (0) Capacity of the ring buffer for
+      #   reading the processed audio with {#read} in seconds. No samples are kept
+      #   if this is zero.
+      # @option options [Integer] :tap_size Capacity of the tap in frames. This
+      #   takes precedence over +:tap_time+.
+      # @option options [Integer] :priority Run the audio thread with +SCHED_FIFO+
+      #   scheduling and the specified real-time priority (1 to 99).
+      # @option options [Array<Integer>] :cpus Restrict the audio thread to the
+      #   specified CPU cores.
+      # @option options [Boolean] :lock_memory (false) Lock the memory of the process
+      #   using +mlockall+.
+      # @option options [Boolean] :realtime_fallback (false) Use normal scheduling
+      #   instead of raising an error if the process lacks the privileges.
+      # @option options [Boolean] :start (true) Start processing immediately.
+      # @return [AlsaDuplex] An object for loopback processing.
+      def new(capture_name = 'default', playback_name = 'default', rate = 48000,
+              channels = 2, options = {})
+        retval = orig_new capture_name, playback_name, rate, channels,
+                          options[:playback_channels] || channels,
+                          (options[:format] || :s16).to_s,
+                          options[:period_size] || 256, options[:periods] || 3,
+                          options[:prefill] || 1,
+                          options[:tap_size] || (rate * (options[:tap_time] || 0)).round
+        begin
+          if options[:priority] or options[:cpus] or options[:lock_memory]
+            retval.schedule options[:priority] || 0, options[:cpus] || [],
+                            options[:lock_memory] || false,
+                            options[:realtime_fallback] || false
+          end
+          retval.start if options.fetch :start, true
+        rescue
+          retval.close
+          raise
+        end
+        retval
+      end
+
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_read, :read
+
+    # Read processed samples from the tap
+    #
+    # A blocking read operation is used. Other Ruby threads keep running while this
+    # method is waiting. Samples which did not fit into the tap are dropped and
+    # counted in {#stats}.
+    #
+    # @param [Integer] samples Number of samples to read.
+    # @param [Class] typecode Element type of the result.
+    # @return [Node] A two-dimensional array with the processed audio samples.
+    def read(samples, typecode = AlsaInput::TYPECODES[format])
+      sample_format = AlsaInput::SAMPLE_FORMATS[typecode]
+      if sample_format.nil?
+        raise "Audio data must be of type SINT, INT, or SFLOAT (but was #{typecode})"
+      end
+      MultiArray.import typecode, orig_read(samples, sample_format).memory,
+                        playback_channels, samples
+    end
+
+    # Round-trip latency in seconds
+    #
+    # @return [Float] Nominal delay between capturing and playing a sample.
+    def latency_time
+      latency.to_f / rate
+    end
+
+  end
+
+end
@@ -22,6 +22,24 @@ module Hornetseye
   # @see http://www.alsa-project.org/
   class AlsaInput
 
+    # Sample formats for transferring arrays of the supported element types
+    #
+    # @private
+    SAMPLE_FORMATS = { SINT => 's16', INT => 's32', SFLOAT => 'float' }
+
+    # Buffer settings for different use cases
+    #
+    # The profile +:low_latency+ is suitable for live monitoring. The profile
+    # +:throughput+ uses a large buffer and few wakeups for bulk transfers.
+    PROFILES = { :default     => { :buffer_time =>   500_000, :periods => 16 },
+                 :low_latency => { :buffer_time =>    10_000, :periods =>  2 },
+                 :throughput  => { :buffer_time => 2_000_000, :periods =>  4 } }
+
+    # Default element type for each sample format of the sound device
+    #
+    # @private
+    TYPECODES = { :s16 => SINT, :s24 => INT, :s32 => INT, :float => SFLOAT }
+
     class << self
 
       # Alias for native constructor
@@ -42,31 +60,167 @@ module Hornetseye
       #   include Hornetseye
       #   microphone = AlsaInput.new 'default', 44_100, 2
       #
+      # @example Record with a large buffer
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   microphone = AlsaInput.new 'default', 44_100, 2, :profile => :throughput
+      #
+      # @example Capture floating point samples
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   microphone = AlsaInput.new 'default', 44_100, 2, :format => :float
+      #
+      # @example Capture using memory-mapped access
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   microphone = AlsaInput.new 'default', 44_100, 2, :mmap => true
+      #
+      # @example Work at 44.1 kHz even if the device only supports 48 kHz
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   microphone = AlsaInput.new 'hw:0', 44_100, 2, :resample => true
+      #   microphone.rate        # 44100
+      #   microphone.device_rate # 48000
+      #
+      # @example Run the audio thread with real-time priority on the fourth core
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   microphone = AlsaInput.new 'default', 44_100, 2, :priority => 70, :cpus => [3],
+      #     :lock_memory => true
+      #
       # @param [String] pcm_name Name of the PCM device
       # @param [Integer] rate Desired sampling rate.
       # @param [Integer] channels Number of channels (1=mono, 2=stereo).
+      # @param [Hash] options Additional options.
+      # @option options [Symbol] :format (:s16) Sample format of the sound device
+      #   (+:s16+, +:s24+, +:s32+, or +:float+).
+      # @option options [Symbol] :profile (:default) Buffer settings to start from
+      #   (see {PROFILES}).
+      # @option options [Integer] :buffer_time (500_000) Desired size of the audio
+      #   buffer in microseconds.
+      # @option options [Integer] :periods (16) Desired number of periods in the audio
+      #   buffer.
+      # @option options [Integer] :period_size Desired period size in frames. This
+      #   takes precedence over +:periods+.
+      # @option options [Boolean] :mmap (false) Copy samples directly from the memory
+      #   mapped buffer of the device instead of using +snd_pcm_readi+.
+      # @option options [Float] :ring_time Capacity of the ring buffer between the
+      #   audio thread and Ruby in seconds (default: one second or two device
+      #   buffers).
+      # @option options [Integer] :ring_size Capacity of the ring buffer in frames.
+      #   This takes precedence over +:ring_time+. The capacity is rounded up to a
+      #   power of two.
+      # @option options [Symbol] :overflow (:drop_newest) What happens to captured
+      #   samples when Ruby does not read them in time and the ring buffer is full:
+      #   +:drop_newest+ discards the incoming samples, +:drop_oldest+ overwrites
+      #   the oldest samples, and +:error+ discards the incoming samples and makes
+      #   the next call to {#read} raise an exception. Lost samples are counted by
+      #   {#lost_frames}.
+      # @option options [Integer] :priority Run the audio thread with +SCHED_FIFO+
+      #   scheduling and the specified real-time priority (1 to 99).
+      # @option options [Array<Integer>] :cpus Restrict the audio thread to the
+      #   specified CPU cores.
+      # @option options [Boolean] :lock_memory (false) Lock the memory of the process
+      #   using +mlockall+ and prefault the audio buffer.
+      # @option options [Boolean] :realtime_fallback (false) Use normal scheduling
+      #   and unlocked memory instead of raising an error if the process lacks the
+      #   privileges for +:priority+ or +:lock_memory+.
+      # @option options [Boolean,Integer] :resample (false) Convert between the
+      #   desired sampling rate and the one of the device if the device does not
+      #   support the desired rate. An integer selects the number of filter taps per
+      #   phase (default 32). More taps give a steeper filter at a higher cost.
       # @return [AlsaInput] An object for accessing the microphone.
       #
       # @see #rate
-      def new(pcm_name = 'default', rate = 48000, channels = 2)
-        orig_new pcm_name, rate, channels
+      # @see #period_size
+      # @see #buffer_size
+      def new(pcm_name = 'default', rate = 48000, channels = 2, options = {})
+        profile = PROFILES[options[:profile] || :default]
+        raise "Unknown profile #{options[:profile].inspect}" if profile.nil?
+        options = profile.merge options
+        retval = orig_new pcm_name, rate, channels, (options[:format] || :s16).to_s,
+                          options[:mmap] || false, options[:buffer_time],
+                          options[:periods], options[:period_size] || 0,
+                          options[:ring_size] || (rate * (options[:ring_time] || 0)).round,
+                          (options[:overflow] || :drop_newest).to_s
+        if options[:resample]
+          begin
+            retval.resample options[:resample] == true ? 32 : options[:resample]
+          rescue
+            retval.close
+            raise
+          end
+        end
+        if options[:priority] or options[:cpus] or options[:lock_memory]
+          begin
+            retval.schedule options[:priority] || 0, options[:cpus] || [],
+                            options[:lock_memory] || false,
+                            options[:realtime_fallback] || false
+          rescue
+            retval.close
+            raise
+          end
+        end
+        retval
+      end
+
+      # Open sound devices in advance and keep them in the pool
+      #
+      # Objects created later with the same parameters take a prepared device from
+      # the pool instead of opening and configuring a new one. Closed objects return
+      # their device to the pool. The capacity of the pool is increased if
+      # necessary.
+      #
+      # @example Keep a prepared device for short clips
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   AlsaInput.prewarm 'default', 44_100, 2
+      #   microphone = AlsaInput.new 'default', 44_100, 2 # Takes the device from the pool
+      #   microphone.close                                # Returns the device to the pool
+      #
+      # @param [String] pcm_name Name of the PCM device
+      # @param [Integer] rate Desired sampling rate.
+      # @param [Integer] channels Number of channels (1=mono, 2=stereo).
+      # @param [Hash] options Options for opening the devices (see {new}).
+      # @option options [Integer] :count (1) Number of devices to open.
+      # @return [Integer] Number of devices in the pool.
+      #
+      # @see AlsaPool
+      def prewarm(pcm_name = 'default', rate = 48000, channels = 2, options = {})
+        count = options[:count] || 1
+        AlsaPool.capacity = [AlsaPool.capacity, AlsaPool.size + count].max
+        devices = []
+        begin
+          count.times { devices << new(pcm_name, rate, channels, options) }
+        ensure
+          devices.each { |device| device.close }
+        end
+        AlsaPool.size
       end
 
     end
 
     # Alias for native method
     #
-    # @return [Node] A two-dimensional array with short-integer audio samples.
+    # @return [Sequence] A sequence of bytes with the audio samples.
     #
     # @private
     alias_method :orig_read, :read
 
     # Read specified number of samples from the sound device
     #
-    # Audio data is read from the input buffer.
+    # Audio data is read from the input buffer. The samples are converted to the
+    # desired element type (+SINT+, +INT+, or +SFLOAT+). Floating point samples are
+    # in the range -1 to 1.
     #
     # A blocking read operation is used. I.e. the program is blocked until there is
-    # sufficient data available in the audio input buffer.
+    # sufficient data available in the audio input buffer. Other Ruby threads keep
+    # running while this method is waiting. When called from a non-blocking fiber
+    # with a +Fiber.scheduler+ set, only the calling fiber waits and the scheduler
+    # runs other fibers in the meantime.
+    #
+    # If the audio thread stopped because of a device error, the error is raised
+    # by this and every following read until +drop+ is called.
     #
     # @example Read 3 seconds of audio samples
     #   require 'hornetseye_alsa'
@@ -75,9 +229,262 @@ module Hornetseye
     #   data = microphone.read 3 * 44_100
     #
     # @param [Integer] samples Number of samples to read.
-    # @return [Node] A two-dimensional array with short-integer audio samples.
-    def read(samples)
-      MultiArray.import SINT, orig_read(samples).memory, channels, samples
+    # @param [Class] typecode Element type of the result. The default depends on the
+    #        sample format of the sound device.
+    # @return [Node] A two-dimensional array with audio samples.
+    def read(samples, typecode = TYPECODES[format])
+      sample_format = SAMPLE_FORMATS[typecode]
+      if sample_format.nil?
+        raise "Audio data must be of type SINT, INT, or SFLOAT (but was #{typecode})"
+      end
+      MultiArray.import typecode, orig_read(samples, sample_format).memory,
+                        channels, samples
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_read_into, :read_into
+
+    # Read samples from the sound device into an existing array
+    #
+    # The audio samples are copied directly into the memory of the array. No Ruby
+    # objects are allocated so this method is suitable for reading many small blocks.
+    # The array is only validated when it is different from the one passed in the
+    # previous call. The number of samples read is given by the second dimension of
+    # the array.
+    #
+    # @example Repeatedly read blocks of 1024 samples
+    #   require 'hornetseye_alsa'
+    #   include Hornetseye
+    #   microphone = AlsaInput.new 'default', 44_100, 2
+    #   frame = MultiArray.new SINT, 2, 1024
+    #   loop { microphone.read_into frame }
+    #
+    # @param [Node] frame A dense two-dimensional array of +SINT+, +INT+, or
+    #        +SFLOAT+ audio samples.
+    # @return [Node] Returns the parameter +frame+.
+    def read_into(frame)
+      unless frame.equal? @read_into_frame
+        sample_format = SAMPLE_FORMATS[frame.typecode]
+        if sample_format.nil?
+          raise "Audio data must be of type SINT, INT, or SFLOAT (but was " +
+                "#{frame.typecode})"
+        end
+        if frame.dimension != 2
+          raise "Audio frame must have two dimensions (but had #{frame.dimension})"
+        end
+        if frame.shape.first != channels
+          raise "Audio frame must have #{channels} channel(s) but had " +
+                "#{frame.shape.first}"
+        end
+        if frame.memory.nil?
+          raise 'Audio frame must be stored in memory'
+        end
+        # Views such as a subset of the channels or a transposed array are not dense.
+        if frame.strides != [1, channels]
+          raise "Audio frame must be stored densely with strides [1, #{channels}] " +
+                "(but had #{frame.strides.inspect})"
+        end
+        bytes = channels * frame.shape.last * frame.typecode.storage_size
+        if frame.memory.size < bytes
+          raise "Memory of audio frame must have #{bytes} bytes (but had " +
+                "#{frame.memory.size})"
+        end
+        @read_into_frame = frame
+        @read_into_samples = frame.shape.last
+        @read_into_format = sample_format
+      end
+      orig_read_into frame.memory, @read_into_samples, @read_into_format
+      frame
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_read_nonblock, :read_nonblock
+
+    # Read up to the specified number of samples without waiting
+    #
+    # This method is meant for event loops handling many audio streams. Use {#to_io}
+    # to wait until at least {#watermark} samples are available.
+    #
+    # @example Read from an event loop
+    #   require 'hornetseye_alsa'
+    #   include Hornetseye
+    #   microphone = AlsaInput.new 'default', 44_100, 2
+    #   loop do
+    #     IO.select [ microphone ]
+    #     data = microphone.read_nonblock 4096, :exception => false
+    #     process data unless data == :wait_readable
+    #   end
+    #
+    # @param [Integer] samples Maximum number of samples to read.
+    # @param [Hash] options Additional options.
+    # @option options [Class] :typecode Element type of the result. The default
+    #   depends on the sample format of the sound device.
+    # @option options [Boolean] :exception (true) Raise +IO::EAGAINWaitReadable+ if
+    #   no samples are available. Otherwise +:wait_readable+ is returned.
+    # @return [Node,Symbol] A two-dimensional array with the available audio samples.
+    def read_nonblock(samples, options = {})
+      typecode = options[:typecode] || TYPECODES[format]
+      sample_format = SAMPLE_FORMATS[typecode]
+      if sample_format.nil?
+        raise "Audio data must be of type SINT, INT, or SFLOAT (but was #{typecode})"
+      end
+      memory = Malloc.new samples * channels * typecode.storage_size
+      count = orig_read_nonblock memory, samples, sample_format
+      if count == 0 and samples > 0
+        if options.fetch :exception, true
+          raise IO::EAGAINWaitReadable, 'No audio samples available'
+        end
+        return :wait_readable
+      end
+      MultiArray.import typecode, memory, channels, count
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_record_to, :record_to
+
+    # Record audio samples to a file until {#stop_recording} is called
+    #
+    # A writer thread takes the place of {#read} and appends the captured samples to
+    # the file in large blocks. No Ruby code runs while recording. Samples captured
+    # before this call are discarded and {#read} raises an error until
+    # {#stop_recording} is called. The header of the file is updated about once a
+    # second.
+    #
+    # WAV files are limited to 4 GiB. Use CAF for longer recordings.
+    #
+    # @example Record one hour of audio
+    #   require 'hornetseye_alsa'
+    #   include Hornetseye
+    #   microphone = AlsaInput.new 'default', 48_000, 8
+    #   microphone.record_to 'session.caf'
+    #   sleep 3600
+    #   microphone.stop_recording
+    #
+    # @param [String] path Name of the file to create.
+    # @param [Hash] options Additional options.
+    # @option options [Symbol] :format File format (+:wav+, +:caf+, or +:raw+). The
+    #   default depends on the extension of the file name.
+    # @option options [Class] :typecode Element type of the samples in the file. The
+    #   default depends on the sample format of the sound device.
+    # @return [AlsaInput] Returns +self+.
+    def record_to(path, options = {})
+      container = options[:format] ||
+        { '.wav' => :wav, '.caf' => :caf }.fetch(File.extname(path.to_s).downcase, :raw)
+      unless [:wav, :caf, :raw].member? container.to_sym
+        raise "File format must be :wav, :caf, or :raw (but was #{container.inspect})"
+      end
+      typecode = options[:typecode] || TYPECODES[format]
+      sample_format = SAMPLE_FORMATS[typecode]
+      if sample_format.nil?
+        raise "Audio data must be of type SINT, INT, or SFLOAT (but was #{typecode})"
+      end
+      orig_record_to path.to_s, container.to_s, sample_format
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_analyse, :analyse
+
+    # Compute levels and the spectrum of the captured samples in the audio thread
+    #
+    # Every +:hop+ samples the audio thread determines the peak and RMS level of each
+    # channel over the hop and the magnitude spectrum of the last +:fft_size+
+    # samples weighted with a Hann window. The results can be polled with
+    # {#analysis} without reading the samples. Capturing starts when this method is
+    # called. Samples which are not read are dropped once the ring buffer is full
+    # and counted in {#stats}.
+    #
+    # @example Show the level of the microphone
+    #   require 'hornetseye_alsa'
+    #   include Hornetseye
+    #   microphone = AlsaInput.new 'default', 48_000, 2
+    #   microphone.analyse :fft_size => 2048
+    #   loop do
+    #     levels = microphone.analysis[:rms].collect { |r| 20 * Math.log10(r + 1e-9) }
+    #     puts levels.collect { |l| '%6.1f dB' % l }.join(' ')
+    #     sleep 0.1
+    #   end
+    #
+    # @param [Hash] options Additional options.
+    # @option options [Integer] :fft_size (1024) Number of samples in the analysis
+    #   window (power of two).
+    # @option options [Integer] :hop Number of samples between results (default:
+    #   half the FFT size).
+    # @return [AlsaInput] Returns +self+.
+    #
+    # @see #analysis
+    # @see #stop_analysis
+    def analyse(options = {})
+      fft_size = options[:fft_size] || 1024
+      orig_analyse fft_size, options[:hop] || fft_size / 2
+    end
+
+    # Stop computing levels and the spectrum
+    #
+    # @return [AlsaInput] Returns +self+.
+    def stop_analysis
+      orig_analyse 0, 0
+    end
+
+    # Check whether levels and the spectrum are computed
+    #
+    # @return [Boolean] Returns +true+ between {#analyse} and {#stop_analysis}.
+    def analysing?
+      analysis_size > 0
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_analysis, :analysis
+
+    # Get the latest results of the analysis
+    #
+    # The levels and the spectrum always stem from the same hop. The magnitudes are
+    # scaled so that a full-scale sine wave has a magnitude of one.
+    #
+    # @return [Hash,NilClass] A hash with the number of hops analysed so far
+    #         (+:blocks+), the +:peak+ and +:rms+ level of each channel, and the
+    #         magnitude spectrum (+:spectrum+, a two-dimensional array of +SFLOAT+
+    #         values with one column per channel and one row per frequency bin).
+    #         Returns +nil+ if no analysis was requested.
+    #
+    # @see #analyse
+    # @see #bin_frequency
+    def analysis
+      result = orig_analysis
+      return nil if result.nil?
+      blocks, peak, rms, spectrum = *result
+      { :blocks => blocks, :peak => peak, :rms => rms,
+        :spectrum => MultiArray.import(SFLOAT, spectrum.memory, channels,
+                                       analysis_size / 2 + 1) }
+    end
+
+    # Frequency of a bin of the spectrum
+    #
+    # @param [Integer] bin Index of the frequency bin.
+    # @return [Float] Centre frequency of the bin in Hz.
+    def bin_frequency(bin)
+      bin * device_rate.to_f / analysis_size
+    end
+
+    # IO object which is readable while at least {#watermark} samples are available
+    #
+    # The object can be passed to +IO.select+ or registered with an event loop
+    # such as nio4r for reading. Capturing starts when this method is called.
+    # Readiness may occasionally be reported although the samples have been read in
+    # the meantime.
+    #
+    # @return [IO] IO object for waiting until samples can be read.
+    def to_io
+      @watermark_io ||= IO.for_fd watermark_fd, 'r', :autoclose => false
     end
 
   end
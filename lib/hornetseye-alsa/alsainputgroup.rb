@@ -0,0 +1,105 @@
+# hornetseye-alsa - Play audio data using libalsa
+# Copyright (C) 2010 Jan Wedekind
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Namespace of Hornetseye computer vision library
+module Hornetseye
+  # Class for capturing audio samples from several ALSA devices at once
+  #
+  # The devices are serviced by a single audio thread. They are linked where the
+  # driver supports it so that they start simultaneously. Otherwise the first frames
+  # are aligned using the hardware timestamps of the devices.
+  #
+  # @see AlsaInput
+  class AlsaInputGroup
+
+    class << self
+
+      # Alias for native constructor
+      #
+      # @return [AlsaInputGroup] An object for capturing from several devices.
+      #
+      # @private
+      alias_method :orig_new, :new
+
+      # Open several sound devices for synchronised input
+      #
+      # @example Record from two USB sound cards
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   group = AlsaInputGroup.new [ 'hw:1', 'hw:2' ], 48_000, 2
+      #   frame = group.read 4096 # 4 channels, 4096 samples
+      #   group.drift             # e.g. [0.0, 2.1e-05]
+      #
+      # @param [Array<String>] pcm_names Names of the PCM devices.
+      # @param [Integer] rate Desired sampling rate of all devices.
+      # @param [Integer,Array<Integer>] channels Number of channels of each device.
+      # @param [Hash] options Options for opening each device (see {AlsaInput.new}).
+      #   The scheduling options (+:priority+, +:cpus+, ...) apply to the single
+      #   audio thread of the group.
+      # @return [AlsaInputGroup] An object for capturing from several devices.
+      def new(pcm_names, rate = 48000, channels = 2, options = {})
+        devices = []
+        begin
+          pcm_names.each_with_index do |pcm_name, i|
+            devices << AlsaInput.new(pcm_name, rate,
+                                     channels.is_a?(Array) ? channels[i] : channels,
+                                     options)
+          end
+          retval = orig_new devices
+        rescue
+          devices.each { |device| device.close }
+          raise
+        end
+        retval.instance_eval { @devices = devices }
+        retval
+      end
+
+    end
+
+    # Sample format of the sound devices
+    #
+    # @return [Symbol] Sample format of the first device.
+    def format
+      @devices.first.format
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_read, :read
+
+    # Read the specified number of samples from all devices
+    #
+    # The channels of the devices are combined in one array in the order of the
+    # devices. The first sample of each device was captured at the same time. A
+    # blocking read operation is used. Other Ruby threads keep running while this
+    # method is waiting.
+    #
+    # @param [Integer] samples Number of samples to read.
+    # @param [Class] typecode Element type of the result.
+    # @return [Node] A two-dimensional array with the audio samples of all devices.
+    def read(samples, typecode = AlsaInput::TYPECODES[format])
+      sample_format = AlsaInput::SAMPLE_FORMATS[typecode]
+      if sample_format.nil?
+        raise "Audio data must be of type SINT, INT, or SFLOAT (but was #{typecode})"
+      end
+      MultiArray.import typecode, orig_read(samples, sample_format).memory,
+                        channels, samples
+    end
+
+  end
+
+end
@@ -0,0 +1,160 @@
+# hornetseye-alsa - Play audio data using libalsa
+# Copyright (C) 2012 Jan Wedekind
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Namespace of Hornetseye computer vision library
+module Hornetseye
+
+  # Class for playing several audio streams on one ALSA device
+  #
+  # Each stream is written to a voice of the mixer. The audio thread of the device
+  # sums all voices and converts the result to the sample format of the device.
+  # Samples exceeding the range of the device are clipped.
+  #
+  # @see AlsaVoice
+  # @see AlsaOutput
+  class AlsaMixer
+
+    class << self
+
+      # Alias for native constructor
+      #
+      # @return [AlsaMixer] An object for mixing several audio streams.
+      #
+      # @private
+      alias_method :orig_new, :new
+
+      # Open a sound device for playing several audio streams
+      #
+      # @example Play two sine waves at the same time
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   mixer = AlsaMixer.new 'default:0', 44_100, 2
+      #   a = mixer.voice :gain => 0.5
+      #   b = mixer.voice :gain => 0.5
+      #   t = lazy( 44_100 ) { |i| i.to_f / 44_100 }
+      #   a.write Math.sin( t * 2 * Math::PI * 440 ).to_sint.repeat( 2 )
+      #   b.write Math.sin( t * 2 * Math::PI * 660 ).to_sint.repeat( 2 )
+      #   a.close
+      #   b.close
+      #   a.drain
+      #   b.drain
+      #   mixer.close
+      #
+      # @param [String] pcm_name Name of the PCM device
+      # @param [Integer] rate Desired sampling rate.
+      # @param [Integer] channels Number of channels (1=mono, 2=stereo).
+      # @param [Hash] options Options for opening the device (see {AlsaOutput.new}).
+      # @option options [Integer] :max_voices (64) Maximum number of voices playing at
+      #   the same time.
+      # @return [AlsaMixer] An object for mixing several audio streams.
+      def new(pcm_name = 'default:0', rate = 48000, channels = 2, options = {})
+        output = AlsaOutput.new pcm_name, rate, channels, options
+        begin
+          retval = orig_new output, options[:max_voices] || 64
+        rescue
+          output.close
+          raise
+        end
+        retval.instance_eval { @output = output }
+        retval
+      end
+
+    end
+
+    # Sampling rate of the sound device
+    #
+    # @return [Integer] The sampling rate of the sound device.
+    def rate
+      @output.rate
+    end
+
+    # Number of audio channels
+    #
+    # @return [Integer] Number of audio channels of the device and of each voice.
+    def channels
+      @output.channels
+    end
+
+    # Statistics of the sound device
+    #
+    # @return [Hash] Statistics of the output thread (see {AlsaOutput#stats}).
+    def stats
+      @output.stats
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_voice, :voice
+
+    # Add a voice to the mixer
+    #
+    # The voice starts playing as soon as data is written to it. It is removed from
+    # the mixer after it was closed and all its samples were played.
+    #
+    # @param [Hash] options Options of the voice.
+    # @option options [Float] :gain (1.0) Gain applied to the samples of the voice.
+    # @option options [Float] :ring_time (0.5) Capacity of the voice's buffer in
+    #   seconds.
+    # @option options [Integer] :ring_size Capacity of the voice's buffer in frames.
+    #   This takes precedence over +:ring_time+.
+    # @return [AlsaVoice] The new voice.
+    def voice(options = {})
+      orig_voice options[:ring_size] || (rate * (options[:ring_time] || 0.5)).round,
+                 options[:gain] || 1.0
+    end
+
+  end
+
+  # Audio stream played by an {AlsaMixer}
+  #
+  # @see AlsaMixer
+  class AlsaVoice
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_write, :write
+
+    # Write audio samples to the voice
+    #
+    # A blocking write operation is used. Other Ruby threads keep running while this
+    # method is waiting for space in the buffer of the voice.
+    #
+    # @param [Node] frame A two-dimensional array with audio samples.
+    # @return [Node] Returns the parameter +frame+.
+    def write(frame)
+      sample_format = AlsaOutput::SAMPLE_FORMATS[frame.typecode]
+      if sample_format.nil?
+        raise "Audio data must be of type SINT, INT, or SFLOAT (but was " +
+              "#{frame.typecode})"
+      end
+      if frame.dimension != 2
+        raise "Audio frame must have two dimensions (but had #{frame.dimension})"
+      end
+      if frame.shape.first != channels
+        raise "Audio frame must have #{channels} channel(s) but had " +
+              "#{frame.shape.first}"
+      end
+      orig_write Hornetseye::Sequence(UBYTE).
+        new(frame.typecode.storage_size * frame.size, :memory => frame.memory),
+        sample_format
+      frame
+    end
+
+  end
+
+end
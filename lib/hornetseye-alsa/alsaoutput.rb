@@ -22,6 +22,19 @@ module Hornetseye
   # @see http://www.alsa-project.org/
   class AlsaOutput
 
+    # Sample formats for transferring arrays of the supported element types
+    #
+    # @private
+    SAMPLE_FORMATS = { SINT => 's16', INT => 's32', SFLOAT => 'float' }
+
+    # Buffer settings for different use cases
+    #
+    # The profile +:low_latency+ is suitable for live monitoring. The profile
+    # +:throughput+ uses a large buffer and few wakeups for bulk transfers.
+    PROFILES = { :default     => { :buffer_time =>   500_000, :periods => 16 },
+                 :low_latency => { :buffer_time =>    10_000, :periods =>  2 },
+                 :throughput  => { :buffer_time => 2_000_000, :periods =>  4 } }
+
     class << self
 
       # Alias for native constructor
@@ -42,14 +55,140 @@ module Hornetseye
       #   include Hornetseye
       #   speaker = AlsaOutput.new 'default', 44_100, 2
       #
+      # @example Open speakers for live monitoring with low latency
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   speaker = AlsaOutput.new 'default', 44_100, 2, :profile => :low_latency
+      #
+      # @example Play floating point samples on a device supporting them
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   speaker = AlsaOutput.new 'default', 44_100, 2, :format => :float
+      #
+      # @example Play using memory-mapped access
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   speaker = AlsaOutput.new 'default', 44_100, 2, :mmap => true
+      #
+      # @example Work at 44.1 kHz even if the device only supports 48 kHz
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   speaker = AlsaOutput.new 'hw:0', 44_100, 2, :resample => true
+      #   speaker.rate        # 44100
+      #   speaker.device_rate # 48000
+      #
+      # @example Run the audio thread with real-time priority on the fourth core
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   speaker = AlsaOutput.new 'default', 44_100, 2, :priority => 70, :cpus => [3],
+      #     :lock_memory => true
+      #
       # @param [String] pcm_name Name of the PCM device
       # @param [Integer] rate Desired sampling rate.
       # @param [Integer] channels Number of channels (1=mono, 2=stereo).
+      # @param [Hash] options Additional options.
+      # @option options [Symbol] :format (:s16) Sample format of the sound device
+      #   (+:s16+, +:s24+, +:s32+, or +:float+).
+      # @option options [Symbol] :profile (:default) Buffer settings to start from
+      #   (see {PROFILES}).
+      # @option options [Integer] :buffer_time (500_000) Desired size of the audio
+      #   buffer in microseconds.
+      # @option options [Integer] :periods (16) Desired number of periods in the audio
+      #   buffer.
+      # @option options [Integer] :period_size Desired period size in frames. This
+      #   takes precedence over +:periods+.
+      # @option options [Boolean] :mmap (false) Copy samples directly to the memory
+      #   mapped buffer of the device instead of using +snd_pcm_writei+.
+      # @option options [Float] :ring_time Capacity of the ring buffer between Ruby
+      #   and the audio thread in seconds (default: one second or two device
+      #   buffers).
+      # @option options [Integer] :ring_size Capacity of the ring buffer in frames.
+      #   This takes precedence over +:ring_time+. The capacity is rounded up to a
+      #   power of two.
+      # @option options [Symbol] :overflow (:block) What {#write} does when the ring
+      #   buffer is full: +:block+ waits for space, +:drop_oldest+ discards the
+      #   oldest queued samples, and +:short+ returns the number of frames which
+      #   fitted.
+      # @option options [Integer] :priority Run the audio thread with +SCHED_FIFO+
+      #   scheduling and the specified real-time priority (1 to 99).
+      # @option options [Array<Integer>] :cpus Restrict the audio thread to the
+      #   specified CPU cores.
+      # @option options [Boolean] :lock_memory (false) Lock the memory of the process
+      #   using +mlockall+ and prefault the audio buffer.
+      # @option options [Boolean] :realtime_fallback (false) Use normal scheduling
+      #   and unlocked memory instead of raising an error if the process lacks the
+      #   privileges for +:priority+ or +:lock_memory+.
+      # @option options [Boolean,Integer] :resample (false) Convert between the
+      #   desired sampling rate and the one of the device if the device does not
+      #   support the desired rate. An integer selects the number of filter taps per
+      #   phase (default 32). More taps give a steeper filter at a higher cost.
       # @return [AlsaOutput] An object for accessing the speakers.
       #
       # @see #rate
-      def new(pcm_name = 'default', rate = 48000, channels = 2)
-        orig_new pcm_name, rate, channels
+      # @see #period_size
+      # @see #buffer_size
+      def new(pcm_name = 'default', rate = 48000, channels = 2, options = {})
+        profile = PROFILES[options[:profile] || :default]
+        raise "Unknown profile #{options[:profile].inspect}" if profile.nil?
+        options = profile.merge options
+        retval = orig_new pcm_name, rate, channels, (options[:format] || :s16).to_s,
+                          options[:mmap] || false, options[:buffer_time],
+                          options[:periods], options[:period_size] || 0,
+                          options[:ring_size] || (rate * (options[:ring_time] || 0)).round,
+                          (options[:overflow] || :block).to_s
+        if options[:resample]
+          begin
+            retval.resample options[:resample] == true ? 32 : options[:resample]
+          rescue
+            retval.close
+            raise
+          end
+        end
+        if options[:priority] or options[:cpus] or options[:lock_memory]
+          begin
+            retval.schedule options[:priority] || 0, options[:cpus] || [],
+                            options[:lock_memory] || false,
+                            options[:realtime_fallback] || false
+          rescue
+            retval.close
+            raise
+          end
+        end
+        retval
+      end
+
+      # Open sound devices in advance and keep them in the pool
+      #
+      # Objects created later with the same parameters take a prepared device from
+      # the pool instead of opening and configuring a new one. Closed objects return
+      # their device to the pool. The capacity of the pool is increased if
+      # necessary.
+      #
+      # @example Keep a prepared device for short clips
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   AlsaOutput.prewarm 'default', 44_100, 2
+      #   speaker = AlsaOutput.new 'default', 44_100, 2 # Takes the device from the pool
+      #   speaker.close                                 # Returns the device to the pool
+      #
+      # @param [String] pcm_name Name of the PCM device
+      # @param [Integer] rate Desired sampling rate.
+      # @param [Integer] channels Number of channels (1=mono, 2=stereo).
+      # @param [Hash] options Options for opening the devices (see {new}).
+      # @option options [Integer] :count (1) Number of devices to open.
+      # @return [Integer] Number of devices in the pool.
+      #
+      # @see AlsaPool
+      def prewarm(pcm_name = 'default', rate = 48000, channels = 2, options = {})
+        count = options[:count] || 1
+        AlsaPool.capacity = [AlsaPool.capacity, AlsaPool.size + count].max
+        devices = []
+        begin
+          count.times { devices << new(pcm_name, rate, channels, options) }
+        ensure
+          devices.each { |device| device.close }
+        end
+        AlsaPool.size
       end
 
     end
@@ -64,10 +203,18 @@ module Hornetseye
     # The audio data is written to the output buffer of the sound device. Playback is
     # resumed if a buffer underflow occurred earlier. The first dimension of the array
     # with the audio data must match the number of channels of the audio device. The
-    # second dimension is the number of audio samples.
+    # second dimension is the number of audio samples. Arrays of type +SINT+, +INT+,
+    # and +SFLOAT+ are converted to the sample format of the sound device. Floating
+    # point samples are expected to be in the range -1 to 1 and are clipped.
     #
-    # A blocking write operation is used. I.e. the program is blocked until there is
-    # sufficient space in the audio output buffer.
+    # By default a blocking write operation is used. I.e. the program is blocked
+    # until there is sufficient space in the audio output buffer. Other Ruby threads
+    # keep running while this method is waiting. When called from a non-blocking
+    # fiber with a +Fiber.scheduler+ set, only the calling fiber waits and the
+    # scheduler runs other fibers in the meantime. If the device was opened with
+    # +:overflow => :drop_oldest+, the oldest queued samples are discarded to make
+    # room instead. If the device was opened with +:overflow => :short+, only as many
+    # frames as fit into the buffer are written.
     #
     # @example Play a 400Hz tune for 3 seconds
     #   require 'hornetseye_alsa'
@@ -77,12 +224,108 @@ module Hornetseye
     #   wave = lazy( 2, L ) { |j,i| Math.sin( i * 2 * Math::PI / L ) * 0x7FFF }.to_sint
     #   ( 3 * 400 ).times { speaker.write wave }
     #
-    # @param [Node] frame A two-dimensional array of short-integer audio samples.
+    # @param [Node] frame A two-dimensional array of +SINT+, +INT+, or +SFLOAT+
+    #        audio samples.
     #
-    # @return [Node] Returns the parameter +frame+.
+    # @return [Node,Integer] Returns the parameter +frame+ or the number of frames
+    #         written if the overflow policy is +:short+.
     def write( frame )
-      if frame.typecode != SINT
-        raise "Audio data must be of type SINT (but was #{frame.typecode})"
+      written = orig_write bytes(frame), sample_format(frame)
+      overflow == :short ? written : frame
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_write_nonblock, :write_nonblock
+
+    # Write as many audio samples as fit into the buffer without waiting
+    #
+    # This method is meant for event loops handling many audio streams. Use {#to_io}
+    # to wait until there is space for at least {#watermark} samples.
+    #
+    # @example Feed a speaker from an event loop
+    #   require 'hornetseye_alsa'
+    #   include Hornetseye
+    #   speaker = AlsaOutput.new 'default', 44_100, 2
+    #   offset = 0
+    #   while offset < wave.shape.last
+    #     IO.select [ speaker ]
+    #     result = speaker.write_nonblock wave[offset ... wave.shape.last],
+    #                                     :exception => false
+    #     offset += result unless result == :wait_writable
+    #   end
+    #
+    # @param [Node] frame A two-dimensional array of +SINT+, +INT+, or +SFLOAT+
+    #        audio samples.
+    # @param [Hash] options Additional options.
+    # @option options [Boolean] :exception (true) Raise +IO::EAGAINWaitWritable+ if
+    #   the buffer is full. Otherwise +:wait_writable+ is returned.
+    # @return [Integer,Symbol] Number of samples written.
+    def write_nonblock(frame, options = {})
+      written = orig_write_nonblock bytes(frame), sample_format(frame)
+      if written == 0 and frame.shape.last > 0
+        if options.fetch :exception, true
+          raise IO::EAGAINWaitWritable, 'Audio output buffer is full'
+        end
+        return :wait_writable
+      end
+      written
+    end
+
+    # Alias for native method
+    #
+    # @private
+    alias_method :orig_play_file, :play_file
+
+    # Play a WAV or raw file without involving Ruby
+    #
+    # The file is mapped into memory and the audio thread converts the samples
+    # directly from the page cache. Samples written before are discarded and
+    # {#write} raises an error while the file is playing. Use {#drain} to wait until
+    # the file has been played and {#stop_file} to stop early.
+    #
+    # WAV files must contain 16 bit or 32 bit integer or 32 bit floating point
+    # samples. Number of channels and sampling rate of the file must match the
+    # ones of the sound device.
+    #
+    # @example Play a sound clip
+    #   require 'hornetseye_alsa'
+    #   include Hornetseye
+    #   speaker = AlsaOutput.new 'default', 44_100, 2
+    #   speaker.play_file 'clip.wav'
+    #   speaker.drain
+    #
+    # @param [String] path Name of the file.
+    # @param [Hash] options Additional options.
+    # @option options [Symbol] :sample_format Sample format of raw files (+:s16+,
+    #   +:s24+, +:s32+, or +:float+). The default is the sample format of the sound
+    #   device. The samples must be interleaved and have the sampling rate and the
+    #   number of channels of the sound device.
+    # @return [AlsaOutput] Returns +self+.
+    def play_file(path, options = {})
+      orig_play_file path.to_s, (options[:sample_format] || format).to_s
+    end
+
+    # IO object which is readable while there is space for at least {#watermark}
+    # samples
+    #
+    # The object can be passed to +IO.select+ or registered with an event loop
+    # such as nio4r for reading. Readiness may occasionally be reported although
+    # the space has been used up in the meantime.
+    #
+    # @return [IO] IO object for waiting until samples can be written.
+    def to_io
+      @watermark_io ||= IO.for_fd watermark_fd, 'r', :autoclose => false
+    end
+
+    private
+
+    def sample_format(frame)
+      retval = SAMPLE_FORMATS[frame.typecode]
+      if retval.nil?
+        raise "Audio data must be of type SINT, INT, or SFLOAT (but was " +
+              "#{frame.typecode})"
       end
       if frame.dimension != 2
         raise "Audio frame must have two dimensions (but had #{frame.dimension})"
@@ -91,8 +334,12 @@ module Hornetseye
         raise "Audio frame must have #{channels} channel(s) but had " +
               "#{frame.shape.first}"
       end
-      orig_write Hornetseye::Sequence(UBYTE).new 2 * frame.size, :memory => frame.memory 
-      frame
+      retval
+    end
+
+    def bytes(frame)
+      Hornetseye::Sequence(UBYTE).new frame.typecode.storage_size * frame.size,
+                                      :memory => frame.memory
     end
 
   end
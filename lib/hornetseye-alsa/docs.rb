@@ -19,19 +19,209 @@ module Hornetseye
 
   class AlsaInput
 
-    # Get the sampling rate of the sound device
+    # Get the sampling rate of the audio data
     #
     # The sampling rate may be different to the desired sampling rate specified in
-    # the constructor.
+    # the constructor unless +:resample+ was requested.
     #
-    # @return [Integer] The sampling rate of the sound device.
+    # @return [Integer] The sampling rate of the audio data.
     attr_reader :rate
 
+    # Get the sampling rate of the sound device
+    #
+    # @return [Integer] The sampling rate negotiated with the sound device.
+    attr_reader :device_rate
+
     # Number of audio channels
     #
     # @return [Integer] Number of audio channels (1=mono, 2=stereo).
     attr_reader :channels
 
+    # Sample format of the sound device
+    #
+    # @return [Symbol] One of +:s16+, +:s24+, +:s32+, or +:float+.
+    def format
+    end
+
+    # Negotiated period size
+    #
+    # @return [Integer] Number of frames transferred per period.
+    attr_reader :period_size
+
+    # Negotiated size of the audio buffer of the sound device
+    #
+    # @return [Integer] Size of the audio buffer in frames.
+    attr_reader :buffer_size
+
+    # Negotiated number of periods
+    #
+    # @return [Integer] Number of periods in the audio buffer.
+    attr_reader :periods
+
+    # Check whether memory-mapped access is used
+    #
+    # @return [Boolean] Returns +true+ if the device was opened with +:mmap => true+.
+    def mmap?
+    end
+
+    # Capacity of the ring buffer
+    #
+    # @return [Integer] Number of frames which can be queued for Ruby.
+    attr_reader :ring_size
+
+    # Overflow policy of the ring buffer
+    #
+    # @return [Symbol] One of +:drop_newest+, +:drop_oldest+, or +:error+.
+    attr_reader :overflow
+
+    # Number of captured frames lost because the ring buffer was full
+    #
+    # @return [Integer] Number of lost frames since the device was opened.
+    attr_reader :lost_frames
+
+    # Capture time of the first frame returned by the last read
+    #
+    # The time is derived from the hardware timestamps which the audio thread takes
+    # once per period and is interpolated using the sampling rate. It refers to the
+    # monotonic clock (+Process::CLOCK_MONOTONIC+).
+    #
+    # @example Get the capture time of a block
+    #   microphone = AlsaInput.new
+    #   frame = microphone.read 1024
+    #   time = microphone.timestamp
+    #
+    # @return [Float,NilClass] Time in seconds or +nil+ if nothing was read yet.
+    #
+    # @see #frame_index
+    def timestamp
+    end
+
+    # Index of the first frame returned by the last read
+    #
+    # The index counts all frames captured since the device was started including
+    # lost frames.
+    #
+    # @return [Integer,NilClass] Frame index or +nil+ if nothing was read yet.
+    #
+    # @see #timestamp
+    def frame_index
+    end
+
+    # Check whether the audio thread uses real-time scheduling
+    #
+    # @return [Boolean] Returns +false+ if no +:priority+ was requested or if the
+    #         process lacked the privileges and +:realtime_fallback+ was set.
+    def realtime?
+    end
+
+    # Check whether the memory of the process is locked
+    #
+    # @return [Boolean] Returns +true+ if +:lock_memory+ was requested and +mlockall+
+    #         succeeded.
+    def memory_locked?
+    end
+
+    # Convert between the desired sampling rate and the one of the device
+    #
+    # This is called by the constructor if +:resample+ was requested. It has no
+    # effect if the device supports the desired rate.
+    #
+    # @param [Integer] taps Number of filter taps per phase.
+    # @return [Boolean] Returns +true+ if the audio data is resampled.
+    #
+    # @private
+    def resample(taps)
+    end
+
+    # Check whether the audio data is resampled
+    #
+    # @return [Boolean] Returns +true+ if {#rate} differs from {#device_rate}.
+    def resampling?
+    end
+
+    # Watermark of the descriptor returned by {#to_io}
+    #
+    # The descriptor is readable while at least this number of samples are
+    # available. The default is one period.
+    #
+    # @return [Integer] Watermark in samples.
+    attr_accessor :watermark
+
+    # File descriptor signalling the watermark
+    #
+    # @return [Integer] File descriptor of an eventfd.
+    #
+    # @private
+    attr_reader :watermark_fd
+
+    # Stop recording to a file
+    #
+    # The remaining samples are written and the header of the file is finalised.
+    # An error is raised if writing failed or if samples were lost and the device
+    # was opened with +:overflow => :error+.
+    #
+    # @return [Integer] Number of samples written to the file.
+    #
+    # @see #record_to
+    def stop_recording
+    end
+
+    # Check whether samples are being recorded to a file
+    #
+    # @return [Boolean] Returns +true+ between {#record_to} and {#stop_recording}.
+    def recording?
+    end
+
+    # Number of samples recorded so far
+    #
+    # @return [Integer] Number of samples handed to the writer thread.
+    attr_reader :recorded
+
+    # Process captured samples in the audio thread
+    #
+    # Each period is passed through the chain before it is stored in the ring
+    # buffer. The chain must not change the number of channels. Attaching or
+    # detaching a chain briefly restarts the audio thread.
+    #
+    # @param [DSPChain,nil] value Processing chain or +nil+ to detach it.
+    # @return [DSPChain,nil] Returns +value+.
+    attr_writer :chain
+
+    # FFT size of the analysis
+    #
+    # @return [Integer] Number of samples in the analysis window or zero if no
+    #         analysis was requested.
+    attr_reader :analysis_size
+
+    # Hop size of the analysis
+    #
+    # @return [Integer] Number of samples between results or zero if no analysis was
+    #         requested.
+    attr_reader :analysis_hop
+
+    # Restart the analysis
+    #
+    # The audio thread discards the samples analysed so far before processing the
+    # next period.
+    #
+    # @return [AlsaInput] Returns +self+.
+    def reset_analysis
+    end
+
+    # Get counters of the audio stream
+    #
+    # The counters are updated by the audio thread without locking. The hash
+    # contains the number of +:xruns+, the number of +:recovered+ device errors,
+    # the number of unrecoverable +:errors+, the number of +:dropped+ frames, the
+    # number of +:frames+ transferred, the +:high_water+ mark of the ring buffer in
+    # frames, the +:blocked_time+ in seconds spent by Ruby waiting for the ring
+    # buffer, and the +:latency+ histogram of processing a period. Element +i+ of
+    # the histogram counts periods which took less than 2**i microseconds.
+    #
+    # @return [Hash] Counters of the audio stream.
+    def stats
+    end
+
     # Close the audio device
     #
     # @return [AlsaInput] Returns +self+.
@@ -61,19 +251,155 @@ module Hornetseye
   
   class AlsaOutput
 
-    # Get the sampling rate of the sound device
+    # Get the sampling rate of the audio data
     #
     # The sampling rate may be different to the desired sampling rate specified in
-    # the constructor.
+    # the constructor unless +:resample+ was requested.
     #
-    # @return [Integer] The sampling rate of the sound device.
+    # @return [Integer] The sampling rate of the audio data.
     attr_reader :rate
 
+    # Get the sampling rate of the sound device
+    #
+    # @return [Integer] The sampling rate negotiated with the sound device.
+    attr_reader :device_rate
+
     # Number of audio channels
     #
     # @return [Integer] Number of audio channels (1=mono, 2=stereo).
     attr_reader :channels
 
+    # Sample format of the sound device
+    #
+    # @return [Symbol] One of +:s16+, +:s24+, +:s32+, or +:float+.
+    def format
+    end
+
+    # Negotiated period size
+    #
+    # @return [Integer] Number of frames transferred per period.
+    attr_reader :period_size
+
+    # Negotiated size of the audio buffer of the sound device
+    #
+    # @return [Integer] Size of the audio buffer in frames.
+    attr_reader :buffer_size
+
+    # Negotiated number of periods
+    #
+    # @return [Integer] Number of periods in the audio buffer.
+    attr_reader :periods
+
+    # Check whether memory-mapped access is used
+    #
+    # @return [Boolean] Returns +true+ if the device was opened with +:mmap => true+.
+    def mmap?
+    end
+
+    # Capacity of the ring buffer
+    #
+    # @return [Integer] Number of frames which can be queued for the audio thread.
+    attr_reader :ring_size
+
+    # Overflow policy of {#write}
+    #
+    # @return [Symbol] One of +:block+, +:drop_oldest+, or +:short+.
+    attr_reader :overflow
+
+    # Check whether the audio thread uses real-time scheduling
+    #
+    # @return [Boolean] Returns +false+ if no +:priority+ was requested or if the
+    #         process lacked the privileges and +:realtime_fallback+ was set.
+    def realtime?
+    end
+
+    # Check whether the memory of the process is locked
+    #
+    # @return [Boolean] Returns +true+ if +:lock_memory+ was requested and +mlockall+
+    #         succeeded.
+    def memory_locked?
+    end
+
+    # Convert between the desired sampling rate and the one of the device
+    #
+    # This is called by the constructor if +:resample+ was requested. It has no
+    # effect if the device supports the desired rate.
+    #
+    # @param [Integer] taps Number of filter taps per phase.
+    # @return [Boolean] Returns +true+ if the audio data is resampled.
+    #
+    # @private
+    def resample(taps)
+    end
+
+    # Check whether the audio data is resampled
+    #
+    # @return [Boolean] Returns +true+ if {#rate} differs from {#device_rate}.
+    def resampling?
+    end
+
+    # Watermark of the descriptor returned by {#to_io}
+    #
+    # The descriptor is readable while there is space for at least this number of
+    # samples in the buffer. The default is one period.
+    #
+    # @return [Integer] Watermark in samples.
+    attr_accessor :watermark
+
+    # File descriptor signalling the watermark
+    #
+    # @return [Integer] File descriptor of an eventfd.
+    #
+    # @private
+    attr_reader :watermark_fd
+
+    # Stop playing a file
+    #
+    # The audio thread stops immediately. Samples already in the buffer of the
+    # device are still played.
+    #
+    # @return [AlsaOutput] Returns +self+.
+    #
+    # @see #play_file
+    def stop_file
+    end
+
+    # Check whether a file is being played
+    #
+    # @return [Boolean] Returns +true+ until the last sample of the file was handed
+    #   to the sound device.
+    def playing?
+    end
+
+    # Number of samples of the file handed to the sound device so far
+    #
+    # @return [Integer] Position in the file in samples.
+    attr_reader :file_position
+
+    # Process samples in the audio thread before playing them
+    #
+    # Each period is passed through the chain before it is written to the device.
+    # The chain must not change the number of channels. Attaching or detaching a
+    # chain briefly restarts the audio thread.
+    #
+    # @param [DSPChain,nil] value Processing chain or +nil+ to detach it.
+    # @return [DSPChain,nil] Returns +value+.
+    attr_writer :chain
+
+    # Get counters of the audio stream
+    #
+    # The counters are updated by the audio thread without locking. The hash
+    # contains the number of +:xruns+, the number of +:recovered+ device errors,
+    # the number of unrecoverable +:errors+, the number of +:dropped+ frames, the
+    # number of +:frames+ transferred, the +:high_water+ mark of the ring buffer in
+    # frames, the +:blocked_time+ in seconds spent by Ruby waiting for the ring
+    # buffer, and the +:latency+ histogram of processing a period. Element +i+ of
+    # the histogram counts periods which took less than 2**i microseconds.
+    #
+    # @return [Hash] Counters of the audio stream.
+    def stats
+    end
+
     # Close the audio device
     #
     # @return [AlsaOutput] Returns +self+.
@@ -88,6 +414,11 @@ module Hornetseye
 
     # Wait until audio buffer underflows
     #
+    # Other Ruby threads keep running while this method is waiting. Under a
+    # +Fiber.scheduler+ other fibers keep running as well.
+    # If a file is being played (see {#play_file}), the method waits until the end
+    # of the file.
+    #
     # @return [AlsaOutput] Returns +self+.
     def drain
     end
@@ -119,5 +450,383 @@ module Hornetseye
 
   end
 
-end
+  class AlsaInputGroup
+
+    # Stop capturing and close all devices of the group
+    #
+    # @return [AlsaInputGroup] Returns +self+.
+    def close
+    end
+
+    # Number of devices in the group
+    #
+    # @return [Integer] Number of devices.
+    attr_reader :size
+
+    # Sampling rate of the devices
+    #
+    # @return [Integer] Sampling rate of the first device.
+    attr_reader :rate
+
+    # Total number of channels
+    #
+    # @return [Integer] Sum of the number of channels of all devices.
+    attr_reader :channels
+
+    # Check whether all devices are linked
+    #
+    # @return [Boolean] Returns +true+ if the driver allowed linking all devices so
+    #         that they start and stop together.
+    def linked?
+    end
+
+    # Clock drift between the devices
+    #
+    # The streams are aligned when reading starts. Afterwards the capture time of
+    # the last block of each device is compared with the one of the first device.
+    #
+    # @return [Array<Float>] Time offset of each device in seconds.
+    def drift
+    end
+
+  end
+
+  class AlsaDuplex
+
+    # Stop processing and close both devices
+    #
+    # @return [AlsaDuplex] Returns +self+.
+    def close
+    end
+
+    # Start processing
+    #
+    # Both devices are prepared, the playback device is prefilled with silence,
+    # and the devices are started together.
+    #
+    # @return [AlsaDuplex] Returns +self+.
+    def start
+    end
+
+    # Stop processing
+    #
+    # @return [AlsaDuplex] Returns +self+.
+    def stop
+    end
+
+    # Check whether the audio thread is running
+    #
+    # @return [Boolean] Returns +false+ before {#start}, after {#stop}, and after an
+    #   unrecoverable device error.
+    def running?
+    end
+
+    # Gain applied by the default kernel
+    #
+    # The value is picked up by the audio thread with the next period.
+    #
+    # @return [Float] Linear gain.
+    attr_accessor :gain
+
+    # Replace the default kernel with a processing chain
+    #
+    # The chain must convert the capture channels to the playback channels.
+    # {#gain} only applies to the default kernel.
+    #
+    # @param [DSPChain,nil] value Processing chain or +nil+ to restore the default
+    #   kernel.
+    # @return [DSPChain,nil] Returns +value+.
+    attr_writer :chain
+
+    # Sampling rate of both devices
+    #
+    # @return [Integer] Sampling rate in Hz.
+    attr_reader :rate
+
+    # Number of channels of the capture device
+    #
+    # @return [Integer] Number of capture channels.
+    attr_reader :capture_channels
+
+    # Number of channels of the playback device
+    #
+    # @return [Integer] Number of playback channels.
+    attr_reader :playback_channels
+
+    # Sample format of both devices
+    #
+    # @return [Symbol] One of +:s16+, +:s24+, +:s32+, or +:float+.
+    attr_reader :format
+
+    # Period size of both devices
+    #
+    # @return [Integer] Period size in frames.
+    attr_reader :period_size
 
+    # Number of periods in the buffer of the playback device
+    #
+    # @return [Integer] Number of periods.
+    attr_reader :periods
+
+    # Number of silent periods written before starting the playback device
+    #
+    # @return [Integer] Number of periods.
+    attr_reader :prefill
+
+    # Nominal round-trip latency
+    #
+    # @return [Integer] Latency in frames (prefill plus one period).
+    attr_reader :latency
+
+    # Check whether the devices are linked
+    #
+    # @return [Boolean] Returns +true+ if the driver allowed linking the devices so
+    #         that they start and stop together.
+    def linked?
+    end
+
+    # Capacity of the tap
+    #
+    # @return [Integer] Capacity of the ring buffer for {#read} in frames.
+    attr_reader :tap_size
+
+    # Configure scheduling of the audio thread
+    #
+    # @param [Integer] priority Real-time priority or zero for normal scheduling.
+    # @param [Array<Integer>] cpus CPU cores for the audio thread.
+    # @param [Boolean] lock_memory Lock the memory of the process.
+    # @param [Boolean] fallback Fall back to normal scheduling if privileges are
+    #   missing.
+    # @return [AlsaDuplex] Returns +self+.
+    #
+    # @private
+    def schedule(priority, cpus, lock_memory, fallback)
+    end
+
+    # Check whether the audio thread uses real-time scheduling
+    #
+    # @return [Boolean] Returns +true+ if +SCHED_FIFO+ scheduling is used.
+    def realtime?
+    end
+
+    # Get counters of the audio stream
+    #
+    # +:xruns+ counts overruns and underruns after which both devices were
+    # restarted and +:dropped+ counts samples which did not fit into the tap.
+    #
+    # @return [Hash] Counters of the audio stream (see {AlsaInput#stats}).
+    def stats
+    end
+
+  end
+
+  class DSPChain
+
+    # Append a gain stage
+    #
+    # Parameters of the stage: gain, mute (non-zero mutes).
+    #
+    # @param [Float] gain Linear gain.
+    # @return [Integer] Index of the new stage.
+    #
+    # @private
+    def add_gain(gain)
+    end
+
+    # Append a biquad filter
+    #
+    # Parameters of the stage: b0, b1, b2, a1, a2.
+    #
+    # @param [Array<Float>] coefficients Coefficients normalised so that a0 is one.
+    # @return [Integer] Index of the new stage.
+    #
+    # @private
+    def add_biquad(coefficients)
+    end
+
+    # Append a DC blocking filter
+    #
+    # Parameter of the stage: pole of the filter.
+    #
+    # @param [Float] pole Pole between zero and one.
+    # @return [Integer] Index of the new stage.
+    #
+    # @private
+    def add_dc_block(pole)
+    end
+
+    # Append a channel remapping stage
+    #
+    # Parameters of the stage: the weights of the input channels for each output
+    # channel in turn.
+    #
+    # @param [Integer] channels Number of output channels.
+    # @param [Array<Float>] matrix Weights or an empty array for a plain copy.
+    # @return [Integer] Index of the new stage.
+    #
+    # @private
+    def add_remap(channels, matrix)
+    end
+
+    # Number of stages
+    #
+    # @return [Integer] Number of stages in the chain.
+    attr_reader :size
+
+    # Number of input channels
+    #
+    # @return [Integer] Number of channels expected by the first stage.
+    attr_reader :input_channels
+
+    # Number of output channels
+    #
+    # @return [Integer] Number of channels produced by the last stage.
+    attr_reader :output_channels
+
+    # Get the type of a stage
+    #
+    # @param [Integer] stage Index of the stage.
+    # @return [String] One of +gain+, +biquad+, +dc_block+, or +remap+.
+    def stage_name(stage)
+    end
+
+    # Get the parameters of a stage
+    #
+    # @param [Integer] stage Index of the stage.
+    # @return [Array<Float>] Latest values set from Ruby.
+    def parameters(stage)
+    end
+
+    # Change parameters of a stage
+    #
+    # The values are applied together at the start of the next period.
+    #
+    # @param [Integer] stage Index of the stage.
+    # @param [Array<Float>] values New values.
+    # @param [Integer] offset Index of the first parameter to change.
+    # @return [Array<Float>] Returns +values+.
+    def set_parameters(stage, values, offset)
+    end
+
+    # Clear the states of the filters
+    #
+    # @return [DSPChain] Returns +self+.
+    def reset
+    end
+
+    # Check whether the chain is attached to a device
+    #
+    # @return [Boolean] Returns +true+ if stages cannot be added any more.
+    def attached?
+    end
+
+  end
+
+  class AlsaMixer
+
+    # Stop playing all voices and close the sound device
+    #
+    # @return [AlsaMixer] Returns +self+.
+    def close
+    end
+
+    # Number of voices currently playing
+    #
+    # @return [Integer] Number of voices which were not removed yet.
+    attr_reader :voices
+
+    # Maximum number of voices
+    #
+    # @return [Integer] Maximum number of voices playing at the same time.
+    attr_reader :max_voices
+
+  end
+
+  class AlsaVoice
+
+    # Mark the end of the audio stream
+    #
+    # The remaining samples are still played. Afterwards the voice is removed from
+    # the mixer.
+    #
+    # @return [AlsaVoice] Returns +self+.
+    def close
+    end
+
+    # Check whether the voice was closed
+    #
+    # @return [Boolean] Returns +true+ if {#close} was called.
+    def closed?
+    end
+
+    # Wait until all samples of the voice were mixed
+    #
+    # @return [AlsaVoice] Returns +self+.
+    def drain
+    end
+
+    # Number of audio channels
+    #
+    # @return [Integer] Number of audio channels of the voice.
+    attr_reader :channels
+
+    # Gain applied to the samples of the voice
+    #
+    # The gain can be changed while the voice is playing.
+    #
+    # @return [Float] Current gain.
+    attr_accessor :gain
+
+    # Number of frames waiting to be mixed
+    #
+    # @return [Integer] Number of frames in the buffer of the voice.
+    attr_reader :pending
+
+  end
+
+  # Process-wide pool of configured sound devices
+  #
+  # Opening a sound device and negotiating its parameters can take tens of
+  # milliseconds. If the pool has a non-zero capacity, closed {AlsaOutput} and
+  # {AlsaInput} objects keep their device prepared in the pool. A new object with
+  # the same device name, direction, sampling rate, number of channels, sample
+  # format, and buffer settings reuses it. The pool is disabled by default because
+  # a device in the pool cannot be opened by other processes.
+  #
+  # @example Enable the pool
+  #   require 'hornetseye_alsa'
+  #   include Hornetseye
+  #   AlsaPool.capacity = 4
+  #   AlsaOutput.prewarm 'default', 44_100, 2
+  #
+  # @see AlsaOutput.prewarm
+  # @see AlsaInput.prewarm
+  module AlsaPool
+
+    class << self
+
+      # Maximum number of idle devices kept in the pool
+      #
+      # Reducing the capacity closes devices exceeding it.
+      #
+      # @return [Integer] Maximum number of idle devices (default: 0).
+      attr_accessor :capacity
+
+      # Number of idle devices in the pool
+      #
+      # @return [Integer] Number of devices waiting to be reused.
+      attr_reader :size
+
+      # Close all idle devices in the pool
+      #
+      # The capacity is not changed.
+      #
+      # @return [AlsaPool] Returns +self+.
+      def clear
+      end
+
+    end
+
+  end
+
+end
@@ -0,0 +1,232 @@
+# hornetseye-alsa - Play audio data using libalsa
+# Copyright (C) 2012 Jan Wedekind
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Namespace of Hornetseye computer vision library
+module Hornetseye
+
+  # Chain of native processing stages for an audio thread
+  #
+  # The stages run in the audio thread of an {AlsaInput}, {AlsaOutput}, or
+  # {AlsaDuplex} once per period. Stages can only be added before the chain is
+  # attached to a device. The parameters of the stages can be changed at any time.
+  # The audio thread picks up the new values at the start of the next period
+  # without ever waiting for Ruby.
+  #
+  # @see AlsaInput#chain=
+  # @see AlsaOutput#chain=
+  # @see AlsaDuplex#chain=
+  class DSPChain
+
+    # Filter types supported by {#biquad}
+    BIQUAD_TYPES = [:lowpass, :highpass, :bandpass, :notch, :peak, :lowshelf,
+                    :highshelf]
+
+    class << self
+
+      # Alias for native constructor
+      #
+      # @return [DSPChain] An empty processing chain.
+      #
+      # @private
+      alias_method :orig_new, :new
+
+      # Create an empty processing chain
+      #
+      # @example Remove hum and rumble from a microphone
+      #   require 'hornetseye_alsa'
+      #   include Hornetseye
+      #   input = AlsaInput.new 'default:0', 48_000, 2
+      #   chain = DSPChain.new 2, 48_000
+      #   chain.dc_block
+      #   chain.biquad :notch, 50, :q => 10
+      #   level = chain.gain 2.0
+      #   input.chain = chain
+      #   chain.set_gain level, 0.5
+      #
+      # @param [Integer] channels Number of input channels.
+      # @param [Integer] rate Sampling rate used to design the filters.
+      # @return [DSPChain] An empty processing chain.
+      def new(channels = 2, rate = 48000)
+        retval = orig_new channels
+        retval.rate = rate
+        retval
+      end
+
+      # Coefficients of a biquad filter
+      #
+      # The coefficients are computed with the formulas of Robert Bristow-Johnson's
+      # audio EQ cookbook and are normalised so that +a0+ is one.
+      #
+      # @param [Symbol] type Filter type (see {BIQUAD_TYPES}).
+      # @param [Float] frequency Cutoff or centre frequency in Hz.
+      # @param [Integer] rate Sampling rate in Hz.
+      # @param [Hash] options Additional options.
+      # @option options [Float] :q (0.7071) Quality factor.
+      # @option options [Float] :gain (0) Gain in dB of +:peak+, +:lowshelf+, and
+      #   +:highshelf+ filters.
+      # @return [Array<Float>] The coefficients +b0+, +b1+, +b2+, +a1+, and +a2+.
+      def biquad_coefficients(type, frequency, rate, options = {})
+        w0 = 2 * Math::PI * frequency / rate
+        cos, sin = Math.cos(w0), Math.sin(w0)
+        alpha = sin / (2 * (options[:q] || Math.sqrt(0.5)))
+        a = 10 ** ((options[:gain] || 0).to_f / 40)
+        sq = 2 * Math.sqrt(a) * alpha
+        b0, b1, b2, a0, a1, a2 = case type
+        when :lowpass
+          [(1 - cos) / 2, 1 - cos, (1 - cos) / 2, 1 + alpha, -2 * cos, 1 - alpha]
+        when :highpass
+          [(1 + cos) / 2, -(1 + cos), (1 + cos) / 2, 1 + alpha, -2 * cos, 1 - alpha]
+        when :bandpass
+          [alpha, 0, -alpha, 1 + alpha, -2 * cos, 1 - alpha]
+        when :notch
+          [1, -2 * cos, 1, 1 + alpha, -2 * cos, 1 - alpha]
+        when :peak
+          [1 + alpha * a, -2 * cos, 1 - alpha * a, 1 + alpha / a, -2 * cos,
+           1 - alpha / a]
+        when :lowshelf
+          [a * ((a + 1) - (a - 1) * cos + sq), 2 * a * ((a - 1) - (a + 1) * cos),
+           a * ((a + 1) - (a - 1) * cos - sq), (a + 1) + (a - 1) * cos + sq,
+           -2 * ((a - 1) + (a + 1) * cos), (a + 1) + (a - 1) * cos - sq]
+        when :highshelf
+          [a * ((a + 1) + (a - 1) * cos + sq), -2 * a * ((a - 1) + (a + 1) * cos),
+           a * ((a + 1) + (a - 1) * cos - sq), (a + 1) - (a - 1) * cos + sq,
+           2 * ((a - 1) - (a + 1) * cos), (a + 1) - (a - 1) * cos - sq]
+        else
+          raise "Unknown filter type #{type.inspect} (must be one of " +
+            "#{BIQUAD_TYPES.collect { |t| t.inspect }.join ', '})"
+        end
+        [b0, b1, b2, a1, a2].collect { |c| c.to_f / a0 }
+      end
+
+    end
+
+    # Sampling rate used to design the filters
+    #
+    # @return [Integer] Sampling rate in Hz.
+    attr_accessor :rate
+
+    # Append a gain stage
+    #
+    # Changes of the gain are ramped over one period to avoid clicks.
+    #
+    # @param [Float] value Linear gain.
+    # @return [Integer] Index of the new stage.
+    #
+    # @see #set_gain
+    # @see #mute
+    def gain(value = 1.0)
+      add_gain value
+    end
+
+    # Append a DC blocking filter
+    #
+    # @param [Float] cutoff Cutoff frequency in Hz.
+    # @return [Integer] Index of the new stage.
+    def dc_block(cutoff = 10.0)
+      add_dc_block Math.exp(-2 * Math::PI * cutoff / rate)
+    end
+
+    # Append a biquad filter
+    #
+    # @example Attenuate frequencies above 8 kHz
+    #   chain.biquad :lowpass, 8000
+    #
+    # @param [Symbol] type Filter type (see {BIQUAD_TYPES}).
+    # @param [Float] frequency Cutoff or centre frequency in Hz.
+    # @param [Hash] options Options of {DSPChain.biquad_coefficients}.
+    # @return [Integer] Index of the new stage.
+    #
+    # @see #set_biquad
+    def biquad(type, frequency, options = {})
+      add_biquad DSPChain.biquad_coefficients(type, frequency, rate, options)
+    end
+
+    # Append a channel remapping stage
+    #
+    # @example Swap left and right
+    #   chain.remap [[0, 1], [1, 0]]
+    #
+    # @param [Array<Array<Float>>] matrix One row of input weights for each output
+    #   channel.
+    # @return [Integer] Index of the new stage.
+    def remap(matrix)
+      add_remap matrix.size, matrix.flatten
+    end
+
+    # Append a stage averaging the input channels down to fewer channels
+    #
+    # Input channel +i+ contributes to output channel +i+ modulo +channels+.
+    #
+    # @param [Integer] channels Number of output channels.
+    # @return [Integer] Index of the new stage.
+    def downmix(channels = 1)
+      inputs = output_channels
+      matrix = (0 ... channels).collect do |o|
+        weights = (0 ... inputs).collect { |i| i % channels == o ? 1.0 : 0.0 }
+        count = weights.inject(0.0) { |s, w| s + w }
+        weights.collect { |w| count > 0 ? w / count : w }
+      end
+      remap matrix
+    end
+
+    # Change the gain of a gain stage
+    #
+    # @param [Integer] stage Index of the gain stage.
+    # @param [Float] value Linear gain.
+    # @return [Float] Returns +value+.
+    def set_gain(stage, value)
+      set_parameters stage, [value], 0
+      value
+    end
+
+    # Mute or unmute a gain stage
+    #
+    # @param [Integer] stage Index of the gain stage.
+    # @param [Boolean] muted Whether to mute the stage.
+    # @return [Boolean] Returns +muted+.
+    def mute(stage, muted = true)
+      set_parameters stage, [muted ? 1 : 0], 1
+      muted
+    end
+
+    # Change the response of a biquad filter
+    #
+    # All five coefficients are replaced at once.
+    #
+    # @param [Integer] stage Index of the biquad stage.
+    # @param [Symbol] type Filter type (see {BIQUAD_TYPES}).
+    # @param [Float] frequency Cutoff or centre frequency in Hz.
+    # @param [Hash] options Options of {DSPChain.biquad_coefficients}.
+    # @return [Array<Float>] The new coefficients.
+    def set_biquad(stage, type, frequency, options = {})
+      set_parameters stage, DSPChain.biquad_coefficients(type, frequency, rate,
+                                                         options), 0
+    end
+
+    # Change the weights of a remapping stage
+    #
+    # @param [Integer] stage Index of the remapping stage.
+    # @param [Array<Array<Float>>] matrix One row of input weights for each output
+    #   channel.
+    # @return [Array<Array<Float>>] Returns +matrix+.
+    def set_matrix(stage, matrix)
+      set_parameters stage, matrix.flatten, 0
+      matrix
+    end
+
+  end
+
+end
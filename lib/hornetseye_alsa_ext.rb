@@ -16,3 +16,7 @@
 require 'hornetseye-alsa/alsaoutput'
 require 'hornetseye-alsa/alsainput'
 
+require 'hornetseye-alsa/alsainputgroup'
+require 'hornetseye-alsa/alsamixer'
+require 'hornetseye-alsa/alsaduplex'
+require 'hornetseye-alsa/dspchain'